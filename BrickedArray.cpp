@@ -0,0 +1,147 @@
+#include "BrickedArray.h"
+#include "alignedMemory.h"
+#include <string.h>
+
+BrickedArray::BrickedArray()
+{
+	dim[0] = dim[1] = dim[2] = 0;
+	bricks[0] = bricks[1] = bricks[2] = 0;
+	data = NULL;
+}
+
+BrickedArray::~BrickedArray()
+{
+	clear();
+}
+
+void BrickedArray::clear()
+{
+	if (data)
+	{
+		size_t numBricks = (size_t)bricks[0]*bricks[1]*bricks[2];
+		for (size_t b = 0; b < numBricks; b++)
+			alignedFree(data[b]);
+		delete[] data;
+	}
+	data = NULL;
+	//an empty array has no cells, so nothing walks the brick table of the previous size
+	dim[0] = dim[1] = dim[2] = 0;
+	bricks[0] = bricks[1] = bricks[2] = 0;
+}
+
+void BrickedArray::resize(int dimX, int dimY, int dimZ)
+{
+	clear();
+	dim[0] = dimX;
+	dim[1] = dimY;
+	dim[2] = dimZ;
+	for (int i = 0; i < 3; i++)
+		bricks[i] = (dim[i] + BRICK_SIZE - 1) >> BRICK_SHIFT;
+	size_t numBricks = (size_t)bricks[0]*bricks[1]*bricks[2];
+	//only the brick table is allocated here, the bricks follow when they are written
+	data = new float*[numBricks];
+	for (size_t b = 0; b < numBricks; b++)
+		data[b] = NULL;
+}
+
+float* BrickedArray::allocBrick(size_t brick)
+{
+	if (!data[brick])
+	{
+		float* p = alignedAlloc<float>(BRICK_VOLUME);
+		if (!p)
+			return NULL;
+		memset(p, 0, BRICK_VOLUME*sizeof(float));
+		data[brick] = p;
+	}
+	return data[brick];
+}
+
+int BrickedArray::getDimX() const
+{
+	return dim[0];
+}
+
+int BrickedArray::getDimY() const
+{
+	return dim[1];
+}
+
+int BrickedArray::getDimZ() const
+{
+	return dim[2];
+}
+
+size_t BrickedArray::getMemory() const
+{
+	if (!data)
+		return 0;
+	size_t numBricks = (size_t)bricks[0]*bricks[1]*bricks[2];
+	size_t allocated = 0;
+	for (size_t b = 0; b < numBricks; b++)
+		if (data[b])
+			allocated++;
+	return allocated * BRICK_VOLUME * sizeof(float) + numBricks * sizeof(float*);
+}
+
+float BrickedArray::sample(float x, float y, float z) const
+{
+	if (!data)
+		return 0.0f;
+	float p[3] = {x, y, z};
+	int i0[3];
+	float t[3];
+	//lower corner of the cell, clamped so that the upper corner exists as well
+	for (int i = 0; i < 3; i++)
+	{
+		int maxIndex = (dim[i] > 1) ? dim[i] - 2 : 0;
+		i0[i] = (int)p[i];
+		i0[i] = (i0[i] < 0) ? 0 : ((i0[i] > maxIndex) ? maxIndex : i0[i]);
+		t[i] = p[i] - i0[i];
+		t[i] = (t[i] < 0.0f) ? 0.0f : ((t[i] > 1.0f) ? 1.0f : t[i]);
+	}
+	int x1 = (dim[0] > 1) ? i0[0]+1 : i0[0];
+	int y1 = (dim[1] > 1) ? i0[1]+1 : i0[1];
+	int z1 = (dim[2] > 1) ? i0[2]+1 : i0[2];
+
+	float c00 = (1-t[0])*getValue(i0[0],i0[1],i0[2]) + t[0]*getValue(x1,i0[1],i0[2]);
+	float c10 = (1-t[0])*getValue(i0[0],y1,i0[2]) + t[0]*getValue(x1,y1,i0[2]);
+	float c01 = (1-t[0])*getValue(i0[0],i0[1],z1) + t[0]*getValue(x1,i0[1],z1);
+	float c11 = (1-t[0])*getValue(i0[0],y1,z1) + t[0]*getValue(x1,y1,z1);
+	return (1-t[2])*((1-t[1])*c00 + t[1]*c10) + t[2]*((1-t[1])*c01 + t[1]*c11);
+}
+
+bool BrickedArray::copySlab(const float* rawdata, int z0, int depth, int vtxSize, int offset)
+{
+	size_t sliceSize = (size_t)dim[0]*dim[1];
+	//the bricks of the slab are allocated up front, so a failure is known before anything is copied and the threads below only write
+	for (int bz = z0 >> BRICK_SHIFT; bz <= (z0 + depth - 1) >> BRICK_SHIFT; bz++)
+		for (size_t b = 0; b < (size_t)bricks[0]*bricks[1]; b++)
+			if (!allocBrick((size_t)bz*bricks[0]*bricks[1] + b))
+				return false;
+	//every thread fills whole rows of bricks
+	int brickRows = bricks[1];
+	for (int z = z0; z < z0 + depth; z++)
+	{
+		#pragma omp parallel for schedule(static)
+		for (int by = 0; by < brickRows; by++)
+		{
+			int y1 = ((by+1) << BRICK_SHIFT < dim[1]) ? (by+1) << BRICK_SHIFT : dim[1];
+			for (int y = by << BRICK_SHIFT; y < y1; y++)
+			{
+				const float* row = rawdata + ((z - z0)*sliceSize + (size_t)y*dim[0]) * vtxSize + offset;
+				for (int x = 0; x < dim[0]; x++)
+					setValue(x, y, z, row[(size_t)x*vtxSize]);
+			}
+		}
+	}
+	return true;
+}
+
+void BrickedArray::extractSliceZ(int z, float* dst, int stride) const
+{
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dim[1]; y++)
+		for (int x = 0; x < dim[0]; x++)
+			dst[((size_t)y*dim[0] + x) * stride] = getValue(x, y, z);
+}
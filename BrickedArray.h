@@ -0,0 +1,103 @@
+#ifndef BRICKEDARRAY_H
+#define BRICKEDARRAY_H
+
+#include <stddef.h>
+
+///log2 of the brick edge length, 16x16x16 floats (16 kB) per brick
+#define BRICK_SHIFT 4
+///brick edge length
+#define BRICK_SIZE (1 << BRICK_SHIFT)
+///number of values in one brick
+#define BRICK_VOLUME (BRICK_SIZE*BRICK_SIZE*BRICK_SIZE)
+
+///Stores one float per cell of a 3D structured grid in cubic bricks.
+/**
+* Every brick is a separate aligned allocation, so no single allocation grows with the grid size and all
+* neighbours of a cell (also in Z) are usually inside of the same 16 kB block. Bricks are allocated when first written,
+* reading a brick that has never been written returns 0. All indexes are 64 bit, so grids of 10^9 cells and more can be addressed.
+*/
+class BrickedArray{
+	private:
+		///resolution of the grid in X, Y, Z
+		int dim[3];
+		///number of bricks in X, Y, Z
+		int bricks[3];
+		///one pointer per brick, NULL for bricks that were never written
+		float** data;
+
+		///returns the index of the brick containing the given cell
+		inline size_t getBrick(int x, int y, int z) const;
+		///returns the offset of the given cell inside of its brick
+		inline int getOffset(int x, int y, int z) const;
+		///returns the brick with the given index, allocates it if needed. Returns NULL if the allocation fails.
+		float* allocBrick(size_t brick);
+
+		//bricked arrays own their memory and are not copied
+		BrickedArray(const BrickedArray&);
+		BrickedArray& operator=(const BrickedArray&);
+	public:
+		BrickedArray();
+		///releases all bricks
+		~BrickedArray();
+
+		///sets the resolution, releases all previously stored data
+		void resize(int dimX, int dimY, int dimZ);
+		///releases all bricks
+		void clear();
+
+		///returns the number of cells in X dimension
+		int getDimX() const;
+		///returns the number of cells in Y dimension
+		int getDimY() const;
+		///returns the number of cells in Z dimension
+		int getDimZ() const;
+		///returns the number of bytes currently allocated for bricks
+		size_t getMemory() const;
+
+		///returns the value of the given cell
+		inline float getValue(int x, int y, int z) const;
+		///sets the value of the given cell, returns false if its brick cannot be allocated
+		inline bool setValue(int x, int y, int z, float val);
+		///returns the value at fractional cell indexes by trilinear interpolation, the indexes are clamped to the grid
+		float sample(float x, float y, float z) const;
+
+		///copies one attribute of a slab of whole XY slices into the bricks
+		/**
+		* @param rawdata row-major data of depth slices starting at slice z0, every cell carrying vtxSize values
+		* @param z0 first slice of the slab
+		* @param depth number of slices in the slab
+		* @param vtxSize number of values per cell in rawdata
+		* @param offset offset of the copied attribute
+		* @return false if the bricks of the slab cannot be allocated
+		*/
+		bool copySlab(const float* rawdata, int z0, int depth, int vtxSize, int offset);
+		///writes the XY slice z row-major into dst, with stride floats between consecutive cells
+		void extractSliceZ(int z, float* dst, int stride = 1) const;
+};
+
+inline size_t BrickedArray::getBrick(int x, int y, int z) const
+{
+	return ((size_t)(z >> BRICK_SHIFT) * bricks[1] + (y >> BRICK_SHIFT)) * bricks[0] + (x >> BRICK_SHIFT);
+}
+
+inline int BrickedArray::getOffset(int x, int y, int z) const
+{
+	return ((((z & (BRICK_SIZE-1)) << BRICK_SHIFT) + (y & (BRICK_SIZE-1))) << BRICK_SHIFT) + (x & (BRICK_SIZE-1));
+}
+
+inline float BrickedArray::getValue(int x, int y, int z) const
+{
+	const float* brick = data[getBrick(x,y,z)];
+	return (brick) ? brick[getOffset(x,y,z)] : 0.0f;
+}
+
+inline bool BrickedArray::setValue(int x, int y, int z, float val)
+{
+	float* brick = allocBrick(getBrick(x,y,z));
+	if (!brick)
+		return false;
+	brick[getOffset(x,y,z)] = val;
+	return true;
+}
+
+#endif
@@ -0,0 +1,128 @@
+#include "DomainDecomposition.h"
+
+bool DomainBlock::owns(int x, int y) const
+{
+	return (x >= begin[0]) && (x < end[0]) && (y >= begin[1]) && (y < end[1]);
+}
+
+bool DomainBlock::covers(int x, int y) const
+{
+	return (x >= ghostBegin[0]) && (x < ghostEnd[0]) && (y >= ghostBegin[1]) && (y < ghostEnd[1]);
+}
+
+DomainDecomposition::DomainDecomposition(int dimX, int dimY, int blocksX, int blocksY, int ghostWidth)
+{
+	dim[0] = dimX;
+	dim[1] = dimY;
+	blocks[0] = (blocksX < 1) ? 1 : blocksX;
+	blocks[1] = (blocksY < 1) ? 1 : blocksY;
+	ghost = (ghostWidth < 0) ? 0 : ghostWidth;
+
+	blockList = new DomainBlock[blocks[0]*blocks[1]];
+	for (int by = 0; by < blocks[1]; by++)
+		for (int bx = 0; bx < blocks[0]; bx++)
+		{
+			DomainBlock& b = blockList[by*blocks[0] + bx];
+			int index[2] = {bx, by};
+			b.rank = by*blocks[0] + bx;
+			for (int d = 0; d < 2; d++)
+			{
+				//the remainder is spread over the first blocks, so the sizes differ by at most one vertex
+				b.begin[d] = (int)(((long long)index[d] * dim[d]) / blocks[d]);
+				b.end[d] = (int)(((long long)(index[d]+1) * dim[d]) / blocks[d]);
+				b.ghostBegin[d] = (b.begin[d] - ghost < 0) ? 0 : b.begin[d] - ghost;
+				b.ghostEnd[d] = (b.end[d] + ghost > dim[d]) ? dim[d] : b.end[d] + ghost;
+			}
+		}
+}
+
+DomainDecomposition::~DomainDecomposition()
+{
+	delete[] blockList;
+}
+
+int DomainDecomposition::getNumBlocks() const
+{
+	return blocks[0]*blocks[1];
+}
+
+const DomainBlock& DomainDecomposition::getBlock(int rank) const
+{
+	return blockList[rank];
+}
+
+int DomainDecomposition::findOwner(int x, int y) const
+{
+	if ((x < 0) || (y < 0) || (x >= dim[0]) || (y >= dim[1]))
+		return -1;
+	//inverse of the split in the constructor, corrected by one block if the rounding went the other way
+	int index[2] = {x, y};
+	int b[2];
+	for (int d = 0; d < 2; d++)
+	{
+		b[d] = (int)(((long long)index[d] * blocks[d]) / dim[d]);
+		while ((b[d] > 0) && (index[d] < (int)(((long long)b[d] * dim[d]) / blocks[d])))
+			b[d]--;
+		while ((b[d] < blocks[d]-1) && (index[d] >= (int)(((long long)(b[d]+1) * dim[d]) / blocks[d])))
+			b[d]++;
+	}
+	return b[1]*blocks[0] + b[0];
+}
+
+int DomainDecomposition::getGhostWidth() const
+{
+	return ghost;
+}
+
+int DomainDecomposition::getDimX() const
+{
+	return dim[0];
+}
+
+int DomainDecomposition::getDimY() const
+{
+	return dim[1];
+}
+
+BlockField::BlockField(const DomainBlock& b)
+{
+	block = b;
+	width = block.ghostEnd[0] - block.ghostBegin[0];
+	values = new float[width * (block.ghostEnd[1] - block.ghostBegin[1])]();
+}
+
+BlockField::~BlockField()
+{
+	delete[] values;
+}
+
+float BlockField::sample(float i, float j)
+{
+	//lower left vertex of the cell, clamped to the covered area
+	int x0 = (int)i;
+	int y0 = (int)j;
+	x0 = (x0 < block.ghostBegin[0]) ? block.ghostBegin[0] : ((x0 > block.ghostEnd[0]-2) ? block.ghostEnd[0]-2 : x0);
+	y0 = (y0 < block.ghostBegin[1]) ? block.ghostBegin[1] : ((y0 > block.ghostEnd[1]-2) ? block.ghostEnd[1]-2 : y0);
+	float s = i - x0;
+	float t = j - y0;
+	return (1-t)*((1-s)*at(x0,y0) + s*at(x0+1,y0)) + t*((1-s)*at(x0,y0+1) + s*at(x0+1,y0+1));
+}
+
+const DomainBlock& BlockField::getBlock() const
+{
+	return block;
+}
+
+void BlockField::fillFrom(FlowChannel* channel, FlowGeometry* geometry)
+{
+	for (int y = block.ghostBegin[1]; y < block.ghostEnd[1]; y++)
+		for (int x = block.ghostBegin[0]; x < block.ghostEnd[0]; x++)
+			at(x,y) = channel->getValue(geometry->getVtx(x,y));
+}
+
+void BlockField::storeTo(FlowChannel* channel, FlowGeometry* geometry)
+{
+	for (int y = block.begin[1]; y < block.end[1]; y++)
+		for (int x = block.begin[0]; x < block.end[0]; x++)
+			channel->setValue(geometry->getVtx(x,y), at(x,y));
+}
@@ -0,0 +1,98 @@
+#ifndef DOMAINDECOMPOSITION_H
+#define DOMAINDECOMPOSITION_H
+
+#include "FlowGeometry.h"
+#include "FlowChannel.h"
+
+///one block of a decomposed index space, all bounds are vertex indexes of the whole grid, the ends are exclusive
+struct DomainBlock{
+	///number of the block (and of the worker owning it)
+	int rank;
+	///first owned vertex in X and Y
+	int begin[2];
+	///end of the owned vertices in X and Y
+	int end[2];
+	///first vertex in X and Y including the ghost layer
+	int ghostBegin[2];
+	///end of the vertices in X and Y including the ghost layer
+	int ghostEnd[2];
+
+	///returns true if the vertex (x,y) is owned by this block
+	bool owns(int x, int y) const;
+	///returns true if the vertex (x,y) lies inside of the block or its ghost layer
+	bool covers(int x, int y) const;
+};
+
+///splits the vertex index space of a 2D grid into blocksX x blocksY blocks with ghost layers of a configurable width
+/**
+* Every block is owned by exactly one worker (a thread or a local process). A worker only allocates the data of its block plus the ghost layer,
+* see BlockField, and refreshes the ghost layer through a SharedExchange.
+*/
+class DomainDecomposition{
+	private:
+		///resolution of the decomposed grid
+		int dim[2];
+		///number of blocks in X and Y
+		int blocks[2];
+		///width of the ghost layer in vertices
+		int ghost;
+		///all blocks, row-major
+		DomainBlock* blockList;
+
+		DomainDecomposition(const DomainDecomposition&);
+		DomainDecomposition& operator=(const DomainDecomposition&);
+	public:
+		///splits a grid of dimX x dimY vertices into blocksX x blocksY blocks with ghost layers of ghostWidth vertices
+		DomainDecomposition(int dimX, int dimY, int blocksX, int blocksY, int ghostWidth);
+		~DomainDecomposition();
+
+		///returns the number of blocks
+		int getNumBlocks() const;
+		///returns the block with the given rank
+		const DomainBlock& getBlock(int rank) const;
+		///returns the rank of the block owning the vertex (x,y), -1 if outside of the grid
+		int findOwner(int x, int y) const;
+		///returns the width of the ghost layer
+		int getGhostWidth() const;
+		///returns the number of vertices of the grid in X dimension
+		int getDimX() const;
+		///returns the number of vertices of the grid in Y dimension
+		int getDimY() const;
+};
+
+///values of one channel on one block including the ghost layer, addressed with the vertex indexes of the whole grid
+class BlockField{
+	private:
+		///the block this field belongs to
+		DomainBlock block;
+		///width of the stored area
+		int width;
+		///row-major values of the block including the ghost layer
+		float* values;
+
+		BlockField(const BlockField&);
+		BlockField& operator=(const BlockField&);
+	public:
+		///allocates the storage for the block and its ghost layer
+		BlockField(const DomainBlock& b);
+		~BlockField();
+
+		///returns the value at the vertex (x,y) of the whole grid, which has to be covered by the block
+		inline float& at(int x, int y);
+		///returns the value at fractional vertex indexes by bilinear interpolation. The cell has to be covered by the block, which is true for all owned positions if the ghost layer is at least 1 wide.
+		float sample(float i, float j);
+		///returns the block this field belongs to
+		const DomainBlock& getBlock() const;
+
+		///copies the covered part (owned and ghost vertices) of a channel into this field
+		void fillFrom(FlowChannel* channel, FlowGeometry* geometry);
+		///copies the owned part of this field back into a channel
+		void storeTo(FlowChannel* channel, FlowGeometry* geometry);
+};
+
+inline float& BlockField::at(int x, int y)
+{
+	return values[(y - block.ghostBegin[1])*width + (x - block.ghostBegin[0])];
+}
+
+#endif
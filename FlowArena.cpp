@@ -0,0 +1,161 @@
+#include "FlowArena.h"
+#include "alignedMemory.h"
+#include <stdlib.h>
+#include <iostream>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+FlowArena::FlowArena()
+{
+	usedBytes = 0;
+	idleBytes = 0;
+	generation = 0;
+	reused = 0;
+	allocated = 0;
+	const char* huge = getenv("FLOW_HUGE_PAGES");
+	hugePages = huge && (atoi(huge) != 0);
+}
+
+FlowArena::~FlowArena()
+{
+	trim();
+	for (std::map<void*, int>::iterator it = used.begin(); it != used.end(); ++it)
+		alignedFree(it->first);
+}
+
+int FlowArena::getSizeClass(size_t bytes)
+{
+	int sizeClass = 0;
+	while (getClassBytes(sizeClass) < bytes)
+		sizeClass++;
+	return sizeClass;
+}
+
+size_t FlowArena::getClassBytes(int sizeClass)
+{
+	//four steps between two powers of two, starting at ARENA_MIN_BYTES
+	return (size_t)(4 + (sizeClass & 3)) << ((sizeClass >> 2) + 10);
+}
+
+void* FlowArena::allocateClass(int sizeClass)
+{
+	size_t bytes = getClassBytes(sizeClass);
+	if (!hugePages || (bytes < ARENA_HUGE_PAGE))
+		return alignedAlloc<char>(bytes);
+	char* p = alignedAlloc<char>(bytes, ARENA_HUGE_PAGE);
+#ifdef MADV_HUGEPAGE
+	//only a hint, the buffer works the same if the kernel has no huge pages to spare
+	if (p)
+		madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+	return p;
+}
+
+void* FlowArena::acquire(size_t bytes)
+{
+	int sizeClass = getSizeClass(bytes);
+	if (sizeClass >= (int)pools.size())
+		pools.resize(sizeClass + 1);
+	std::vector<IdleBuffer>& pool = pools[sizeClass];
+	size_t classBytes = getClassBytes(sizeClass);
+	void* p = NULL;
+	if (!pool.empty())
+	{
+		//the most recently released buffer is the most likely to be still cached
+		p = pool.back().p;
+		pool.pop_back();
+		idleBytes -= classBytes;
+		reused++;
+	}
+	else
+	{
+		p = allocateClass(sizeClass);
+		//the idle buffers of other classes may be all that stands in the way
+		if (!p && trim())
+			p = allocateClass(sizeClass);
+		if (!p)
+		{
+			std::cerr << "Cannot allocate a buffer of " << (classBytes >> 10) << " kB!" << std::endl;
+			return NULL;
+		}
+		allocated++;
+	}
+	used[p] = sizeClass;
+	usedBytes += classBytes;
+	return p;
+}
+
+void FlowArena::release(void* p)
+{
+	if (!p)
+		return;
+	std::map<void*, int>::iterator it = used.find(p);
+	if (it == used.end())
+	{
+		std::cerr << "Tried to release a buffer not owned by the arena." << std::endl;
+		return;
+	}
+	IdleBuffer idle;
+	idle.p = p;
+	idle.generation = generation;
+	pools[it->second].push_back(idle);
+	size_t classBytes = getClassBytes(it->second);
+	usedBytes -= classBytes;
+	idleBytes += classBytes;
+	used.erase(it);
+}
+
+size_t FlowArena::trim(unsigned int before)
+{
+	size_t freed = 0;
+	for (size_t c = 0; c < pools.size(); c++)
+	{
+		std::vector<IdleBuffer>& pool = pools[c];
+		size_t kept = 0;
+		for (size_t k = 0; k < pool.size(); k++)
+		{
+			if (pool[k].generation < before)
+			{
+				alignedFree(pool[k].p);
+				freed += getClassBytes((int)c);
+			}
+			else
+				pool[kept++] = pool[k];
+		}
+		pool.resize(kept);
+	}
+	idleBytes -= freed;
+	return freed;
+}
+
+unsigned int FlowArena::advanceGeneration()
+{
+	return ++generation;
+}
+
+size_t FlowArena::getUsedMemory()
+{
+	return usedBytes;
+}
+
+size_t FlowArena::getIdleMemory()
+{
+	return idleBytes;
+}
+
+void FlowArena::setHugePages(bool enable)
+{
+	hugePages = enable;
+}
+
+bool FlowArena::getHugePages()
+{
+	return hugePages;
+}
+
+void FlowArena::print()
+{
+	std::cout << "Arena: " << (usedBytes >> 20) << " MB used, " << (idleBytes >> 20) << " MB idle, "
+		<< reused << " buffers reused, " << allocated << " allocated" << std::endl;
+}
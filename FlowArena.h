@@ -0,0 +1,92 @@
+#ifndef FLOWARENA_H
+#define FLOWARENA_H
+
+#include <stddef.h>
+#include <map>
+#include <vector>
+
+///smallest size class of FlowArena in bytes, smaller requests are rounded up to it
+#define ARENA_MIN_BYTES 4096
+///size of a huge page, buffers from this size on may be backed by huge pages (see FlowArena::setHugePages)
+#define ARENA_HUGE_PAGE (2 << 20)
+
+///recycles the large buffers of a data set (channel values, resampled grids, scratch of the loading and of the renderer) instead of returning them to the heap
+/**
+* Requests are rounded up to size classes, four per power of two, so less than a quarter of a buffer is wasted. A released buffer goes back to the pool
+* of its class and is handed out again by the next request of the same class, so loading a data set of the same size reuses the buffers of the previous
+* one instead of fragmenting the heap. Buffers that stay idle for a whole generation (see advanceGeneration) are freed by trim.
+* All buffers are aligned to DATA_ALIGNMENT. With huge pages (setHugePages or the environment variable FLOW_HUGE_PAGES=1) the buffers of at least
+* ARENA_HUGE_PAGE bytes are aligned to a huge page and advised to the kernel as huge page candidates, this has an effect on Linux only.
+* The arena is not thread-safe, buffers are acquired and released outside of parallel regions.
+*/
+class FlowArena{
+	private:
+		///a buffer waiting in a pool
+		struct IdleBuffer{
+			///the buffer
+			void* p;
+			///generation in which it was released
+			unsigned int generation;
+		};
+		///idle buffers of every size class, the most recently released one last
+		std::vector< std::vector<IdleBuffer> > pools;
+		///size class of every buffer handed out and not released yet
+		std::map<void*, int> used;
+		///bytes of the buffers handed out
+		size_t usedBytes;
+		///bytes of the buffers waiting in the pools
+		size_t idleBytes;
+		///current generation
+		unsigned int generation;
+		///true if large buffers are backed by huge pages
+		bool hugePages;
+		///number of requests served from the pools
+		unsigned int reused;
+		///number of requests served from the heap
+		unsigned int allocated;
+
+		///allocates a buffer of a size class from the heap
+		void* allocateClass(int sizeClass);
+		///not copyable, the buffers have a single owner
+		FlowArena(const FlowArena&);
+		///not copyable, the buffers have a single owner
+		FlowArena& operator=(const FlowArena&);
+	public:
+		///creates empty pools, huge pages are taken from the environment
+		FlowArena();
+		///frees all buffers, including the ones not released by their owners
+		~FlowArena();
+
+		///returns an uninitialized buffer of at least the given number of bytes, reused from the pool of its size class if possible. Returns NULL if the allocation fails.
+		void* acquire(size_t bytes);
+		///returns an uninitialized array of count elements, see acquire
+		template < typename T > T* allocate(size_t count);
+		///puts a buffer obtained by acquire back into its pool, NULL is ignored
+		void release(void* p);
+		///frees the idle buffers released before the given generation, all of them by default. Returns the number of freed bytes.
+		size_t trim(unsigned int before = ~0u);
+		///starts a new generation and returns it, e.g. before loading a data set
+		unsigned int advanceGeneration();
+
+		///returns the bytes of the buffers handed out
+		size_t getUsedMemory();
+		///returns the bytes of the buffers waiting in the pools
+		size_t getIdleMemory();
+		///backs the buffers of at least ARENA_HUGE_PAGE bytes allocated from now on by huge pages
+		void setHugePages(bool enable);
+		///returns true if large buffers are backed by huge pages
+		bool getHugePages();
+		///prints the memory and the number of reused and allocated buffers
+		void print();
+
+		///returns the size class of the given number of bytes
+		static int getSizeClass(size_t bytes);
+		///returns the number of bytes of the buffers of a size class
+		static size_t getClassBytes(int sizeClass);
+};
+
+template < typename T > T* FlowArena::allocate(size_t count)
+{
+	return (T*)acquire(count * sizeof(T));
+}
+#endif
@@ -0,0 +1,385 @@
+#include "FlowBitmap.h"
+#include <algorithm>
+#include <iterator>
+#include <string.h>
+
+FlowBitmap::FlowBitmap()
+{
+}
+
+int FlowBitmap::popcount(unsigned int v)
+{
+	v = v - ((v >> 1) & 0x55555555);
+	v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+	return (((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+void FlowBitmap::Container::toBitmap()
+{
+	words.assign(BITMAP_WORDS, 0);
+	for (size_t k = 0; k < array.size(); k++)
+		words[array[k] >> 5] |= 1u << (array[k] & 31);
+	std::vector<unsigned short>().swap(array);
+}
+
+void FlowBitmap::Container::optimize()
+{
+	if (isBitmap() && cardinality <= BITMAP_ARRAY_MAX)
+	{
+		array.reserve(cardinality);
+		for (int w = 0; w < BITMAP_WORDS; w++)
+			for (unsigned int bits = words[w]; bits; bits &= bits - 1)
+			{
+				//index of the lowest set bit
+				int bit = 0;
+				while (!(bits & (1u << bit)))
+					bit++;
+				array.push_back((unsigned short)(w*32 + bit));
+			}
+		std::vector<unsigned int>().swap(words);
+	}
+	else if (!isBitmap() && cardinality > BITMAP_ARRAY_MAX)
+		toBitmap();
+}
+
+void FlowBitmap::Container::swap(Container& other)
+{
+	std::swap(key, other.key);
+	std::swap(cardinality, other.cardinality);
+	array.swap(other.array);
+	words.swap(other.words);
+}
+
+void FlowBitmap::clear()
+{
+	containers.clear();
+}
+
+void FlowBitmap::append(const int* ids, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		int key = ids[i] >> 16;
+		unsigned short low = (unsigned short)(ids[i] & 0xFFFF);
+		if (containers.empty() || containers.back().key != key)
+		{
+			containers.push_back(Container());
+			containers.back().key = key;
+			containers.back().cardinality = 0;
+		}
+		Container& c = containers.back();
+		if (c.isBitmap())
+			c.words[low >> 5] |= 1u << (low & 31);
+		else
+			c.array.push_back(low);
+		c.cardinality++;
+		if (!c.isBitmap() && c.cardinality > BITMAP_ARRAY_MAX)
+			c.toBitmap();
+	}
+}
+
+void FlowBitmap::splice(FlowBitmap& other)
+{
+	size_t first = containers.size();
+	size_t size = first + other.containers.size();
+	if (size > containers.capacity())
+	{
+		//growing the vector would copy all containers, they are swapped over instead
+		std::vector<Container> grown;
+		grown.reserve((size > 2*first) ? size : 2*first);
+		grown.resize(size);
+		for (size_t i = 0; i < first; i++)
+			grown[i].swap(containers[i]);
+		containers.swap(grown);
+	}
+	else
+		containers.resize(size);
+	for (size_t i = 0; i < other.containers.size(); i++)
+		containers[first + i].swap(other.containers[i]);
+	other.containers.clear();
+}
+
+void FlowBitmap::unite(Container& a, const Container& b)
+{
+	if (!a.isBitmap() && !b.isBitmap())
+	{
+		std::vector<unsigned short> merged;
+		merged.reserve(a.array.size() + b.array.size());
+		std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(merged));
+		a.array.swap(merged);
+		a.cardinality = (int)a.array.size();
+		a.optimize();
+		return;
+	}
+	if (!a.isBitmap())
+		a.toBitmap();
+	if (b.isBitmap())
+		for (int w = 0; w < BITMAP_WORDS; w++)
+			a.words[w] |= b.words[w];
+	else
+		for (size_t k = 0; k < b.array.size(); k++)
+			a.words[b.array[k] >> 5] |= 1u << (b.array[k] & 31);
+	a.cardinality = 0;
+	for (int w = 0; w < BITMAP_WORDS; w++)
+		a.cardinality += popcount(a.words[w]);
+}
+
+void FlowBitmap::intersect(Container& a, const Container& b, bool complement)
+{
+	if (a.isBitmap() && b.isBitmap())
+	{
+		a.cardinality = 0;
+		for (int w = 0; w < BITMAP_WORDS; w++)
+		{
+			a.words[w] &= complement ? ~b.words[w] : b.words[w];
+			a.cardinality += popcount(a.words[w]);
+		}
+	}
+	else if (a.isBitmap())
+	{
+		if (complement)
+		{
+			for (size_t k = 0; k < b.array.size(); k++)
+			{
+				unsigned int bit = 1u << (b.array[k] & 31);
+				if (a.words[b.array[k] >> 5] & bit)
+				{
+					a.words[b.array[k] >> 5] &= ~bit;
+					a.cardinality--;
+				}
+			}
+		}
+		else
+		{
+			//the result is at most as large as the array
+			std::vector<unsigned short> kept;
+			for (size_t k = 0; k < b.array.size(); k++)
+				if (a.words[b.array[k] >> 5] & (1u << (b.array[k] & 31)))
+					kept.push_back(b.array[k]);
+			std::vector<unsigned int>().swap(a.words);
+			a.array.swap(kept);
+			a.cardinality = (int)a.array.size();
+		}
+	}
+	else if (b.isBitmap())
+	{
+		size_t kept = 0;
+		for (size_t k = 0; k < a.array.size(); k++)
+		{
+			bool set = (b.words[a.array[k] >> 5] & (1u << (a.array[k] & 31))) != 0;
+			if (set != complement)
+				a.array[kept++] = a.array[k];
+		}
+		a.array.resize(kept);
+		a.cardinality = (int)kept;
+	}
+	else
+	{
+		std::vector<unsigned short> result;
+		if (complement)
+			std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(result));
+		else
+			std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(result));
+		a.array.swap(result);
+		a.cardinality = (int)a.array.size();
+	}
+	a.optimize();
+}
+
+void FlowBitmap::orWith(const FlowBitmap& other)
+{
+	std::vector<Container> result;
+	result.reserve(containers.size() + other.containers.size());
+	size_t i = 0, j = 0;
+	while (i < containers.size() || j < other.containers.size())
+	{
+		if (j == other.containers.size() || (i < containers.size() && containers[i].key < other.containers[j].key))
+		{
+			result.push_back(Container());
+			result.back().swap(containers[i++]);
+		}
+		else if (i == containers.size() || other.containers[j].key < containers[i].key)
+			result.push_back(other.containers[j++]);
+		else
+		{
+			result.push_back(Container());
+			result.back().swap(containers[i++]);
+			unite(result.back(), other.containers[j++]);
+		}
+	}
+	containers.swap(result);
+}
+
+void FlowBitmap::uniteAll(const std::vector<const FlowBitmap*>& sets)
+{
+	containers.clear();
+	int maxKey = -1;
+	for (size_t s = 0; s < sets.size(); s++)
+		if (!sets[s]->containers.empty())
+			maxKey = (sets[s]->containers.back().key > maxKey) ? sets[s]->containers.back().key : maxKey;
+	if (maxKey < 0)
+		return;
+
+	//every chunk is collected in a bitmap first, the cardinality is counted once at the end
+	std::vector<int> slot(maxKey + 1, -1);
+	for (size_t s = 0; s < sets.size(); s++)
+		for (size_t i = 0; i < sets[s]->containers.size(); i++)
+			if (slot[sets[s]->containers[i].key] < 0)
+				slot[sets[s]->containers[i].key] = 0;
+	int used = 0;
+	for (int key = 0; key <= maxKey; key++)
+		if (slot[key] == 0)
+			slot[key] = used++;
+		else
+			slot[key] = -1;
+	containers.resize(used);
+	for (int key = 0; key <= maxKey; key++)
+		if (slot[key] >= 0)
+		{
+			containers[slot[key]].key = key;
+			containers[slot[key]].words.assign(BITMAP_WORDS, 0);
+		}
+
+	for (size_t s = 0; s < sets.size(); s++)
+		for (size_t i = 0; i < sets[s]->containers.size(); i++)
+		{
+			const Container& b = sets[s]->containers[i];
+			Container& a = containers[slot[b.key]];
+			if (b.isBitmap())
+				for (int w = 0; w < BITMAP_WORDS; w++)
+					a.words[w] |= b.words[w];
+			else
+				for (size_t k = 0; k < b.array.size(); k++)
+					a.words[b.array[k] >> 5] |= 1u << (b.array[k] & 31);
+		}
+
+	for (size_t i = 0; i < containers.size(); i++)
+	{
+		Container& a = containers[i];
+		a.cardinality = 0;
+		for (int w = 0; w < BITMAP_WORDS; w++)
+			a.cardinality += popcount(a.words[w]);
+		a.optimize();
+	}
+}
+
+void FlowBitmap::andWith(const FlowBitmap& other)
+{
+	size_t kept = 0;
+	size_t j = 0;
+	for (size_t i = 0; i < containers.size(); i++)
+	{
+		while (j < other.containers.size() && other.containers[j].key < containers[i].key)
+			j++;
+		if (j == other.containers.size())
+			break;
+		if (other.containers[j].key != containers[i].key)
+			continue;
+		intersect(containers[i], other.containers[j], false);
+		if (containers[i].cardinality > 0)
+		{
+			if (kept != i)
+				containers[kept].swap(containers[i]);
+			kept++;
+		}
+	}
+	containers.resize(kept);
+}
+
+void FlowBitmap::andNotWith(const FlowBitmap& other)
+{
+	size_t kept = 0;
+	size_t j = 0;
+	for (size_t i = 0; i < containers.size(); i++)
+	{
+		while (j < other.containers.size() && other.containers[j].key < containers[i].key)
+			j++;
+		if (j < other.containers.size() && other.containers[j].key == containers[i].key)
+			intersect(containers[i], other.containers[j], true);
+		if (containers[i].cardinality > 0)
+		{
+			if (kept != i)
+				containers[kept].swap(containers[i]);
+			kept++;
+		}
+	}
+	containers.resize(kept);
+}
+
+int FlowBitmap::count() const
+{
+	int n = 0;
+	for (size_t i = 0; i < containers.size(); i++)
+		n += containers[i].cardinality;
+	return n;
+}
+
+bool FlowBitmap::contains(int id) const
+{
+	int key = id >> 16;
+	unsigned short low = (unsigned short)(id & 0xFFFF);
+	size_t lo = 0, hi = containers.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (containers[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == containers.size() || containers[lo].key != key)
+		return false;
+	const Container& c = containers[lo];
+	if (c.isBitmap())
+		return (c.words[low >> 5] & (1u << (low & 31))) != 0;
+	return std::binary_search(c.array.begin(), c.array.end(), low);
+}
+
+void FlowBitmap::getIds(std::vector<int>* ids) const
+{
+	ids->reserve(ids->size() + count());
+	for (size_t i = 0; i < containers.size(); i++)
+	{
+		const Container& c = containers[i];
+		int base = c.key << 16;
+		if (c.isBitmap())
+		{
+			for (int w = 0; w < BITMAP_WORDS; w++)
+				if (c.words[w])
+					for (int bit = 0; bit < 32; bit++)
+						if (c.words[w] & (1u << bit))
+							ids->push_back(base + w*32 + bit);
+		}
+		else
+			for (size_t k = 0; k < c.array.size(); k++)
+				ids->push_back(base + c.array[k]);
+	}
+}
+
+void FlowBitmap::toMask(unsigned char* mask, int size) const
+{
+	memset(mask, 0, size);
+	for (size_t i = 0; i < containers.size(); i++)
+	{
+		const Container& c = containers[i];
+		int base = c.key << 16;
+		if (c.isBitmap())
+		{
+			int end = (size - base < BITMAP_WORDS*32) ? size - base : BITMAP_WORDS*32;
+			for (int low = 0; low < end; low++)
+				mask[base + low] = (unsigned char)((c.words[low >> 5] >> (low & 31)) & 1);
+		}
+		else
+			for (size_t k = 0; k < c.array.size(); k++)
+				if (base + c.array[k] < size)
+					mask[base + c.array[k]] = 1;
+	}
+}
+
+int FlowBitmap::getMemoryUsage() const
+{
+	int bytes = (int)(containers.capacity() * sizeof(Container));
+	for (size_t i = 0; i < containers.size(); i++)
+		bytes += (int)(containers[i].array.capacity() * sizeof(unsigned short) + containers[i].words.capacity() * sizeof(unsigned int));
+	return bytes;
+}
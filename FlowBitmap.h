@@ -0,0 +1,78 @@
+#ifndef FLOWBITMAP_H
+#define FLOWBITMAP_H
+
+#include <vector>
+
+///compressed set of vertex ids, used for selections and bitmap indices
+/**
+* The id space is split into chunks of 65536 ids (Roaring style). Every non-empty chunk is stored in a container,
+* either as a sorted array of the low 16 bits (up to BITMAP_ARRAY_MAX ids) or as a plain bitmap of 65536 bits.
+* Sparse selections thus cost 2 bytes per id, dense ones 1 bit per id, and empty chunks nothing.
+* Union, intersection and difference work container by container.
+*/
+class FlowBitmap{
+	public:
+		///containers with more ids than this are stored as bitmaps
+		enum { BITMAP_ARRAY_MAX = 4096, BITMAP_WORDS = 2048 };
+
+		///creates an empty set
+		FlowBitmap();
+
+		///removes all ids
+		void clear();
+		///adds the ids, which have to be sorted and larger than all ids in the set
+		void append(const int* ids, int n);
+		///moves all ids of other, which have to be larger than all ids in this set, to this set and leaves other empty
+		void splice(FlowBitmap& other);
+		///adds all ids of other to this set
+		void orWith(const FlowBitmap& other);
+		///replaces this set by the union of all the sets, which is much faster than uniting them one by one
+		void uniteAll(const std::vector<const FlowBitmap*>& sets);
+		///removes all ids from this set that are not in other
+		void andWith(const FlowBitmap& other);
+		///removes all ids of other from this set
+		void andNotWith(const FlowBitmap& other);
+
+		///returns the number of ids in the set
+		int count() const;
+		///returns true if the id is in the set
+		bool contains(int id) const;
+		///appends all ids to the vector, in ascending order
+		void getIds(std::vector<int>* ids) const;
+		///writes 1 for the ids in the set and 0 for all others into mask (size bytes, e.g. one per vertex in the vertex order)
+		void toMask(unsigned char* mask, int size) const;
+		///returns the memory used by the containers in bytes
+		int getMemoryUsage() const;
+	private:
+		///the ids of one chunk of 65536 ids
+		struct Container{
+			///chunk number (id >> 16)
+			int key;
+			///number of ids in the container
+			int cardinality;
+			///sorted low 16 bits of the ids, used while cardinality <= BITMAP_ARRAY_MAX
+			std::vector<unsigned short> array;
+			///BITMAP_WORDS words of 32 bits, used for larger containers (array is empty then)
+			std::vector<unsigned int> words;
+
+			///is the container stored as a bitmap?
+			bool isBitmap() const { return !words.empty(); }
+			///converts to a bitmap
+			void toBitmap();
+			///converts to the representation fitting the cardinality
+			void optimize();
+			///exchanges the contents without copying the ids
+			void swap(Container& other);
+		};
+
+		///the non-empty containers, sorted by key
+		std::vector<Container> containers;
+
+		///returns the number of bits set in a word
+		static int popcount(unsigned int v);
+		///unites a with b into a
+		static void unite(Container& a, const Container& b);
+		///intersects a with b into a, or removes b from a if complement is set
+		static void intersect(Container& a, const Container& b, bool complement);
+};
+#endif
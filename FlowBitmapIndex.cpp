@@ -0,0 +1,195 @@
+#include "FlowBitmapIndex.h"
+#include "FlowChannel.h"
+#include "FlowStatistics.h"
+#include <algorithm>
+
+FlowBitmapIndex::FlowBitmapIndex(FlowChannel* c, FlowGeometry* g)
+{
+	channel = c;
+	geometry = g;
+	numBins = 0;
+	edges = NULL;
+	lookup = NULL;
+	lookupScale = 0.0f;
+	bins = NULL;
+	binCounts = NULL;
+	revision = 0;
+	built = false;
+}
+
+FlowBitmapIndex::~FlowBitmapIndex()
+{
+	delete[] edges;
+	delete[] lookup;
+	delete[] bins;
+	delete[] binCounts;
+}
+
+int FlowBitmapIndex::findBin(float value)
+{
+	//the cell gives a bin close by, the right one is usually only a step or two away (in either direction because of rounding)
+	float f = (value - edges[0]) * lookupScale;
+	int cell = (f > 0.0f) ? ((f < numBins*BITMAP_INDEX_LOOKUP - 1) ? (int)f : numBins*BITMAP_INDEX_LOOKUP - 1) : 0;
+	int b = lookup[cell];
+	while (b > 0 && value < edges[b])
+		b--;
+	while (b < numBins - 1 && value >= edges[b+1])
+		b++;
+	return b;
+}
+
+void FlowBitmapIndex::build(int n)
+{
+	if (n != numBins)
+	{
+		delete[] edges;
+		delete[] lookup;
+		delete[] bins;
+		delete[] binCounts;
+		numBins = n;
+		edges = new float[numBins + 1];
+		lookup = new int[numBins*BITMAP_INDEX_LOOKUP];
+		bins = new FlowBitmap[numBins];
+		binCounts = new int[numBins];
+	}
+
+	//bins of equal depth, so that no bin gets most of the vertices
+	FlowStatistics* statistics = channel->getStatistics();
+	edges[0] = channel->getMin();
+	edges[numBins] = channel->getMax();
+	for (int b = 1; b < numBins; b++)
+	{
+		float edge = statistics->getPercentile((float)b / numBins);
+		edges[b] = (edge > edges[b-1]) ? edge : edges[b-1];
+	}
+	int cells = numBins*BITMAP_INDEX_LOOKUP;
+	lookupScale = (edges[numBins] > edges[0]) ? cells / (edges[numBins] - edges[0]) : 0.0f;
+	for (int cell = 0; cell < cells; cell++)
+	{
+		float start = edges[0] + cell / lookupScale;
+		lookup[cell] = (lookupScale > 0.0f) ? (int)(std::upper_bound(edges + 1, edges + numBins, start) - (edges + 1)) : 0;
+	}
+
+	const float* values = channel->getValueArray();
+	int dimX = geometry->getDimX();
+	int dimY = geometry->getDimY();
+	bool rowMajor = (geometry->getVertexOrder() == ORDER_ROW_MAJOR);
+	int storage = geometry->getStorageSize();
+	int numChunks = (storage + 0xFFFF) >> 16;
+	//every chunk of 65536 ids gets its own bitmaps, they are spliced together in the order of the chunks afterwards
+	FlowBitmap* slots = new FlowBitmap[numChunks * numBins];
+
+	#pragma omp parallel
+	{
+		std::vector<int>* ids = new std::vector<int>[numBins];
+		#pragma omp for schedule(dynamic)
+		for (int c = 0; c < numChunks; c++)
+		{
+			int first = c << 16;
+			int last = (first + 0x10000 < storage) ? first + 0x10000 : storage;
+			for (int id = first; id < last; id++)
+			{
+				//the padding of the tiled orders is no vertex
+				if (!rowMajor && (geometry->getVtxX(id) >= dimX || geometry->getVtxY(id) >= dimY))
+					continue;
+				ids[findBin(values[id])].push_back(id);
+			}
+			for (int b = 0; b < numBins; b++)
+				if (!ids[b].empty())
+				{
+					slots[c*numBins + b].append(&ids[b][0], (int)ids[b].size());
+					ids[b].clear();
+				}
+		}
+		delete[] ids;
+	}
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int b = 0; b < numBins; b++)
+	{
+		bins[b].clear();
+		for (int c = 0; c < numChunks; c++)
+			bins[b].splice(slots[c*numBins + b]);
+		binCounts[b] = bins[b].count();
+	}
+	delete[] slots;
+	revision = channel->getRevision();
+	built = true;
+}
+
+bool FlowBitmapIndex::isCurrent()
+{
+	return built && (revision == channel->getRevision());
+}
+
+void FlowBitmapIndex::filterBin(int b, float lo, float hi, std::vector<int>* ids)
+{
+	const float* values = channel->getValueArray();
+	std::vector<int> members;
+	bins[b].getIds(&members);
+	for (size_t k = 0; k < members.size(); k++)
+	{
+		float value = values[members[k]];
+		if (value >= lo && value <= hi)
+			ids->push_back(members[k]);
+	}
+}
+
+void FlowBitmapIndex::select(float lo, float hi, FlowBitmap* result)
+{
+	std::vector<const FlowBitmap*> inside;
+	std::vector<int> partial;
+	for (int b = 0; b < numBins; b++)
+	{
+		//bins completely outside of the range
+		if (edges[b+1] < lo || (edges[b+1] == lo && b < numBins - 1) || edges[b] > hi)
+			continue;
+		if (lo <= edges[b] && edges[b+1] <= hi)
+			inside.push_back(&bins[b]);
+		else
+			filterBin(b, lo, hi, &partial);
+	}
+	result->uniteAll(inside);
+	if (!partial.empty())
+	{
+		//the two crossing bins may interleave
+		std::sort(partial.begin(), partial.end());
+		FlowBitmap crossing;
+		crossing.append(&partial[0], (int)partial.size());
+		result->orWith(crossing);
+	}
+}
+
+int FlowBitmapIndex::count(float lo, float hi)
+{
+	int n = 0;
+	std::vector<int> partial;
+	for (int b = 0; b < numBins; b++)
+	{
+		if (edges[b+1] < lo || (edges[b+1] == lo && b < numBins - 1) || edges[b] > hi)
+			continue;
+		if (lo <= edges[b] && edges[b+1] <= hi)
+			n += binCounts[b];
+		else
+			filterBin(b, lo, hi, &partial);
+	}
+	return n + (int)partial.size();
+}
+
+int FlowBitmapIndex::getNumBins()
+{
+	return numBins;
+}
+
+float FlowBitmapIndex::getEdge(int b)
+{
+	return edges[b];
+}
+
+int FlowBitmapIndex::getMemoryUsage()
+{
+	int bytes = 0;
+	for (int b = 0; b < numBins; b++)
+		bytes += bins[b].getMemoryUsage();
+	return bytes;
+}
@@ -0,0 +1,76 @@
+#ifndef FLOWBITMAPINDEX_H
+#define FLOWBITMAPINDEX_H
+
+#include "FlowBitmap.h"
+
+class FlowChannel;
+class FlowGeometry;
+
+///default number of value bins of a bitmap index
+#define BITMAP_INDEX_BINS 128
+///cells of the bin lookup table per bin
+#define BITMAP_INDEX_LOOKUP 8
+
+///binned bitmap index of one channel, answers range queries without scanning the channel
+/**
+* The value range is split into bins holding roughly the same number of vertices (taken from the histogram of the channel statistics),
+* every bin keeps the set of its vertex ids as a compressed FlowBitmap. A range query unites the bins lying completely inside of the range
+* and checks the values of the vertices of the (at most two) bins crossing its ends, so the results are exact.
+* Selections of several channels are combined with the set operations of FlowBitmap, e.g.
+*   a.select(x, HUGE_VAL, &result); b.select(-HUGE_VAL, y, &other); result.andWith(other);
+* The ids are the vertex ids of the geometry (see FlowGeometry::getVtx), so FlowBitmap::toMask gives a mask in the vertex order.
+*/
+class FlowBitmapIndex{
+	private:
+		///the indexed channel
+		FlowChannel* channel;
+		///geometry of the channel
+		FlowGeometry* geometry;
+		///number of bins
+		int numBins;
+		///bin b holds the values edges[b] <= value < edges[b+1], the last one includes edges[numBins]
+		float* edges;
+		///first bin of each of the numBins*BITMAP_INDEX_LOOKUP equally wide value cells, so that finding the bin of a value needs no binary search
+		int* lookup;
+		///value cells per unit of the value, for lookup
+		float lookupScale;
+		///vertex ids of every bin
+		FlowBitmap* bins;
+		///number of vertices of every bin
+		int* binCounts;
+		///revision of the channel the index was built from
+		unsigned int revision;
+		///was the index built at all?
+		bool built;
+
+		///returns the bin of the value
+		int findBin(float value);
+		///appends the vertices of bin b with lo <= value <= hi to ids
+		void filterBin(int b, float lo, float hi, std::vector<int>* ids);
+
+		FlowBitmapIndex(const FlowBitmapIndex&);
+		FlowBitmapIndex& operator=(const FlowBitmapIndex&);
+	public:
+		///creates an empty index for the channel, see build
+		FlowBitmapIndex(FlowChannel* c, FlowGeometry* g);
+		///frees the bins
+		~FlowBitmapIndex();
+
+		///builds the index with the given number of bins, the chunks of 65536 vertex ids are processed in parallel
+		void build(int bins = BITMAP_INDEX_BINS);
+		///returns false if the channel was modified since build or build was never called
+		bool isCurrent();
+
+		///stores the vertices with lo <= value <= hi in result
+		void select(float lo, float hi, FlowBitmap* result);
+		///returns the number of vertices with lo <= value <= hi, only the bins crossing the ends of the range are looked at
+		int count(float lo, float hi);
+
+		///returns the number of bins
+		int getNumBins();
+		///returns the lower edge of bin b (b = getNumBins() gives the upper edge of the last bin)
+		float getEdge(int b);
+		///returns the memory used by the bins in bytes
+		int getMemoryUsage();
+};
+#endif
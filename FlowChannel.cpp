@@ -1,5 +1,13 @@
 #include "FlowChannel.h"
+#include "interpolation.h"
+#include "FlowStatistics.h"
+#include "FlowBitmapIndex.h"
+#include "FlowMipPyramid.h"
+#include "FlowSummedArea.h"
+#include "alignedMemory.h"
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <QDebug>
 
@@ -26,6 +34,23 @@ float FlowChannel::getValue(int vtxID)
     return values[vtxID];
 }
 
+bool FlowChannel::getValueGradient(vec3 pos, float* value, float* gradient)
+{
+	//one point location gives the cell for both the value and the derivatives
+	vec3 n = geom->normalizeCoords(pos);
+	int cx, cy;
+	float s, t;
+	if (!geom->locateCell(n[0], n[1], &cx, &cy, &s, &t))
+		return false;
+	sampleBilinearGradient(values, geom, cx, cy, s, t, value, gradient);
+	//from normalized to physical coordinates
+	float sizeX = geom->getMaxX() - geom->getMinX();
+	float sizeY = geom->getMaxY() - geom->getMinY();
+	gradient[0] = (sizeX != 0.0f) ? gradient[0] / sizeX : 0.0f;
+	gradient[1] = (sizeY != 0.0f) ? gradient[1] / sizeY : 0.0f;
+	return true;
+}
+
 ///returns the value at given position in normalized coordinates for each dimension <0..1>
 float FlowChannel::getValueNormPos(vec3 pos)
 {
@@ -42,26 +67,65 @@ float FlowChannel::getValueNormPos(float x, float y)
     return getValueNormPos(vec3(x,y));
 }
 
+float FlowChannel::getValueAtIndex(float i, float j)
+{
+	return sampleAtIndex<InterpolateBilinear>(values, geom, i, j);
+}
+
 float FlowChannel::normalizeValue(float val)
 {
 	//scales the value so that minimum will be 0 and maximum 1
     return (val-minimum)/(maximum-minimum);
 }
 
-FlowChannel::FlowChannel(FlowGeometry* g)
+FlowChannel::FlowChannel(FlowGeometry* g, FlowArena* a)
 {
     geom = g;
-    //create the appropriate storage
-    values = new float[geom->getDimX()*geom->getDimY()];
+    arena = a;
+    //create the appropriate storage, the padding of the tiled vertex orders stays 0
+    values = allocateValues();
+    if (values)
+        memset(values, 0, geom->getStorageSize() * sizeof(float));
+    ownsValues = true;
     minimum = HUGE_VAL;
     maximum = -HUGE_VAL;
+    revision = 0;
+    statistics = NULL;
+    bitmapIndex = NULL;
+    pyramid = new FlowMinMaxPyramid(geom);
+    mipmap = NULL;
+    summedArea = NULL;
     std::cout << "ok" << std::endl;    
 }
 
+FlowChannel::FlowChannel(FlowGeometry* g, float* shared)
+{
+    geom = g;
+    values = shared;
+    ownsValues = false;
+    arena = NULL;
+    minimum = HUGE_VAL;
+    maximum = -HUGE_VAL;
+    revision = 0;
+    statistics = NULL;
+    bitmapIndex = NULL;
+    pyramid = new FlowMinMaxPyramid(geom);
+    mipmap = NULL;
+    summedArea = NULL;
+}
+
 FlowChannel::~FlowChannel()
 {
-	//delete the value storage
-    delete[] values;
+	//delete the value storage, unless it is only viewed
+    if (ownsValues)
+        freeValues();
+    delete statistics;
+    delete bitmapIndex;
+    delete pyramid;
+    delete mipmap;
+    delete summedArea;
+    if (!spillPath.empty())
+        remove(spillPath.c_str());
     std::cout << "ok" << std::endl;
 }
 
@@ -71,18 +135,24 @@ void FlowChannel::setValue(int vtxID, float val)
 	//update the minimum and maximum
     minimum = (val < minimum) ? val : minimum;
     maximum = (val > maximum) ? val : maximum;    
+    pyramid->expand(geom->getVtxX(vtxID), geom->getVtxY(vtxID), val);
+    revision++;
 }
 
 //takes an array containing all attributes for a vertex and copies the attribute specified in offset to this channel
 void FlowChannel::copyValues(float* rawdata, int vtxSize, int offset)
 {
+	//rawdata is row-major, the channel follows the vertex order of the geometry
     for (int i = 0; i < geom->getDimX()*geom->getDimY(); i++)
     {
-        values[i] = rawdata[(i*vtxSize) + offset];
+        int vtxID = geom->getVtx(i % geom->getDimX(), i / geom->getDimX());
+        values[vtxID] = rawdata[(i*vtxSize) + offset];
 		//update the minimum and maximum
-        minimum = (values[i] < minimum) ? values[i] : minimum;
-        maximum = (values[i] > maximum) ? values[i] : maximum;
+        minimum = (values[vtxID] < minimum) ? values[vtxID] : minimum;
+        maximum = (values[vtxID] > maximum) ? values[vtxID] : maximum;
     }
+    pyramid->build(values);
+    revision++;
     std::cout << "Maximum value in channel: " << maximum << std::endl;
     std::cout << "Minimum value in channel: " << minimum << std::endl;    
 
@@ -109,4 +179,174 @@ float FlowChannel::getRange()
 float FlowChannel::getRawValue(int i)
 {
 	return values[i];
-}
\ No newline at end of file
+}
+
+const float* FlowChannel::getValueArray()
+{
+	if (!values)
+		restore();
+	return values;
+}
+
+float* FlowChannel::beginUpdate()
+{
+	if (!values)
+		restore();
+	return values;
+}
+
+void FlowChannel::endUpdate()
+{
+	//the tiles cover all vertices (and no padding), the last level is the range of the whole channel
+	pyramid->build(values);
+	pyramid->getRange(&minimum, &maximum);
+	revision++;
+}
+
+unsigned int FlowChannel::getRevision()
+{
+	return revision;
+}
+
+FlowStatistics* FlowChannel::getStatistics()
+{
+	if (!statistics)
+		statistics = new FlowStatistics(this, geom);
+	if (!statistics->isCurrent())
+		statistics->compute();
+	return statistics;
+}
+
+FlowBitmapIndex* FlowChannel::getBitmapIndex()
+{
+	if (!bitmapIndex)
+		bitmapIndex = new FlowBitmapIndex(this, geom);
+	if (!bitmapIndex->isCurrent())
+		bitmapIndex->build();
+	return bitmapIndex;
+}
+
+FlowMinMaxPyramid* FlowChannel::getPyramid()
+{
+	return pyramid;
+}
+
+FlowMipPyramid* FlowChannel::getMipmap()
+{
+	if (!mipmap)
+		mipmap = new FlowMipPyramid(this, geom);
+	return mipmap;
+}
+
+FlowSummedArea* FlowChannel::getSummedArea()
+{
+	if (!summedArea)
+		summedArea = new FlowSummedArea(this, geom);
+	if (!summedArea->isCurrent())
+		summedArea->build();
+	return summedArea;
+}
+
+size_t FlowChannel::getMemory()
+{
+	size_t bytes = pyramid->getMemory();
+	if (ownsValues && values)
+		bytes += geom->getStorageSize() * sizeof(float);
+	return bytes;
+}
+
+size_t FlowChannel::getCacheMemory()
+{
+	size_t bytes = 0;
+	if (bitmapIndex)
+		bytes += bitmapIndex->getMemoryUsage();
+	if (summedArea)
+		bytes += summedArea->getMemory();
+	if (mipmap)
+		bytes += mipmap->getMemory();
+	return bytes;
+}
+
+size_t FlowChannel::releaseCaches()
+{
+	size_t bytes = getCacheMemory();
+	delete bitmapIndex;
+	delete summedArea;
+	delete mipmap;
+	bitmapIndex = NULL;
+	summedArea = NULL;
+	mipmap = NULL;
+	return bytes;
+}
+
+size_t FlowChannel::spill(const std::string& path)
+{
+	if (!ownsValues || !values)
+		return 0;
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (!fp)
+	{
+		std::cerr << "Cannot create the spill file " << path << std::endl;
+		return 0;
+	}
+	size_t n = geom->getStorageSize();
+	bool ok = (fwrite(values, sizeof(float), n, fp) == n);
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok)
+	{
+		std::cerr << "Cannot write the spill file " << path << std::endl;
+		remove(path.c_str());
+		return 0;
+	}
+	//the caches would have to be built again from the values anyway
+	size_t bytes = releaseCaches() + n * sizeof(float);
+	freeValues();
+	values = NULL;
+	spillPath = path;
+	return bytes;
+}
+
+bool FlowChannel::restore()
+{
+	if (values)
+		return true;
+	FILE* fp = fopen(spillPath.c_str(), "rb");
+	if (!fp)
+	{
+		std::cerr << "Cannot open the spill file " << spillPath << std::endl;
+		return false;
+	}
+	size_t n = geom->getStorageSize();
+	values = allocateValues();
+	bool ok = values && (fread(values, sizeof(float), n, fp) == n);
+	fclose(fp);
+	if (!ok)
+	{
+		std::cerr << "Cannot read the spill file " << spillPath << std::endl;
+		freeValues();
+		values = NULL;
+		return false;
+	}
+	remove(spillPath.c_str());
+	spillPath.clear();
+	return true;
+}
+
+float* FlowChannel::allocateValues()
+{
+	size_t n = geom->getStorageSize();
+	return arena ? arena->allocate<float>(n) : alignedAlloc<float>(n);
+}
+
+void FlowChannel::freeValues()
+{
+	if (arena)
+		arena->release(values);
+	else
+		alignedFree(values);
+}
+
+bool FlowChannel::isSpilled()
+{
+	return !values && !spillPath.empty();
+}
@@ -2,7 +2,16 @@
 #define FLOWCHANNEL_H
 
 #include "FlowGeometry.h"
+#include "FlowMinMaxPyramid.h"
+#include "FlowArena.h"
 #include <iostream>
+#include <string>
+
+class FlowStatistics;
+class FlowBitmapIndex;
+class FlowMipPyramid;
+class FlowSummedArea;
+
 ///Handles one scalar field of floats defined for each cell.
 /**
 * More dimensional vectors are split into components. E.g. a 3D velocity vector gets stored in three FlowChannels. A FlowChannel stores data only from one time step, it is not aware of any time related information.
@@ -13,13 +22,41 @@ class FlowChannel{
         FlowGeometry* geom;    
         ///channel data storage
         float* values;
+        ///false if the values belong to somebody else (see the second constructor) and must not be freed
+        bool ownsValues;
+        ///arena the values are taken from and returned to, NULL for the heap
+        FlowArena* arena;
+        ///allocates the storage of the values, uninitialized
+        float* allocateValues();
+        ///frees the storage of the values
+        void freeValues();
         ///minimum value (of all cells in a single time step)
         float minimum;
         ///maximum value (of all cells in a single time step)
         float maximum;
+        ///incremented on every modification of the values, so that derived data can tell whether it is outdated
+        unsigned int revision;
+        ///histogram, mean, variance and percentiles, computed on demand
+        FlowStatistics* statistics;
+        ///bitmap index for range queries, built on demand
+        FlowBitmapIndex* bitmapIndex;
+        ///minimum and maximum per tile of cells, kept up to date by all modifications
+        FlowMinMaxPyramid* pyramid;
+        ///downsampled versions of the channel, built on demand
+        FlowMipPyramid* mipmap;
+        ///summed-area tables for region statistics, built on demand
+        FlowSummedArea* summedArea;
+        ///file holding the values while they are spilled to disk, empty if they are in memory
+        std::string spillPath;
     public:
-		///constructor using a given geometry structure
-        FlowChannel(FlowGeometry* g);
+		///constructor using a given geometry structure, the values are taken from the arena a if given (and returned to it by the destructor)
+        FlowChannel(FlowGeometry* g, FlowArena* a = NULL);
+		///constructor for a channel viewing values owned by somebody else (getStorageSize() floats in the vertex order of g), nothing is copied
+		/**
+		* The values have to outlive the channel, call endUpdate once they are filled to get the minimum and maximum.
+		* Used e.g. for the geometry channels, which read the coordinate arrays of the geometry directly.
+		*/
+        FlowChannel(FlowGeometry* g, float* shared);
 		///destructor
         ~FlowChannel();
         ///sets the value of the given vertex
@@ -27,7 +64,7 @@ class FlowChannel{
         ///takes an array containing all attributes for a vertex and copies the j-th attribute to this channel
 		/**
 		* This methos is used by the loading of data sets.
-		* @param rawdata data gained directly from the file, without any processing. It contains all channels for all cells. Please note, there is no time information considered here.
+		* @param rawdata data gained directly from the file, without any processing. It contains all channels for all cells in row-major order, they are rearranged to the vertex order of the geometry. Please note, there is no time information considered here.
 		* @param vtxSize number of channels per cell (incl. velocity vector size)
 		* @param offset offset of the parameter loaded into this channel
 		*/
@@ -37,10 +74,14 @@ class FlowChannel{
         float getValue(vec3 pos);
 		///returns the value of the given vertex
         float getValue(int vtxID);
+		///interpolates the value and its gradient (in physical units, d/dx and d/dy) at given position in data set coordinates from a single point location. Returns false outside of the grid.
+		bool getValueGradient(vec3 pos, float* value, float* gradient);
         ///returns the value at given position in normalized coordinates for each dimension <0..1>
         float getValueNormPos(vec3 pos);
         ///returns the value at given position in normalized coordinates for each dimension <0..1>
 		float getValueNormPos(float x, float y);
+		///returns the value at fractional vertex indexes (i from 0 to dimX-1, j from 0 to dimY-1), interpolated bilinearly in computational space
+		float getValueAtIndex(float i, float j);
         
 		///scales the value according to the channel minimim and maximum, so that it lies inside of <0,1>
         float normalizeValue(float val);
@@ -54,5 +95,42 @@ class FlowChannel{
 
 		///returns the raw values for a given channel
 		float getRawValue(int i);
+		///returns the whole value storage (getStorageSize() of the geometry floats, in its vertex order), meant for batch processing
+		const float* getValueArray();
+		///returns the value storage for direct (e.g. parallel) writes, which have to be finished by endUpdate
+		float* beginUpdate();
+		///finishes direct writes started by beginUpdate, recomputes the minimum and maximum (and the min/max pyramid)
+		void endUpdate();
+		///returns the revision of the values, which changes with every modification
+		unsigned int getRevision();
+		///returns the statistics of the values, they are computed again if the channel was modified since the last call
+		FlowStatistics* getStatistics();
+		///returns the bitmap index of the values for range queries, it is built again if the channel was modified since the last call
+		FlowBitmapIndex* getBitmapIndex();
+		///returns the min/max pyramid over tiles of cells, e.g. to skip the tiles that cannot contain a value
+		FlowMinMaxPyramid* getPyramid();
+		///returns the downsampled versions of the channel, e.g. to display or analyse it at the resolution of the screen. Its levels are built again if the channel was modified.
+		FlowMipPyramid* getMipmap();
+		///returns the summed-area tables of the values for constant time sums, means and variances of rectangles, they are built again if the channel was modified since the last call
+		FlowSummedArea* getSummedArea();
+
+		///returns the bytes of the values (if owned and in memory) and of the min/max pyramid
+		size_t getMemory();
+		///returns the bytes of the bitmap index, the summed-area tables and the mip pyramid
+		size_t getCacheMemory();
+		///deletes the bitmap index, the summed-area tables and the mip pyramid (they are built again on demand), returns the bytes freed
+		size_t releaseCaches();
+		///writes the values to the file and frees them, returns the bytes freed (0 on errors or for values that are not owned)
+		/**
+		* The caches are released as well. A spilled channel keeps its minimum, maximum, statistics and revision, but the values are not accessible
+		* until restore is called. getValueArray and beginUpdate restore them, FlowData::getChannel does so within the memory budget. The per-vertex accessors
+		* (getValue, setValue, getRawValue, the sampling) do not, they run inside of parallel loops and restore is not thread-safe, so holders of a channel pointer
+		* have to ask the data set for the channel again after it may have been spilled, before the loop.
+		*/
+		size_t spill(const std::string& path);
+		///reads the values back from the spill file and deletes it, returns false if it cannot be read
+		bool restore();
+		///returns true if the values are spilled to disk
+		bool isSpilled();
 };
 #endif
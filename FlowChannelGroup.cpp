@@ -0,0 +1,119 @@
+#include "FlowChannelGroup.h"
+#include "alignedMemory.h"
+#include <math.h>
+#include <string.h>
+
+FlowChannelGroup::FlowChannelGroup(FlowGeometry* g, int n, FlowArena* a)
+{
+	geometry = g;
+	components = n;
+	arena = a;
+	//the padding of the tiled vertex orders stays 0
+	size_t count = (size_t)geometry->getStorageSize() * components;
+	values = arena ? arena->allocate<float>(count) : alignedAlloc<float>(count);
+	if (values)
+		memset(values, 0, count * sizeof(float));
+	minimum = new float[components];
+	maximum = new float[components];
+	for (int c = 0; c < components; c++)
+	{
+		minimum[c] = 0.0f;
+		maximum[c] = 0.0f;
+	}
+	revision = 0;
+}
+
+FlowChannelGroup::~FlowChannelGroup()
+{
+	if (arena)
+		arena->release(values);
+	else
+		alignedFree(values);
+	delete[] minimum;
+	delete[] maximum;
+}
+
+int FlowChannelGroup::getNumComponents()
+{
+	return components;
+}
+
+const float* FlowChannelGroup::getInterleaved()
+{
+	return values;
+}
+
+FlowStridedArray FlowChannelGroup::getComponent(int c)
+{
+	FlowStridedArray view;
+	view.base = values + c;
+	view.stride = components;
+	return view;
+}
+
+float FlowChannelGroup::getMin(int c)
+{
+	return minimum[c];
+}
+
+float FlowChannelGroup::getMax(int c)
+{
+	return maximum[c];
+}
+
+float* FlowChannelGroup::beginUpdate()
+{
+	return values;
+}
+
+void FlowChannelGroup::endUpdate()
+{
+	int dimX = geometry->getDimX();
+	int dimY = geometry->getDimY();
+	//one partial result per row and component, merged afterwards (OpenMP 2.0 has no min/max reductions)
+	float* rowMin = new float[dimY * components];
+	float* rowMax = new float[dimY * components];
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dimY; y++)
+	{
+		float* lo = rowMin + y*components;
+		float* hi = rowMax + y*components;
+		for (int c = 0; c < components; c++)
+		{
+			lo[c] = HUGE_VAL;
+			hi[c] = -HUGE_VAL;
+		}
+		for (int x = 0; x < dimX; x++)
+		{
+			const float* record = values + geometry->getVtx(x,y)*components;
+			for (int c = 0; c < components; c++)
+			{
+				lo[c] = (record[c] < lo[c]) ? record[c] : lo[c];
+				hi[c] = (record[c] > hi[c]) ? record[c] : hi[c];
+			}
+		}
+	}
+	for (int c = 0; c < components; c++)
+	{
+		minimum[c] = HUGE_VAL;
+		maximum[c] = -HUGE_VAL;
+		for (int y = 0; y < dimY; y++)
+		{
+			minimum[c] = (rowMin[y*components + c] < minimum[c]) ? rowMin[y*components + c] : minimum[c];
+			maximum[c] = (rowMax[y*components + c] > maximum[c]) ? rowMax[y*components + c] : maximum[c];
+		}
+	}
+	delete[] rowMin;
+	delete[] rowMax;
+	revision++;
+}
+
+unsigned int FlowChannelGroup::getRevision()
+{
+	return revision;
+}
+
+size_t FlowChannelGroup::getMemory()
+{
+	return (size_t)geometry->getStorageSize() * components * sizeof(float);
+}
@@ -0,0 +1,97 @@
+#ifndef FLOWCHANNELGROUP_H
+#define FLOWCHANNELGROUP_H
+
+#include "FlowGeometry.h"
+#include "FlowArena.h"
+#include "interpolation.h"
+
+///read-only view of every stride-th float of an array, indexed by vertex id like the value array of a channel
+/**
+* The interpolation policies (see interpolation.h) take it in place of a plain array, so a component of an interleaved FlowChannelGroup
+* is sampled without copying it out first.
+*/
+struct FlowStridedArray{
+	///value of vertex 0
+	const float* base;
+	///distance between the values of two consecutive vertex ids in floats
+	int stride;
+
+	///returns the value of the vertex
+	inline float operator[](int vtxID) const { return base[vtxID*stride]; }
+};
+
+///several scalar fields stored together, the components of every vertex next to each other
+/**
+* A vector field sampled as a whole (e.g. by a streamline integrator) fetches all components of a vertex from the same cache line,
+* instead of one line per component from separate channels. The values follow the vertex order of the geometry,
+* getInterleaved gives the whole storage (e.g. for uploads or exports) and getComponent a strided view of one component, both without copies.
+*/
+class FlowChannelGroup{
+	private:
+		///the geometry of the values
+		FlowGeometry* geometry;
+		///number of components per vertex
+		int components;
+		///getStorageSize() of the geometry records of components floats
+		float* values;
+		///minimum of every component
+		float* minimum;
+		///maximum of every component
+		float* maximum;
+		///incremented on every modification of the values
+		unsigned int revision;
+		///arena the values are taken from, NULL for the heap
+		FlowArena* arena;
+
+		FlowChannelGroup(const FlowChannelGroup&);
+		FlowChannelGroup& operator=(const FlowChannelGroup&);
+	public:
+		///creates a group of n components for the geometry, all values are 0. The values are taken from the arena a if given.
+		FlowChannelGroup(FlowGeometry* g, int n, FlowArena* a = NULL);
+		///frees the values
+		~FlowChannelGroup();
+
+		///returns the number of components per vertex
+		int getNumComponents();
+		///returns the whole storage, component c of vertex vtxID at vtxID*getNumComponents() + c
+		const float* getInterleaved();
+		///returns a view of component c, usable wherever the value array of a channel is
+		FlowStridedArray getComponent(int c);
+		///returns the value of component c of the vertex
+		inline float getValue(int vtxID, int c);
+		///returns the minimum of component c
+		float getMin(int c);
+		///returns the maximum of component c
+		float getMax(int c);
+
+		///returns the storage for direct (e.g. parallel) writes, which have to be finished by endUpdate
+		float* beginUpdate();
+		///finishes direct writes started by beginUpdate, recomputes the minimum and maximum of all components
+		void endUpdate();
+		///returns the revision of the values, which changes with every modification
+		unsigned int getRevision();
+		///returns the bytes of the values
+		size_t getMemory();
+
+		///interpolates all components at fractional vertex indexes (i from 0 to dimX-1, j from 0 to dimY-1) with the given policy, out receives getNumComponents() values
+		template < class Policy > inline void sampleAtIndex(float i, float j, float* out);
+};
+
+inline float FlowChannelGroup::getValue(int vtxID, int c)
+{
+	return values[vtxID*components + c];
+}
+
+template < class Policy > inline void FlowChannelGroup::sampleAtIndex(float i, float j, float* out)
+{
+	//the cell is found once for all components, clamped like in ::sampleAtIndex (upper bound first)
+	int cx = (int)i;
+	int cy = (int)j;
+	cx = (cx > geometry->getDimX()-2) ? geometry->getDimX()-2 : cx;
+	cy = (cy > geometry->getDimY()-2) ? geometry->getDimY()-2 : cy;
+	cx = (cx < 0) ? 0 : cx;
+	cy = (cy < 0) ? 0 : cy;
+	for (int c = 0; c < components; c++)
+		out[c] = Policy::sample(getComponent(c), geometry, cx, cy, i - cx, j - cy);
+}
+#endif
@@ -1,29 +1,38 @@
 #include "FlowData.h"
 #include <math.h>
 #include "reverseBytes.h"
+#include "transpose.h"
+#include "FlowResampler.h"
+#include "FlowExpression.h"
+#include "FlowChannelGroup.h"
+#include "SharedExchange.h"
+#include <algorithm>
+
+///edge length of the tiles processed by createChannelDerived
+#define DERIVED_TILE 32
 
 #include <qgl.h>
 #include <QDebug>
 
 FlowData::FlowData()
 {
-    //mark all the channel slots as free
-    for(int i = 0; i < max_channels; i++)
-    {
-		channels[i] = NULL;
-		freeChannel[i] = true;   
-    }
+	slice = 0;
+	vertexOrder = ORDER_ROW_MAJOR;
+	loadGeneration = 0;
+	resampler = new FlowResampler(this);
 }
 
 FlowData::~FlowData()
 {
 	//delete all the channels
-	for(int i = 0; i < max_channels; i++)
-		if (!freeChannel[i])
+	for (int i = getNumChannelSlots(); i-- > 0; )
+		if (hasChannel(i))
 			deleteChannel(i);
+	deleteGroups();
+	delete resampler;
 }
 
-bool FlowData::loadDataset(string filename, bool bigEndian)
+bool FlowData::loadDataset(string filename, bool bigEndian, VertexOrder order)
 {
 	FILE* griFile = NULL;
 	FILE* datFile = NULL;	
@@ -54,17 +63,36 @@ bool FlowData::loadDataset(string filename, bool bigEndian)
 	}
 	//save the header
 	fread(header,40,1,griFile);
-	//pass the grid file to the geometry class to process it
-	if (!geometry.readFromFile(header,griFile,bigEndian))
-		return false;
-	//close the file
-	fclose(griFile);
-	 
+
 	int dimX,dimY,dimZ,numChannels;
 	float DT;	 
 	//read some neceassry data from the header
 	sscanf(header,"SN4DB %d %d %d %d %d %f",&dimX,&dimY,&dimZ,&numChannels,&timesteps,&DT);
 	printf("Channels: %d\nTimesteps: %d\n",numChannels,timesteps);
+	vertexOrder = order;
+	//the geometry changes, so does every resampled grid and every group
+	resampler->clearCache();
+	deleteGroups();
+	//the buffers released by the previous data set are reused by this one, those the data set before did not need either are of a size gone for good
+	arena.trim(loadGeneration);
+	loadGeneration = arena.advanceGeneration();
+
+	if (dimZ > 1)
+	{
+		//3D grids go to the bricked volume, the geometry gets a slice of it later on
+		std::cout << "Dimensions: " << dimX << " x " << dimY << " x " << dimZ << std::endl;
+		if (!volume.readGrid(griFile,dimX,dimY,dimZ,bigEndian))
+			return false;
+	}
+	else
+	{
+		volume.clear();
+		//pass the grid file to the geometry class to process it
+		if (!geometry.readFromFile(header,griFile,bigEndian,order))
+			return false;
+	}
+	//close the file
+	fclose(griFile);
 
 	//qDebug() << "Channels: " << numChannels;
 	//qDebug() << "Timesteps: " << timesteps;
@@ -88,17 +116,27 @@ bool FlowData::loadDataset(string filename, bool bigEndian)
 	}
 	//let's prepare the channels
 	numChannels += 3; //add the 3 components of the velocity vector to the number of additional chanenls
-	int* ch = new int[numChannels]; //create a storage for addresses our channels
+
+	if (dimZ > 1)
+	{
+		bool ok = volume.readChannels(datFile,numChannels,bigEndian);
+		fclose(datFile);
+		std::cout << "Volume memory: " << (volume.getMemory() >> 20) << " MB" << std::endl;
+		//start with the middle slice
+		return ok && selectSlice(dimZ/2);
+	}
 
 	//because reading big chunks of data is much faster than single values, 
 	//we read the data into a temporary array and then copy it to the channels
-	float* tmpArray = new float[numChannels*geometry.getDimX()*geometry.getDimY()]; //create temporary storage
-	int result = fread(tmpArray,sizeof(float),numChannels*geometry.getDimX()*geometry.getDimY(),datFile); //read the data
+	float* tmpArray = arena.allocate<float>(numChannels*geometry.getDimX()*geometry.getDimY()); //create temporary storage, kept by the arena for the next data set
+	int result = tmpArray ? fread(tmpArray,sizeof(float),numChannels*geometry.getDimX()*geometry.getDimY(),datFile) : 0; //read the data
 	//have we read the whole data file?
 	if (result != numChannels*geometry.getDimX()*geometry.getDimY())
 	{
 		std::cerr << "+ Error reading dat file:" << datName << std::endl << std::endl;
 		//qDebug() << "+ Error reading dat file:" << datName.c_str();
+		arena.release(tmpArray);
+		fclose(datFile);
 		return false;
 	}
 	//close the file, it is no longer needed
@@ -108,27 +146,23 @@ bool FlowData::loadDataset(string filename, bool bigEndian)
 	if (bigEndian)
 		for(int j = 0; j < numChannels*geometry.getDimX()*geometry.getDimY(); j++)
 			tmpArray[j] = reverseBytes<float>(tmpArray[j]);
-	//assign the data to the appropriate channels
-	for (int j = 0; j < (numChannels); j++)
-	{
-		//create the new channel
-		ch[j] = createChannel();
-		//copy the values of the jth channel from tmpArray, which carries numChannels    
-		channels[ch[j]]->copyValues(tmpArray,(numChannels),j);
-	}
+	bool assigned = assignChannels(tmpArray,numChannels);
 
 	//qDebug() << "vel: " << vel;
 	//qDebug() << "TEST: " << getChannel(vel)->getValueNormPos(vec3(0.5,0.5));
 	//qDebug() << "TEST2: " << getChannel(3)->getValueNormPos(vec3(0.5,0.5));
 	//qDebug() << "TEST3: " << getChannel(4)->getValueNormPos(vec3(0.5,0.5));
 
-	delete[] ch;
-	delete[] tmpArray;
+	arena.release(tmpArray);
+	if (!assigned)
+		return false;
 
 	qDebug() << "channel3Min " << getChannel(3)->getMin();
 	qDebug() << "channel3Max " << getChannel(3)->getMax();
 	qDebug() << "channel3Range " << getChannel(3)->getRange();
-	qDebug() << "channel3 test " << getChannel(3)->getValue(134050);
+	//the test vertex does not exist in smaller data sets
+	if (geometry.getDimX()*geometry.getDimY() > 134050)
+		qDebug() << "channel3 test " << getChannel(3)->getValue(134050);
 
 	qDebug() << "Xmin: " << geometry.getMinX();
 	qDebug() << "Xmax: " << geometry.getMaxX();
@@ -138,70 +172,331 @@ bool FlowData::loadDataset(string filename, bool bigEndian)
 	return true;
 }
 
-int FlowData::createChannel()
+bool FlowData::assignChannels(float* rawdata, int numChannels)
 {
-    //find the first unused channel slot
-    int i = 0;
-    while ((!freeChannel[i])&&(i < max_channels)) i++;
-    //if there is a free slot
-	if (i < max_channels) 
-    {
-        std::cout << "Creating channel at " << i << " ... ";
-		//qDebug() << "Creating channel at " << i;
-        //create a new channel
-        channels[i] = new FlowChannel(&geometry);
-        //remember the slot
-        freeChannel[i] = false;
-        //return the adress of the new channel
-        return i;
-    }
-    //there is no free channel
-    else 
+	int* ch = new int[numChannels]; //create a storage for addresses our channels
+	float* tmpArray = rawdata;
+	//the geometry has been transposed to the row-major layout while loading, the channels have to follow
+	if (geometry.getFlipped())
+	{
+		tmpArray = arena.allocate<float>(numChannels*geometry.getDimX()*geometry.getDimY());
+		if (!tmpArray)
+		{
+			delete[] ch;
+			return false;
+		}
+		//the file holds dimX rows of dimY vertices each, every vertex carrying numChannels values
+		transposeBlocked<float>(rawdata, tmpArray, geometry.getDimX(), geometry.getDimY(), numChannels);
+	}
+	//assign the data to the appropriate channels
+	bool ok = true;
+	for (int j = 0; (j < numChannels) && ok; j++)
+	{
+		//create the new channel
+		ch[j] = createChannel();
+		ok = (ch[j] >= 0);
+		if (!ok)
+			break;
+		//copy the values of the jth channel from tmpArray, which carries numChannels    
+		getChannel(ch[j])->copyValues(tmpArray,(numChannels),j);
+	}
+	if (tmpArray != rawdata)
+		arena.release(tmpArray);
+	if (ok)
+	{
+		//the first three channels are the velocity, solid obstacles are where it vanishes
+		int invalid = createMaskFromVelocity(ch[0], ch[1], (numChannels > 2) ? ch[2] : -1);
+		if (invalid > 0)
+			std::cout << "Masked " << invalid << " vertices without any flow" << std::endl;
+		//histogram, mean and variance are ready before anybody asks for them, over the valid vertices only
+		for (int j = 0; j < numChannels; j++)
+			getChannel(ch[j])->getStatistics();
+	}
+	delete[] ch;
+	return ok;
+}
+
+bool FlowData::is3D()
+{
+	return volume.getDimZ() > 1;
+}
+
+FlowVolume* FlowData::getVolume()
+{
+	return (is3D()) ? &volume : NULL;
+}
+
+int FlowData::getSlice()
+{
+	return slice;
+}
+
+bool FlowData::selectSlice(int z)
+{
+	if (!is3D() || (z < 0) || (z >= volume.getDimZ()))
+		return false;
+	slice = z;
+
+	//the channels of the previous slice (including derived ones) are no longer valid
+	for (int i = getNumChannelSlots(); i-- > 0; )
+		if (hasChannel(i))
+			deleteChannel(i);
+	deleteGroups();
+
+	//only one slice is expanded at a time, the volume itself stays bricked
+	size_t n = (size_t)volume.getDimX()*volume.getDimY();
+	//every slice has the same size, so stepping through them takes the same buffers again and again
+	float* x = arena.allocate<float>(n);
+	float* y = arena.allocate<float>(n);
+	float* rawdata = arena.allocate<float>(n*volume.getNumChannels());
+	if (!x || !y || !rawdata)
+	{
+		arena.release(x);
+		arena.release(y);
+		arena.release(rawdata);
+		return false;
+	}
+	volume.extractSliceZ(z, x, y, rawdata);
+	geometry.setFromArrays(volume.getDimX(), volume.getDimY(), x, y, vertexOrder);
+	bool ok = assignChannels(rawdata, volume.getNumChannels());
+	arena.release(x);
+	arena.release(y);
+	arena.release(rawdata);
+	std::cout << "Slice " << z << " of " << volume.getDimZ() << std::endl;
+	return ok;
+}
+
+int FlowData::createChannel(float* shared)
+{
+    //the values have to fit into the budget, older items are evicted if necessary
+    size_t bytes = shared ? 0 : geometry.getStorageSize() * sizeof(float);
+    if (!enforceBudget(bytes))
     {
+        std::cerr << "Cannot create a channel, the memory budget of " << (memory.getBudget() >> 20) << " MB is exhausted!" << std::endl;
         return -1;
-        std::cerr << "There is no free channel slot!" << std::endl;
     }
+    //find the first unused channel slot, the registry grows if there is none
+    int i = 0;
+    while ((i < (int)channels.size()) && channels[i].channel) i++;
+    if (i == (int)channels.size())
+        channels.push_back(ChannelEntry());
+    std::cout << "Creating channel at " << i << " ... ";
+	//qDebug() << "Creating channel at " << i;
+    //create a new channel
+    ChannelEntry& entry = channels[i];
+    entry.channel = shared ? new FlowChannel(&geometry, shared) : new FlowChannel(&geometry, &arena);
+    char name[16];
+    sprintf(name, "c%d", i);
+    entry.name = name;
+    entry.derived = false;
+    entry.lastUse = memory.getClock();
+    //return the adress of the new channel
+    return i;
 }
 
 void FlowData::deleteChannel(int i)
 {
 	//if the address is really occupied
-    if (!freeChannel[i])
+    if (hasChannel(i))
     {
         std::cout << "Deleting channel at " << i << " ... ";
         //delete the channel instance
-        delete channels[i];
-        channels[i] = NULL;
-        //free the slot
-        freeChannel[i] = true;
+        delete channels[i].channel;
+        //free the slot, the free slots at the end are dropped
+        channels[i].channel = NULL;
+        channels[i].name.clear();
+        while (!channels.empty() && !channels.back().channel)
+            channels.pop_back();
+        //the slot may get reused by a different channel
+        resampler->clearCache();
+        //forget the expressions computed into or from this channel
+        for (size_t e = expressions.size(); e-- > 0; )
+        {
+            bool uses = (expressions[e].channel == i);
+            for (size_t k = 0; k < expressions[e].inputs.size(); k++)
+                uses = uses || (expressions[e].inputs[k] == i);
+            if (uses)
+                expressions.erase(expressions.begin() + e);
+        }
     }
     else std::cout << "Tried to delete a non-existing channel at " << i << "." << std::endl;
 }
 
 FlowChannel* FlowData::getChannel(int i)
 {
-    return channels[i];
+    ChannelEntry& entry = channels[i];
+    entry.lastUse = memory.getClock();
+    if (entry.channel->isSpilled())
+    {
+        //channels used since the last enforcement are protected, the caller may still be working with them
+        size_t bytes = geometry.getStorageSize() * sizeof(float);
+        updateMemoryUsage();
+        if (!evict(bytes, memory.getClock(), true))
+            std::cerr << "Reading back channel " << i << " exceeds the memory budget, the channels in use do not fit into it." << std::endl;
+        entry.channel->restore();
+    }
+    return entry.channel;
+}
+
+FlowChannel* FlowData::touchChannel(int i)
+{
+    channels[i].lastUse = memory.getClock();
+    return channels[i].channel;
+}
+
+bool FlowData::hasChannel(int i)
+{
+    return (i >= 0) && (i < (int)channels.size()) && channels[i].channel;
+}
+
+int FlowData::getNumChannelSlots()
+{
+    return (int)channels.size();
+}
+
+void FlowData::setChannelName(int i, const string& name)
+{
+    if (hasChannel(i))
+        channels[i].name = name;
+}
+
+string FlowData::getChannelName(int i)
+{
+    return hasChannel(i) ? channels[i].name : string();
+}
+
+int FlowData::findChannel(const string& name)
+{
+    for (int i = 0; i < (int)channels.size(); i++)
+        if (channels[i].channel && (channels[i].name == name))
+            return i;
+    return -1;
+}
+
+void FlowData::setDerived(int i, const string& name)
+{
+    channels[i].derived = true;
+    channels[i].name = name;
+}
+
+FlowMemory* FlowData::getMemory()
+{
+    return &memory;
+}
+
+FlowArena* FlowData::getArena()
+{
+    return &arena;
+}
+
+void FlowData::updateMemoryUsage()
+{
+	size_t loaded = 0;
+	size_t derived = 0;
+	size_t caches = 0;
+	for (size_t i = 0; i < channels.size(); i++)
+	{
+		if (!channels[i].channel)
+			continue;
+		if (channels[i].derived)
+			derived += channels[i].channel->getMemory();
+		else
+			loaded += channels[i].channel->getMemory();
+		caches += channels[i].channel->getCacheMemory();
+	}
+	size_t resampled = resampler->getMemory();
+	for (size_t g = 0; g < groups.size(); g++)
+		resampled += groups[g]->getMemory();
+	memory.setUsage(MEMORY_GEOMETRY, geometry.getMemory() + volume.getMemory());
+	memory.setUsage(MEMORY_CHANNELS, loaded);
+	memory.setUsage(MEMORY_DERIVED, derived);
+	memory.setUsage(MEMORY_CACHES, caches);
+	memory.setUsage(MEMORY_RESAMPLED, resampled);
+	memory.setUsage(MEMORY_POOLED, arena.getIdleMemory());
+}
+
+bool FlowData::enforceBudget(size_t extra)
+{
+	updateMemoryUsage();
+	unsigned int since = memory.getClock();
+	//whatever is used from now on is protected from the next enforcement
+	memory.advanceClock();
+	return evict(extra, since, true);
+}
+
+bool FlowData::evict(size_t extra, unsigned int since, bool spill)
+{
+	size_t budget = memory.getBudget();
+	size_t used = memory.getTotal();
+	if ((budget == 0) || (used + extra <= budget))
+		return true;
+
+	//the channels not in use, least recently used first
+	vector< pair<unsigned int, int> > idle;
+	for (size_t i = 0; i < channels.size(); i++)
+		if (channels[i].channel && (channels[i].lastUse < since))
+			idle.push_back(make_pair(channels[i].lastUse, (int)i));
+	sort(idle.begin(), idle.end());
+
+	//the cheapest to get back first, idle buffers cost nothing but a new allocation
+	used -= arena.trim();
+	for (size_t k = 0; (k < idle.size()) && (used + extra > budget); k++)
+		used -= channels[idle[k].second].channel->releaseCaches();
+	while (used + extra > budget)
+	{
+		size_t freed = resampler->releaseLeastRecent(since);
+		if (freed == 0)
+			break;
+		used -= freed;
+	}
+	for (size_t k = 0; spill && (k < idle.size()) && (used + extra > budget); k++)
+	{
+		ChannelEntry& entry = channels[idle[k].second];
+		if (entry.derived && !entry.channel->isSpilled())
+		{
+			size_t freed = entry.channel->spill(memory.createSpillPath());
+			if (freed)
+				std::cout << "Spilled channel " << idle[k].second << " (" << entry.name << ") to disk" << std::endl;
+			used -= freed;
+		}
+	}
+	//the evicted grids and spilled values went back to the arena, the budget wants them freed
+	arena.trim();
+	updateMemoryUsage();
+	return memory.fits(extra);
 }
 
 int FlowData::createChannelGeometry(int dimension)
 {
-    int result = createChannel();
-	//just take the dimension as if it was an offset to the geometryData array
-    channels[result]->copyValues((float*)geometry.geometryData, 3, dimension);
+	//the geometry keeps a separate array per dimension in the same vertex order as the channels, so the channel can simply view it
+	float* pos = (dimension == 0) ? geometry.posX : geometry.posY;
+    int result = createChannel(pos);
+	if (result < 0)
+		return result;
+	getChannel(result)->endUpdate();
+	setChannelName(result, (dimension == 0) ? "x" : "y");
     return result;
 }
 
 int FlowData::createChannelVectorLength(FlowChannel* chX, FlowChannel* chY, FlowChannel* chZ)
 {
     int result = createChannel();
+	if (result < 0)
+		return result;
+	setDerived(result, "length");
+	FlowChannel* out = getChannel(result);
     //check whether we deal with 2D or 3D vectors
-	if (chZ)
-        for (int i = 0; i < geometry.getDimX()*geometry.getDimY(); i++)
-			//save the vector length
-            channels[result]->setValue(i,sqrt(chX->getValue(i)*chX->getValue(i) + chY->getValue(i)*chY->getValue(i) + chZ->getValue(i)*chZ->getValue(i)));
-    else
-        for (int i = 0; i < geometry.getDimX()*geometry.getDimY(); i++)
-            channels[result]->setValue(i,sqrt(chX->getValue(i)*chX->getValue(i) + chY->getValue(i)*chY->getValue(i)));
+	//walk the vertices (not the storage), so that the padding of tiled orders does not end up in the minimum
+	for (int y = 0; y < geometry.getDimY(); y++)
+		for (int x = 0; x < geometry.getDimX(); x++)
+		{
+			int i = geometry.getVtx(x,y);
+			if (chZ)
+				//save the vector length
+				out->setValue(i,sqrt(chX->getValue(i)*chX->getValue(i) + chY->getValue(i)*chY->getValue(i) + chZ->getValue(i)*chZ->getValue(i)));
+			else
+				out->setValue(i,sqrt(chX->getValue(i)*chX->getValue(i) + chY->getValue(i)*chY->getValue(i)));
+		}
  
     return result;
 }
@@ -214,6 +509,459 @@ int FlowData::createChannelVectorLength(int chX, int chY, int chZ)
 	else return createChannelVectorLength(getChannel(chX),getChannel(chY));
 }
 
+int FlowData::createChannelComputationalVelocity(int chX, int chY, int dimension)
+{
+	int result = createChannel();
+	if (result < 0)
+		return result;
+	setDerived(result, (dimension == 0) ? "velocity i" : "velocity j");
+	FlowChannel* u = getChannel(chX);
+	FlowChannel* v = getChannel(chY);
+	FlowChannel* out = getChannel(result);
+	int dimX = geometry.getDimX();
+	int dimY = geometry.getDimY();
+
+	//every vertex is transformed independently, the minimum and maximum are merged afterwards
+	float* transformed = arena.allocate<float>(dimX*dimY);
+	if (!transformed)
+	{
+		deleteChannel(result);
+		return -1;
+	}
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dimY; y++)
+		for (int x = 0; x < dimX; x++)
+		{
+			int i = geometry.getVtx(x,y);
+			float J[4];
+			geometry.getJacobian(i, J);
+			//(di/dt, dj/dt) = J^-1 * (u, v)
+			float det = J[0]*J[3] - J[1]*J[2];
+			float invDet = (fabs(det) > 1e-20f) ? 1.0f / det : 0.0f;
+			if (dimension == 0)
+				transformed[(y*dimX) + x] = (J[3]*u->getValue(i) - J[1]*v->getValue(i)) * invDet;
+			else
+				transformed[(y*dimX) + x] = (J[0]*v->getValue(i) - J[2]*u->getValue(i)) * invDet;
+		}
+	out->copyValues(transformed, 1, 0);
+	arena.release(transformed);
+
+	return result;
+}
+
+FlowChannelGroup* FlowData::createGroupComputationalVelocity(int chX, int chY)
+{
+	FlowChannelGroup* group = new FlowChannelGroup(&geometry, 2, &arena);
+	FlowChannel* u = getChannel(chX);
+	FlowChannel* v = getChannel(chY);
+	int dimX = geometry.getDimX();
+	int dimY = geometry.getDimY();
+
+	//both components of a vertex at once, straight into the group
+	float* dst = group->beginUpdate();
+	if (!dst)
+	{
+		delete group;
+		return NULL;
+	}
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dimY; y++)
+		for (int x = 0; x < dimX; x++)
+		{
+			int i = geometry.getVtx(x,y);
+			float J[4];
+			geometry.getJacobian(i, J);
+			float det = J[0]*J[3] - J[1]*J[2];
+			float invDet = (fabs(det) > 1e-20f) ? 1.0f / det : 0.0f;
+			dst[2*i] = (J[3]*u->getValue(i) - J[1]*v->getValue(i)) * invDet;
+			dst[2*i + 1] = (J[0]*v->getValue(i) - J[2]*u->getValue(i)) * invDet;
+		}
+	group->endUpdate();
+	groups.push_back(group);
+	return group;
+}
+
+int FlowData::createChannelFiltered(int ch, FilterType type, float size, float sigmaRange)
+{
+	int result = createChannel();
+	if (result < 0)
+		return result;
+	static const char* names[] = {"gaussian", "box", "median", "bilateral"};
+	setDerived(result, string(names[type]) + "(" + getChannelName(ch) + ")");
+	FlowChannel* src = getChannel(ch);
+	FlowChannel* dst = getChannel(result);
+	//the scratch arrays of the filters come from the arena like the temporaries of the other derived channels
+	bool ok;
+	switch (type)
+	{
+	case FILTER_BOX:
+		ok = FlowFilter::box(src, &geometry, (int)size, dst, &arena);
+		break;
+	case FILTER_MEDIAN:
+		ok = FlowFilter::median(src, &geometry, (int)size, dst, &arena);
+		break;
+	case FILTER_BILATERAL:
+		ok = FlowFilter::bilateral(src, &geometry, size, sigmaRange, dst, &arena);
+		break;
+	default:
+		ok = FlowFilter::gaussian(src, &geometry, size, dst, &arena);
+	}
+	if (!ok)
+	{
+		deleteChannel(result);
+		return -1;
+	}
+	return result;
+}
+
+///diffuses the block of one worker and stores its owned vertices into a row-major result, see FlowData::createChannelDiffused
+class DiffusionJob : public ExchangeJob{
+	public:
+		const DomainDecomposition* decomposition;
+		FlowChannel* source;
+		FlowGeometry* geometry;
+		int iterations;
+		float rate;
+		float* result;
+
+		bool run(SharedExchange& exchange, int rank)
+		{
+			BlockField field(decomposition->getBlock(rank));
+			field.fillFrom(source, geometry);
+			if (!exchange.diffuse(field, 0, iterations, rate))
+				return false;
+			//the blocks own disjoint vertices, so they write without locking
+			const DomainBlock& b = field.getBlock();
+			for (int y = b.begin[1]; y < b.end[1]; y++)
+				for (int x = b.begin[0]; x < b.end[0]; x++)
+					result[(size_t)y*geometry->getDimX() + x] = field.at(x,y);
+			return true;
+		}
+};
+
+int FlowData::createChannelDiffused(int ch, int iterations, int blocksX, int blocksY, float rate)
+{
+	if ((rate <= 0.0f) || (rate > 0.25f))
+	{
+		std::cerr << "The diffusion rate " << rate << " is not stable, it has to lie in (0, 0.25]." << std::endl;
+		return -1;
+	}
+	int result = createChannel();
+	if (result < 0)
+		return result;
+	setDerived(result, "diffused(" + getChannelName(ch) + ")");
+	int dimX = geometry.getDimX();
+	int dimY = geometry.getDimY();
+	float* values = arena.allocate<float>((size_t)dimX*dimY);
+	if (!values)
+	{
+		deleteChannel(result);
+		return -1;
+	}
+
+	DomainDecomposition decomposition(dimX, dimY, blocksX, blocksY, 1);
+	DiffusionJob job;
+	job.decomposition = &decomposition;
+	//read back before the workers start, they only read the values
+	job.source = getChannel(ch);
+	job.source->getValueArray();
+	job.geometry = &geometry;
+	job.iterations = iterations;
+	job.rate = rate;
+	job.result = values;
+	//the key has to be unique among all processes of the machine
+	static int diffusions = 0;
+	char key[64];
+	sprintf(key, "flow_diffusion_%p_%d", (void*)this, diffusions++);
+	bool ok = SharedExchange::runLocal(QString(key), &decomposition, 1, &job);
+	if (ok)
+		getChannel(result)->copyValues(values, 1, 0);
+	arena.release(values);
+	if (!ok)
+	{
+		std::cerr << "The workers of the diffusion failed." << std::endl;
+		deleteChannel(result);
+		return -1;
+	}
+	return result;
+}
+
+void FlowData::deleteGroups()
+{
+	for (size_t g = 0; g < groups.size(); g++)
+		delete groups[g];
+	groups.clear();
+}
+
+int FlowData::createChannelDerived(int chX, int chY, DerivedQuantity quantity)
+{
+	int result = createChannel();
+	if (result < 0)
+		return result;
+	static const char* names[] = {"vorticity", "divergence", "shear", "okubo-weiss", "q-criterion", "lambda2"};
+	setDerived(result, names[quantity]);
+	FlowChannel* u = getChannel(chX);
+	FlowChannel* v = getChannel(chY);
+	int dimX = geometry.getDimX();
+	int dimY = geometry.getDimY();
+	int tilesX = (dimX + DERIVED_TILE - 1) / DERIVED_TILE;
+	int tilesY = (dimY + DERIVED_TILE - 1) / DERIVED_TILE;
+	float* derived = arena.allocate<float>(dimX*dimY);
+	if (!derived)
+	{
+		deleteChannel(result);
+		return -1;
+	}
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int tile = 0; tile < tilesX*tilesY; tile++)
+	{
+		const int stride = DERIVED_TILE + 2;
+		int x0 = (tile % tilesX) * DERIVED_TILE;
+		int y0 = (tile / tilesX) * DERIVED_TILE;
+		int tw = (x0 + DERIVED_TILE < dimX) ? DERIVED_TILE : dimX - x0;
+		int th = (y0 + DERIVED_TILE < dimY) ? DERIVED_TILE : dimY - y0;
+
+		//the velocity of the tile and a one vertex wide border around it, (lx,ly) = (1,1) is the vertex (x0,y0)
+		float tu[stride*stride], tv[stride*stride];
+		//the Jacobian of the tile vertices
+		float jxi[DERIVED_TILE*DERIVED_TILE], jxj[DERIVED_TILE*DERIVED_TILE], jyi[DERIVED_TILE*DERIVED_TILE], jyj[DERIVED_TILE*DERIVED_TILE];
+		int lxMin = (x0 > 0) ? 0 : 1;
+		int lxMax = (x0 + tw < dimX) ? tw+1 : tw;
+		int lyMin = (y0 > 0) ? 0 : 1;
+		int lyMax = (y0 + th < dimY) ? th+1 : th;
+		for (int ly = lyMin; ly <= lyMax; ly++)
+			for (int lx = lxMin; lx <= lxMax; lx++)
+			{
+				int i = geometry.getVtx(x0 + lx - 1, y0 + ly - 1);
+				tu[ly*stride + lx] = u->getValue(i);
+				tv[ly*stride + lx] = v->getValue(i);
+			}
+		for (int ly = 0; ly < th; ly++)
+			for (int lx = 0; lx < tw; lx++)
+			{
+				float J[4];
+				geometry.getJacobian(geometry.getVtx(x0 + lx, y0 + ly), J);
+				jxi[ly*DERIVED_TILE + lx] = J[0];
+				jxj[ly*DERIVED_TILE + lx] = J[1];
+				jyi[ly*DERIVED_TILE + lx] = J[2];
+				jyj[ly*DERIVED_TILE + lx] = J[3];
+			}
+
+		//beyond the grid border the velocity is extrapolated linearly, so that the central difference there equals the one-sided one.
+		//the inner neighbour of a border vertex is either inside of the tile or in the halo of the neighbouring tile (e.g. the last tile of a grid with dimX % DERIVED_TILE == 1)
+		bool hasRight = (tw > 1) || (lxMax > tw);
+		bool hasLeft = (tw > 1) || (lxMin == 0);
+		bool hasBelow = (th > 1) || (lyMax > th);
+		bool hasAbove = (th > 1) || (lyMin == 0);
+		float* fields[2] = {tu, tv};
+		for (int f = 0; f < 2; f++)
+		{
+			float* t = fields[f];
+			for (int ly = lyMin; ly <= lyMax; ly++)
+			{
+				if (lxMin == 1)
+					t[ly*stride] = hasRight ? 2.0f*t[ly*stride + 1] - t[ly*stride + 2] : t[ly*stride + 1];
+				if (lxMax == tw)
+					t[ly*stride + tw+1] = hasLeft ? 2.0f*t[ly*stride + tw] - t[ly*stride + tw-1] : t[ly*stride + tw];
+			}
+			for (int lx = 0; lx <= tw+1; lx++)
+			{
+				if (lyMin == 1)
+					t[lx] = hasBelow ? 2.0f*t[stride + lx] - t[2*stride + lx] : t[stride + lx];
+				if (lyMax == th)
+					t[(th+1)*stride + lx] = hasAbove ? 2.0f*t[th*stride + lx] - t[(th-1)*stride + lx] : t[th*stride + lx];
+			}
+		}
+
+		//the physical velocity gradient: du/dx, du/dy, dv/dx, dv/dy. Only contiguous buffers from here on, so the loops vectorize.
+		float a[DERIVED_TILE*DERIVED_TILE], b[DERIVED_TILE*DERIVED_TILE], c[DERIVED_TILE*DERIVED_TILE], d[DERIVED_TILE*DERIVED_TILE];
+		for (int ly = 0; ly < th; ly++)
+			for (int lx = 0; lx < tw; lx++)
+			{
+				int k = (ly+1)*stride + lx+1;
+				int l = ly*DERIVED_TILE + lx;
+				float dudi = 0.5f*(tu[k+1] - tu[k-1]);
+				float dudj = 0.5f*(tu[k+stride] - tu[k-stride]);
+				float dvdi = 0.5f*(tv[k+1] - tv[k-1]);
+				float dvdj = 0.5f*(tv[k+stride] - tv[k-stride]);
+				float det = jxi[l]*jyj[l] - jxj[l]*jyi[l];
+				float invDet = (fabs(det) > 1e-20f) ? 1.0f / det : 0.0f;
+				a[l] = (dudi*jyj[l] - dudj*jyi[l]) * invDet;
+				b[l] = (dudj*jxi[l] - dudi*jxj[l]) * invDet;
+				c[l] = (dvdi*jyj[l] - dvdj*jyi[l]) * invDet;
+				d[l] = (dvdj*jxi[l] - dvdi*jxj[l]) * invDet;
+			}
+
+		//the quantity is chosen once per tile, not per vertex
+		for (int ly = 0; ly < th; ly++)
+		{
+			float* out = derived + (y0 + ly)*dimX + x0;
+			const float* ra = a + ly*DERIVED_TILE;
+			const float* rb = b + ly*DERIVED_TILE;
+			const float* rc = c + ly*DERIVED_TILE;
+			const float* rd = d + ly*DERIVED_TILE;
+			switch (quantity)
+			{
+			case DERIVED_VORTICITY:
+				for (int lx = 0; lx < tw; lx++)
+					out[lx] = rc[lx] - rb[lx];
+				break;
+			case DERIVED_DIVERGENCE:
+				for (int lx = 0; lx < tw; lx++)
+					out[lx] = ra[lx] + rd[lx];
+				break;
+			case DERIVED_SHEAR:
+				for (int lx = 0; lx < tw; lx++)
+					out[lx] = sqrt((ra[lx] - rd[lx])*(ra[lx] - rd[lx]) + (rc[lx] + rb[lx])*(rc[lx] + rb[lx]));
+				break;
+			case DERIVED_OKUBO_WEISS:
+				for (int lx = 0; lx < tw; lx++)
+					out[lx] = (ra[lx] - rd[lx])*(ra[lx] - rd[lx]) + (rc[lx] + rb[lx])*(rc[lx] + rb[lx]) - (rc[lx] - rb[lx])*(rc[lx] - rb[lx]);
+				break;
+			case DERIVED_Q_CRITERION:
+				//|R|^2 = (b-c)^2/2, |S|^2 = a^2 + d^2 + (b+c)^2/2
+				for (int lx = 0; lx < tw; lx++)
+					out[lx] = 0.5f*(0.5f*(rb[lx] - rc[lx])*(rb[lx] - rc[lx]) - ra[lx]*ra[lx] - rd[lx]*rd[lx] - 0.5f*(rb[lx] + rc[lx])*(rb[lx] + rc[lx]));
+				break;
+			case DERIVED_LAMBDA2:
+				for (int lx = 0; lx < tw; lx++)
+				{
+					//S^2 + R^2 is symmetric, its smaller eigenvalue in closed form
+					float s = 0.5f*(rb[lx] + rc[lx]);
+					float r = 0.5f*(rb[lx] - rc[lx]);
+					float m00 = ra[lx]*ra[lx] + s*s - r*r;
+					float m11 = rd[lx]*rd[lx] + s*s - r*r;
+					float m01 = s*(ra[lx] + rd[lx]);
+					float half = 0.5f*(m00 - m11);
+					out[lx] = 0.5f*(m00 + m11) - sqrt(half*half + m01*m01);
+				}
+				break;
+			}
+		}
+	}
+
+	getChannel(result)->copyValues(derived, 1, 0);
+	arena.release(derived);
+	return result;
+}
+
+int FlowData::createChannelExpression(const string& expression)
+{
+	FlowExpression compiled;
+	if (!compiled.compile(expression, this))
+		return -1;
+	unsigned int hash = compiled.getHash();
+
+	//look for an earlier evaluation of the same code
+	for (size_t e = 0; e < expressions.size(); e++)
+	{
+		ExpressionEntry& entry = expressions[e];
+		if (entry.hash != hash || entry.key != compiled.getKey())
+			continue;
+		bool current = true;
+		for (size_t k = 0; k < entry.inputs.size(); k++)
+			current = current && (channels[entry.inputs[k]].channel->getRevision() == entry.revisions[k]);
+		if (!current)
+		{
+			//an input was modified, the values are computed again into the same channel
+			compiled.evaluate(this, getChannel(entry.channel));
+			for (size_t k = 0; k < entry.inputs.size(); k++)
+				entry.revisions[k] = channels[entry.inputs[k]].channel->getRevision();
+			resampler->clearCache();
+		}
+		return entry.channel;
+	}
+
+	int result = createChannel();
+	if (result < 0)
+		return result;
+	setDerived(result, compiled.getKey());
+	compiled.evaluate(this, getChannel(result));
+	ExpressionEntry entry;
+	entry.hash = hash;
+	entry.key = compiled.getKey();
+	entry.inputs = compiled.getInputs();
+	entry.channel = result;
+	for (size_t k = 0; k < entry.inputs.size(); k++)
+		entry.revisions.push_back(channels[entry.inputs[k]].channel->getRevision());
+	expressions.push_back(entry);
+	std::cout << "Expression " << expression << " evaluated into channel " << result << std::endl;
+	return result;
+}
+
+int FlowData::createChannelValidity()
+{
+	int result = createChannel();
+	if (result < 0)
+		return result;
+	setDerived(result, "valid");
+	FlowMask* mask = geometry.getMask();
+	float* dst = getChannel(result)->beginUpdate();
+	int dimX = geometry.getDimX();
+	int dimY = geometry.getDimY();
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dimY; y++)
+		for (int x = 0; x < dimX; x++)
+			dst[geometry.getVtx(x,y)] = (!mask || mask->isValid(x,y)) ? 1.0f : 0.0f;
+	getChannel(result)->endUpdate();
+	return result;
+}
+
+int FlowData::createMaskFromVelocity(int chX, int chY, int chZ, float threshold)
+{
+	const float* u = getChannel(chX)->getValueArray();
+	const float* v = getChannel(chY)->getValueArray();
+	const float* w = (chZ >= 0) ? getChannel(chZ)->getValueArray() : NULL;
+	int dimX = geometry.getDimX();
+	int dimY = geometry.getDimY();
+	FlowMask* mask = new FlowMask(dimX, dimY);
+	//every thread sets whole rows, which never share a word of bits
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dimY; y++)
+		for (int x = 0; x < dimX; x++)
+		{
+			int i = geometry.getVtx(x,y);
+			bool still = (fabs(u[i]) <= threshold) && (fabs(v[i]) <= threshold) && (!w || (fabs(w[i]) <= threshold));
+			mask->setValid(x, y, !still);
+		}
+	mask->endUpdate();
+	int invalid = mask->getNumInvalid();
+	if (invalid == 0)
+	{
+		delete mask;
+		mask = NULL;
+	}
+	geometry.setMask(mask);
+	return invalid;
+}
+
+int FlowData::createMaskFromChannel(int ch, float threshold)
+{
+	const float* values = getChannel(ch)->getValueArray();
+	int dimX = geometry.getDimX();
+	int dimY = geometry.getDimY();
+	FlowMask* mask = new FlowMask(dimX, dimY);
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dimY; y++)
+		for (int x = 0; x < dimX; x++)
+			mask->setValid(x, y, values[geometry.getVtx(x,y)] >= threshold);
+	mask->endUpdate();
+	int invalid = mask->getNumInvalid();
+	if (invalid == 0)
+	{
+		delete mask;
+		mask = NULL;
+	}
+	geometry.setMask(mask);
+	return invalid;
+}
+
+void FlowData::clearMask()
+{
+	geometry.setMask(NULL);
+}
+
 int FlowData::getNumTimesteps()
 {
 	return timesteps;
@@ -221,4 +969,9 @@ int FlowData::getNumTimesteps()
 
 FlowGeometry* FlowData::getGeometry() {
 	return &geometry;
-}
\ No newline at end of file
+}
+
+FlowResampler* FlowData::getResampler()
+{
+	return resampler;
+}
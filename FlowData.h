@@ -3,13 +3,35 @@
 
 #include "FlowGeometry.h"
 #include "FlowChannel.h"
+#include "FlowVolume.h"
+#include "FlowFilter.h"
+#include "FlowMemory.h"
+#include "FlowArena.h"
 #include <stdio.h>
 #include <iostream>
 #include <string>
+#include <vector>
+
+class FlowResampler;
+class FlowChannelGroup;
 
 using namespace std;
-//maximum nuber of channels. For VisLU data sets we have only 5 anyways
-#define max_channels 16
+
+///quantities derived from the velocity gradient, see FlowData::createChannelDerived
+enum DerivedQuantity {
+	///vorticity dv/dx - du/dy
+	DERIVED_VORTICITY,
+	///divergence du/dx + dv/dy
+	DERIVED_DIVERGENCE,
+	///magnitude of the strain, sqrt(normal strain^2 + shear strain^2) with the normal strain du/dx - dv/dy and the shear strain dv/dx + du/dy
+	DERIVED_SHEAR,
+	///Okubo-Weiss parameter, strain^2 - vorticity^2 (negative in vortices)
+	DERIVED_OKUBO_WEISS,
+	///Q-criterion, (|rotation tensor|^2 - |strain rate tensor|^2) / 2 (positive in vortices)
+	DERIVED_Q_CRITERION,
+	///smaller eigenvalue of S^2 + R^2 with the strain rate tensor S and the rotation tensor R (negative in vortices)
+	DERIVED_LAMBDA2
+};
 ///class managing the data sets and related stuff like data loading, channels creation etc.
 class FlowData{
 private:
@@ -19,12 +41,66 @@ private:
     ///Number of timesteps
     int timesteps;
 
-    ///Stores the underlying geometry
+    ///Stores the underlying geometry. For 3D datasets this is the geometry of the selected slice.
     FlowGeometry geometry;
-    
-  
+
+    ///Stores the whole grid and all channels of 3D datasets, empty for 2D ones
+    FlowVolume volume;
+    ///index of the Z slice currently exposed through geometry and channels (3D datasets only)
+    int slice;
+    ///vertex order requested when loading, also used for the slices
+    VertexOrder vertexOrder;
+    ///resamples channels onto regular grids, caches the results until channels change
+    FlowResampler* resampler;
+
+    ///a channel computed from an expression, see createChannelExpression
+    struct ExpressionEntry{
+        ///hash of the canonical expression text
+        unsigned int hash;
+        ///canonical expression text, compared on equal hashes
+        string key;
+        ///ids of the channels the expression reads
+        vector<int> inputs;
+        ///revisions of the inputs at the time of the evaluation
+        vector<unsigned int> revisions;
+        ///the channel holding the result
+        int channel;
+    };
+    ///all evaluated expressions, each one is computed once until one of its inputs changes
+    vector<ExpressionEntry> expressions;
+
+    ///channel groups created by the create*Group methods, they live until the next dataset or slice is loaded
+    vector<FlowChannelGroup*> groups;
+    ///deletes all channel groups
+    void deleteGroups();
+
+    ///creates one channel per attribute of rawdata (row-major, numChannels values per vertex), transposing it first if the geometry was flipped. Returns false if they do not fit into the memory budget.
+    bool assignChannels(float* rawdata, int numChannels);
+
+    ///one slot of the channel registry
+    struct ChannelEntry{
+        ///the channel, NULL for a free slot
+        FlowChannel* channel;
+        ///name of the channel, see findChannel
+        string name;
+        ///true for channels computed by the create* methods, their values may be spilled to disk
+        bool derived;
+        ///time of the use clock (see FlowMemory) of the last getChannel
+        unsigned int lastUse;
+    };
     ///stores the values of data channels for one time step. For time-dependent data, the best solution is to create a separate class handling channels in one timestep and to instanciate this class for all timesteps.
-    FlowChannel* channels[max_channels];
+    vector<ChannelEntry> channels;
+    ///marks a channel as computed by the data set and names it
+    void setDerived(int i, const string& name);
+
+    ///accounting and budget of the memory of the data set
+    FlowMemory memory;
+    ///pools of the buffers of channels, groups, resampled grids and loading scratch, reused by the next data set
+    FlowArena arena;
+    ///generation of the arena when the current data set started loading, the buffers idle since before are freed by the next load
+    unsigned int loadGeneration;
+    ///evicts items not used since the time since of the use clock until extra bytes more fit into the budget. Channels are spilled only if spill is true.
+    bool evict(size_t extra, unsigned int since, bool spill);
 
 public:
 	///initializes the channel storage
@@ -32,31 +108,131 @@ public:
     ///destoys all created channels
     ~FlowData();
 
-    ///is the channel slot free?
-    bool freeChannel[max_channels];
-
-    ///Loads a dataset, returns true if everything successful. You have to specify the byte order used in the data
-    bool loadDataset(string filename, bool bigEndian);
+    ///Loads a dataset, returns true if everything successful. You have to specify the byte order used in the data. The vertex order selects the memory layout of the geometry and all channels.
+    bool loadDataset(string filename, bool bigEndian, VertexOrder order = ORDER_ROW_MAJOR);
     
     ///Returns the number of timesteps
     int getNumTimesteps();
     
     //channels stuff
-	///creates a new channel and returns it's address in the channels array (line 28)
-	int createChannel();
+	///creates a new channel and returns it's address in the channel registry, -1 if it does not fit into the memory budget. If shared is given, the channel views these values (see FlowChannel) instead of allocating its own.
+	/**
+	* The first free slot is reused, otherwise the registry grows, so there is no limit on the number of channels. The channel is named "c" followed by its address,
+	* the create* methods name their results after what they compute.
+	*/
+	int createChannel(float* shared = NULL);
 	///deletes the channel and all it's data at given adress
     void deleteChannel(int i);
-	///returns a pointer to the instance of channel at given adress. This is the only way to access the channels storage (at line 28)
+	///returns a pointer to the instance of channel at given adress. This is the only way to access the channel registry.
+	/**
+	* Spilled values (see enforceBudget) are read back first, other derived channels not in use are spilled to make room for them if necessary.
+	* The channel counts as in use until the next enforcement of the budget, so it is not spilled while the caller works with it.
+	* The budget is soft for what is in use: if the items in use alone exceed it, the values are read back anyway and a warning is printed.
+	*/
 	FlowChannel* getChannel(int i);
+	///marks the channel at given adress as in use like getChannel, but does not read back spilled values. Meant for results cached from the channel, which only need its revision.
+	FlowChannel* touchChannel(int i);
+	///returns true if there is a channel at given adress
+	bool hasChannel(int i);
+	///returns the number of slots of the registry, all channels have addresses below it (see hasChannel)
+	int getNumChannelSlots();
+	///renames the channel at given adress
+	void setChannelName(int i, const string& name);
+	///returns the name of the channel at given adress
+	string getChannelName(int i);
+	///returns the address of the first channel with the given name, -1 if there is none
+	int findChannel(const string& name);
+
+	//memory governor
+	///returns the memory accounting of the data set, e.g. to set the budget or to report the textures
+	FlowMemory* getMemory();
+	///measures the memory of the geometry, the channels, their caches, the resampled grids and the idle buffers of the arena
+	void updateMemoryUsage();
+	///evicts items until extra bytes more fit into the budget, returns false if that is not possible
+	/**
+	* Items are evicted in the order of the cost to get them back, the least recently used first within each kind:
+	* the idle buffers of the arena, the caches of the channels (bitmap indexes, summed-area tables, mip pyramids), then the results of the resampler,
+	* then the values of derived channels are spilled to disk. Loaded channels, channel groups and everything used since the previous
+	* enforcement stay in memory. createChannel calls this with the size of the new channel, the renderer after loading a data set.
+	*/
+	bool enforceBudget(size_t extra = 0);
+	///returns the arena of the data set, large buffers that live as long as the data set (or are needed again and again) should be taken from it
+	FlowArena* getArena();
     
     //special channels creation
 	///creates a new channel containing the geometrical information of the given dimension (x = 0, y = 1). Returns address of the created channel in the channels array (line 28)
+	/**
+	* The channel views the coordinate array of the geometry, so nothing is copied. It must not be modified.
+	*/
     int createChannelGeometry(int dimension);
 	///creates a new channel containing the vector lengths for the given channels (channels given by IDs). Returns address of the created channel in the channels array (line 28)
     int createChannelVectorLength(int chX, int chY, int chZ = -1);
 	///creates a new channel containing the vector lengths for the given channels (channels given by reference). Returns address of the created channel
 	int createChannelVectorLength(FlowChannel* chX, FlowChannel* chY, FlowChannel* chZ = NULL);
+	///creates a new channel containing the given component (i = 0, j = 1) of the velocity (given by the channels chX, chY) transformed into computational space by the inverse grid Jacobian. Returns address of the created channel in the channels array (line 28)
+	/**
+	* The result is the velocity in vertex indexes per unit of time, so that streamlines can be integrated purely in (i,j) without any point location.
+	*/
+	int createChannelComputationalVelocity(int chX, int chY, int dimension);
+	///creates a group of both components of the velocity (given by the channels chX, chY) in computational space, see createChannelComputationalVelocity
+	/**
+	* The components of every vertex are stored next to each other, so an integrator fetches a whole vector at once. The group is owned by the dataset
+	* and deleted when the next dataset or slice is loaded. Returns NULL if there is no memory for the values.
+	*/
+	FlowChannelGroup* createGroupComputationalVelocity(int chX, int chY);
+	///creates a new channel containing a quantity derived from the gradient of the velocity given by the channels chX, chY. Returns address of the created channel in the channels array (line 28)
+	/**
+	* The derivatives along the vertex indexes (central differences inside, one-sided ones at the border) are turned into physical ones with the metric terms of the geometry.
+	* The grid is processed in tiles in parallel, each tile first gathers its vertices and its one vertex wide border into small row-major buffers.
+	*/
+	int createChannelDerived(int chX, int chY, DerivedQuantity quantity);
+	///creates a new channel containing the channel ch smoothed by the given filter (see FlowFilter). Returns address of the created channel in the channels array (line 28), -1 if there is no memory for it or its scratch arrays
+	/**
+	* @param size standard deviation in vertices for FILTER_GAUSSIAN and FILTER_BILATERAL, radius in vertices for FILTER_BOX and FILTER_MEDIAN
+	* @param sigmaRange standard deviation of the values for FILTER_BILATERAL (the standard deviation of the channel if <= 0), unused otherwise
+	*/
+	int createChannelFiltered(int ch, FilterType type, float size, float sigmaRange = 0.0f);
+	///creates a new channel containing the channel ch after iterations steps of diffusion, computed by blocksX x blocksY workers of a DomainDecomposition. Returns -1 on errors.
+	/**
+	* Every worker owns one block with a one vertex wide ghost layer and runs the stencil of SharedExchange::diffuse, the ghost layers are exchanged
+	* through shared memory before every step. The workers run as threads of this process (see SharedExchange::runLocal).
+	*/
+	int createChannelDiffused(int ch, int iterations, int blocksX, int blocksY, float rate = 0.25f);
+	///returns the address of a channel holding the values of the expression (e.g. "sqrt(c0*c0+c1*c1)" or "(c3-mean(c3))/std(c3)", see FlowExpression), -1 on errors
+	/**
+	* Expressions are memoized by the hash of their compiled code: asking for the same expression again returns the same channel,
+	* which is only evaluated again when one of its input channels was modified. The channel is shared, so it should not be modified by the caller.
+	* Deleting the channel or one of its inputs drops the memoized entry.
+	*/
+	int createChannelExpression(const string& expression);
+	///creates a new channel holding 1 for the valid and 0 for the invalid vertices of the mask of the geometry (see FlowMask). Returns address of the created channel in the channel registry.
+	/**
+	* Resampled onto a regular grid (see FlowResampler), the result is 0 exactly where the pixel lies in a blocked cell or outside of the grid.
+	*/
+	int createChannelValidity();
+
+	//masks of valid vertices
+	///marks the vertices where all velocity components (given by the channels chX, chY, chZ) are at most threshold in magnitude as invalid, e.g. solid obstacles. Returns the number of invalid vertices.
+	/**
+	* The mask is stored in the geometry (see FlowGeometry::getMask), statistics, expression reductions, integrators and renderers skip the invalid vertices.
+	* Without any invalid vertex the mask is removed, so nothing is skipped and nothing costs extra. loadDataset derives the mask from the velocity this way.
+	*/
+	int createMaskFromVelocity(int chX, int chY, int chZ = -1, float threshold = 0.0f);
+	///marks the vertices where the channel ch is below threshold as invalid, e.g. for a channel flagging the fluid vertices with 1. Returns the number of invalid vertices.
+	int createMaskFromChannel(int ch, float threshold = 0.5f);
+	///removes the mask, all vertices are valid again
+	void clearMask();
+	///returns true if the loaded dataset is a 3D grid
+	bool is3D();
+	///returns the bricked 3D data for trilinear sampling, NULL for 2D datasets
+	FlowVolume* getVolume();
+	///returns the index of the Z slice currently exposed as 2D data
+	int getSlice();
+	///exposes the Z slice z of a 3D dataset as the 2D geometry and channels. All channels, including derived ones, are recreated. Returns false for 2D datasets or invalid slices.
+	bool selectSlice(int z);
 	///returns the underlying geometry
 	FlowGeometry* getGeometry();
+	///returns the resampler for regular grid versions of the channels. Its cache is dropped whenever a channel is deleted or a dataset is loaded.
+	FlowResampler* getResampler();
 };
 #endif
@@ -0,0 +1,391 @@
+#include "FlowExpression.h"
+#include "FlowData.h"
+#include "FlowStatistics.h"
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+FlowExpression::FlowExpression()
+{
+	depth = 0;
+	text = cursor = NULL;
+	data = NULL;
+	stackSize = 0;
+}
+
+void FlowExpression::skipSpaces()
+{
+	while (*cursor == ' ' || *cursor == '\t')
+		cursor++;
+}
+
+bool FlowExpression::accept(char c)
+{
+	skipSpaces();
+	if (*cursor != c)
+		return false;
+	cursor++;
+	return true;
+}
+
+bool FlowExpression::error(const char* message)
+{
+	std::cerr << "Expression error at position " << (cursor - text) << ": " << message << std::endl;
+	return false;
+}
+
+void FlowExpression::emit(Opcode op, int operands, int channel, float value)
+{
+	static const char* names[] = {"", "", "+", "-", "*", "/", "pow", "atan2", "min", "max",
+		"neg", "sqrt", "abs", "exp", "log", "sin", "cos", "mean", "std", "min", "max"};
+	Instruction instruction;
+	instruction.op = op;
+	instruction.channel = channel;
+	instruction.value = value;
+	program.push_back(instruction);
+
+	stackSize += 1 - operands;
+	depth = (stackSize > depth) ? stackSize : depth;
+
+	//the key lists the postfix code, so it does not depend on whitespace or redundant parentheses
+	char token[32];
+	if (op == OP_CHANNEL)
+		sprintf(token, "c%d ", channel);
+	else if (op == OP_CONSTANT)
+		sprintf(token, "%.9g ", value);
+	else if (op >= OP_MEAN)
+		sprintf(token, "%s(c%d) ", names[op], channel);
+	else
+		sprintf(token, "%s ", names[op]);
+	key += token;
+}
+
+bool FlowExpression::parseExpression()
+{
+	if (!parseTerm())
+		return false;
+	while (true)
+	{
+		if (accept('+'))
+		{
+			if (!parseTerm())
+				return false;
+			emit(OP_ADD, 2);
+		}
+		else if (accept('-'))
+		{
+			if (!parseTerm())
+				return false;
+			emit(OP_SUB, 2);
+		}
+		else return true;
+	}
+}
+
+bool FlowExpression::parseTerm()
+{
+	if (!parseUnary())
+		return false;
+	while (true)
+	{
+		if (accept('*'))
+		{
+			if (!parseUnary())
+				return false;
+			emit(OP_MUL, 2);
+		}
+		else if (accept('/'))
+		{
+			if (!parseUnary())
+				return false;
+			emit(OP_DIV, 2);
+		}
+		else return true;
+	}
+}
+
+bool FlowExpression::parseUnary()
+{
+	if (accept('-'))
+	{
+		if (!parseUnary())
+			return false;
+		emit(OP_NEG, 1);
+		return true;
+	}
+	return parsePower();
+}
+
+bool FlowExpression::parsePower()
+{
+	if (!parsePrimary())
+		return false;
+	if (accept('^'))
+	{
+		//right associative, a^b^c = a^(b^c)
+		if (!parseUnary())
+			return false;
+		emit(OP_POW, 2);
+	}
+	return true;
+}
+
+bool FlowExpression::parseChannel(int* id)
+{
+	skipSpaces();
+	if (*cursor != 'c' || cursor[1] < '0' || cursor[1] > '9')
+		return error("channel expected");
+	cursor++;
+	*id = (int)strtol(cursor, (char**)&cursor, 10);
+	if (!data->hasChannel(*id))
+		return error("channel does not exist");
+	//every input is listed once
+	bool known = false;
+	for (size_t k = 0; k < inputs.size(); k++)
+		known = known || (inputs[k] == *id);
+	if (!known)
+		inputs.push_back(*id);
+	return true;
+}
+
+bool FlowExpression::parsePrimary()
+{
+	skipSpaces();
+	if (accept('('))
+	{
+		if (!parseExpression())
+			return false;
+		if (!accept(')'))
+			return error("')' expected");
+		return true;
+	}
+	if ((*cursor >= '0' && *cursor <= '9') || *cursor == '.')
+	{
+		const char* start = cursor;
+		float value = (float)strtod(start, (char**)&cursor);
+		if (cursor == start)
+			return error("invalid number");
+		emit(OP_CONSTANT, 0, -1, value);
+		return true;
+	}
+	if (*cursor == 'c' && cursor[1] >= '0' && cursor[1] <= '9')
+	{
+		int id;
+		if (!parseChannel(&id))
+			return false;
+		emit(OP_CHANNEL, 0, id);
+		return true;
+	}
+
+	//function name
+	const char* start = cursor;
+	while ((*cursor >= 'a' && *cursor <= 'z') || (*cursor >= '0' && *cursor <= '9'))
+		cursor++;
+	std::string name(start, cursor - start);
+	if (name.empty())
+		return error("unexpected character");
+	if (!accept('('))
+		return error("'(' expected after function name");
+
+	if (name == "mean" || name == "std")
+	{
+		int id;
+		if (!parseChannel(&id))
+			return false;
+		if (!accept(')'))
+			return error("')' expected, reductions take a single channel");
+		emit((name == "mean") ? OP_MEAN : OP_STD, 0, id);
+		return true;
+	}
+
+	static const char* unaryNames[] = {"sqrt", "abs", "exp", "log", "sin", "cos"};
+	static const Opcode unaryOps[] = {OP_SQRT, OP_ABS, OP_EXP, OP_LOG, OP_SIN, OP_COS};
+	for (int f = 0; f < 6; f++)
+		if (name == unaryNames[f])
+		{
+			if (!parseExpression())
+				return false;
+			if (!accept(')'))
+				return error("')' expected");
+			emit(unaryOps[f], 1);
+			return true;
+		}
+
+	static const char* binaryNames[] = {"pow", "atan2", "min", "max"};
+	static const Opcode binaryOps[] = {OP_POW, OP_ATAN2, OP_MIN, OP_MAX};
+	for (int f = 0; f < 4; f++)
+		if (name == binaryNames[f])
+		{
+			size_t first = program.size();
+			if (!parseExpression())
+				return false;
+			if (f >= 2 && program.size() == first + 1 && program[first].op == OP_CHANNEL && accept(')'))
+			{
+				//min(cN) and max(cN) are the reductions over the channel
+				int id = program[first].channel;
+				program.pop_back();
+				key.erase(key.rfind('c'));
+				stackSize--;
+				emit((f == 2) ? OP_CHANNEL_MIN : OP_CHANNEL_MAX, 0, id);
+				return true;
+			}
+			if (!accept(','))
+				return error("',' expected");
+			if (!parseExpression())
+				return false;
+			if (!accept(')'))
+				return error("')' expected");
+			emit(binaryOps[f], 2);
+			return true;
+		}
+	return error("unknown function");
+}
+
+bool FlowExpression::compile(const std::string& expression, FlowData* d)
+{
+	program.clear();
+	inputs.clear();
+	key.clear();
+	depth = 0;
+	stackSize = 0;
+	data = d;
+	text = cursor = expression.c_str();
+
+	bool ok = parseExpression();
+	skipSpaces();
+	if (ok && *cursor != '\0')
+		ok = error("unexpected character");
+	if (ok && depth > EXPR_MAX_DEPTH)
+		ok = error("expression nested too deeply");
+	if (!ok)
+	{
+		program.clear();
+		inputs.clear();
+		key.clear();
+	}
+	text = cursor = NULL;
+	return ok;
+}
+
+float FlowExpression::reduce(FlowData* d, int channel, bool deviation)
+{
+	//the statistics of the channel sum up in double, skip the invalid vertices and are kept until the channel changes
+	FlowStatistics* statistics = d->getChannel(channel)->getStatistics();
+	if (!deviation)
+		return (float)statistics->getMean();
+	return (float)sqrt(statistics->getVariance());
+}
+
+void FlowExpression::evaluate(FlowData* d, FlowChannel* out)
+{
+	FlowGeometry* geometry = d->getGeometry();
+	if (program.empty())
+		return;
+
+	//the reductions become constants, each one is computed once per evaluation
+	std::vector<Instruction> code(program);
+	std::vector<const float*> values(d->getNumChannelSlots(), (const float*)NULL);
+	for (size_t k = 0; k < code.size(); k++)
+	{
+		Instruction& instruction = code[k];
+		if (instruction.op == OP_CHANNEL)
+			values[instruction.channel] = d->getChannel(instruction.channel)->getValueArray();
+		else if (instruction.op == OP_MEAN || instruction.op == OP_STD)
+			instruction.value = reduce(d, instruction.channel, instruction.op == OP_STD);
+		else if (instruction.op == OP_CHANNEL_MIN)
+			instruction.value = d->getChannel(instruction.channel)->getMin();
+		else if (instruction.op == OP_CHANNEL_MAX)
+			instruction.value = d->getChannel(instruction.channel)->getMax();
+		else continue;
+		if (instruction.op != OP_CHANNEL)
+			instruction.op = OP_CONSTANT;
+	}
+
+	int dimX = geometry->getDimX();
+	int dimY = geometry->getDimY();
+	int blocksPerRow = (dimX + EXPR_BLOCK - 1) / EXPR_BLOCK;
+	int numBlocks = blocksPerRow * dimY;
+	int numInstructions = (int)code.size();
+	const Instruction* instructions = &code[0];
+	float* result = out->beginUpdate();
+
+	#pragma omp parallel for schedule(dynamic, 16)
+	for (int b = 0; b < numBlocks; b++)
+	{
+		int y = b / blocksPerRow;
+		int x0 = (b % blocksPerRow) * EXPR_BLOCK;
+		int n = (dimX - x0 < EXPR_BLOCK) ? dimX - x0 : EXPR_BLOCK;
+		int vtx[EXPR_BLOCK];
+		for (int k = 0; k < n; k++)
+			vtx[k] = geometry->getVtx(x0 + k, y);
+
+		//every instruction runs over the whole block, the loops are simple enough for the compiler to vectorize
+		float stack[EXPR_MAX_DEPTH][EXPR_BLOCK];
+		int top = -1;
+		for (int i = 0; i < numInstructions; i++)
+		{
+			const Instruction& instruction = instructions[i];
+			float* a = stack[(top > 0) ? top - 1 : 0];
+			float* r = stack[(top >= 0) ? top : 0];
+			switch (instruction.op)
+			{
+				case OP_CHANNEL:
+				{
+					const float* src = values[instruction.channel];
+					float* dst = stack[++top];
+					for (int k = 0; k < n; k++)
+						dst[k] = src[vtx[k]];
+					break;
+				}
+				case OP_CONSTANT:
+				{
+					float* dst = stack[++top];
+					for (int k = 0; k < n; k++)
+						dst[k] = instruction.value;
+					break;
+				}
+				case OP_ADD: for (int k = 0; k < n; k++) a[k] += r[k]; top--; break;
+				case OP_SUB: for (int k = 0; k < n; k++) a[k] -= r[k]; top--; break;
+				case OP_MUL: for (int k = 0; k < n; k++) a[k] *= r[k]; top--; break;
+				case OP_DIV: for (int k = 0; k < n; k++) a[k] /= r[k]; top--; break;
+				case OP_POW: for (int k = 0; k < n; k++) a[k] = pow(a[k], r[k]); top--; break;
+				case OP_ATAN2: for (int k = 0; k < n; k++) a[k] = atan2(a[k], r[k]); top--; break;
+				case OP_MIN: for (int k = 0; k < n; k++) a[k] = (r[k] < a[k]) ? r[k] : a[k]; top--; break;
+				case OP_MAX: for (int k = 0; k < n; k++) a[k] = (r[k] > a[k]) ? r[k] : a[k]; top--; break;
+				case OP_NEG: for (int k = 0; k < n; k++) r[k] = -r[k]; break;
+				case OP_SQRT: for (int k = 0; k < n; k++) r[k] = sqrt(r[k]); break;
+				case OP_ABS: for (int k = 0; k < n; k++) r[k] = fabs(r[k]); break;
+				case OP_EXP: for (int k = 0; k < n; k++) r[k] = exp(r[k]); break;
+				case OP_LOG: for (int k = 0; k < n; k++) r[k] = log(r[k]); break;
+				case OP_SIN: for (int k = 0; k < n; k++) r[k] = sin(r[k]); break;
+				case OP_COS: for (int k = 0; k < n; k++) r[k] = cos(r[k]); break;
+				default: break;
+			}
+		}
+		for (int k = 0; k < n; k++)
+			result[vtx[k]] = stack[0][k];
+	}
+	out->endUpdate();
+}
+
+const std::string& FlowExpression::getKey()
+{
+	return key;
+}
+
+unsigned int FlowExpression::getHash()
+{
+	//FNV-1a
+	unsigned int hash = 2166136261u;
+	for (size_t k = 0; k < key.size(); k++)
+	{
+		hash ^= (unsigned char)key[k];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+const std::vector<int>& FlowExpression::getInputs()
+{
+	return inputs;
+}
@@ -0,0 +1,102 @@
+#ifndef FLOWEXPRESSION_H
+#define FLOWEXPRESSION_H
+
+#include <string>
+#include <vector>
+
+class FlowData;
+class FlowChannel;
+
+///vertices evaluated at once, all intermediate results of a block stay in the cache
+#define EXPR_BLOCK 256
+///maximum depth of the evaluation stack, i.e. of nested subexpressions
+#define EXPR_MAX_DEPTH 16
+
+///arithmetic expression over channels, compiled once and evaluated block by block
+/**
+* Grammar (whitespace is ignored):
+*   expression := term (('+' | '-') term)*
+*   term       := unary (('*' | '/') unary)*
+*   unary      := '-' unary | power
+*   power      := primary ('^' unary)?
+*   primary    := number | channel | function '(' arguments ')' | '(' expression ')'
+*   channel    := 'c' followed by the channel id, e.g. c0
+* Elementwise functions: sqrt, abs, exp, log, sin, cos, atan2(y,x), pow(a,b), min(a,b), max(a,b).
+* Reductions over a whole channel, which enter the expression as constants: mean(cN), std(cN), min(cN), max(cN).
+* The expression is compiled into postfix code, evaluate runs every instruction over EXPR_BLOCK vertices at a time,
+* so the interpreter overhead is paid once per block and the only full-size array is the result channel.
+*/
+class FlowExpression{
+	private:
+		///instructions of the postfix code
+		enum Opcode {
+			OP_CHANNEL, OP_CONSTANT,
+			OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW, OP_ATAN2, OP_MIN, OP_MAX,
+			OP_NEG, OP_SQRT, OP_ABS, OP_EXP, OP_LOG, OP_SIN, OP_COS,
+			OP_MEAN, OP_STD, OP_CHANNEL_MIN, OP_CHANNEL_MAX
+		};
+		///one instruction, channel is used by OP_CHANNEL and the reductions, value by OP_CONSTANT
+		struct Instruction{
+			Opcode op;
+			int channel;
+			float value;
+		};
+
+		///the compiled postfix code
+		std::vector<Instruction> program;
+		///ids of all channels read by the expression, each one once
+		std::vector<int> inputs;
+		///canonical text of the postfix code, equal for expressions differing only in whitespace or parentheses
+		std::string key;
+		///stack depth needed by the program
+		int depth;
+
+		///parser state: the text, the current position and the data set the channels are checked against
+		const char* text;
+		///see text
+		const char* cursor;
+		///see text
+		FlowData* data;
+		///current stack depth while compiling
+		int stackSize;
+
+		///skips whitespace
+		void skipSpaces();
+		///consumes c if it is the next character
+		bool accept(char c);
+		///appends an instruction and tracks the stack depth, pops operands and pushes one result
+		void emit(Opcode op, int operands, int channel = -1, float value = 0.0f);
+		///parsing functions of the grammar, return false on syntax errors
+		bool parseExpression();
+		///see parseExpression
+		bool parseTerm();
+		///see parseExpression
+		bool parseUnary();
+		///see parseExpression
+		bool parsePower();
+		///see parseExpression
+		bool parsePrimary();
+		///parses a channel reference (cN) and checks that the channel exists
+		bool parseChannel(int* id);
+		///prints a syntax error at the current position
+		bool error(const char* message);
+
+		///computes mean or standard deviation of a channel over its valid vertices (see FlowMask), taken from its statistics
+		static float reduce(FlowData* data, int channel, bool deviation);
+	public:
+		///creates an empty expression
+		FlowExpression();
+
+		///compiles the expression, checking that all channels exist in the data set. Prints the error and returns false on syntax errors.
+		bool compile(const std::string& expression, FlowData* d);
+		///evaluates the compiled expression for all vertices of the data set into out (in parallel), the reductions are computed first
+		void evaluate(FlowData* d, FlowChannel* out);
+
+		///returns the canonical text of the compiled code
+		const std::string& getKey();
+		///returns the hash of the canonical text
+		unsigned int getHash();
+		///returns the ids of all channels read by the expression
+		const std::vector<int>& getInputs();
+};
+#endif
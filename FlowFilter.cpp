@@ -0,0 +1,367 @@
+#include "FlowFilter.h"
+#include "FlowChannel.h"
+#include "FlowStatistics.h"
+#include "alignedMemory.h"
+#include <math.h>
+#include <algorithm>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FLOW_SSE
+#endif
+
+///rows of one tile of the column pass
+#define FILTER_TILE_ROWS 256
+
+float* FlowFilter::allocate(FlowArena* arena, size_t n)
+{
+	return arena ? arena->allocate<float>(n) : alignedAlloc<float>(n);
+}
+
+void FlowFilter::release(FlowArena* arena, float* p)
+{
+	if (arena)
+		arena->release(p);
+	else
+		alignedFree(p);
+}
+
+const float* FlowFilter::gather(FlowChannel* c, FlowGeometry* g, float* buffer)
+{
+	if (g->getVertexOrder() == ORDER_ROW_MAJOR)
+		return c->getValueArray();
+	const float* values = c->getValueArray();
+	int dimX = g->getDimX();
+	int dimY = g->getDimY();
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dimY; y++)
+		for (int x = 0; x < dimX; x++)
+			buffer[y*dimX + x] = values[g->getVtx(x,y)];
+	return buffer;
+}
+
+void FlowFilter::scatter(const float* src, FlowGeometry* g, FlowChannel* c)
+{
+	float* values = c->beginUpdate();
+	if (src != values)
+	{
+		int dimX = g->getDimX();
+		int dimY = g->getDimY();
+		#pragma omp parallel for schedule(static)
+		for (int y = 0; y < dimY; y++)
+			for (int x = 0; x < dimX; x++)
+				values[g->getVtx(x,y)] = src[y*dimX + x];
+	}
+	c->endUpdate();
+}
+
+void FlowFilter::convolveRows(const float* src, float* dst, int dimX, int dimY, const float* weights, int radius)
+{
+	#pragma omp parallel
+	{
+		//the row with radius repeated border vertices on both sides, so the kernel needs no bounds checks
+		float* padded = new float[dimX + 2*radius];
+		#pragma omp for schedule(static)
+		for (int y = 0; y < dimY; y++)
+		{
+			const float* row = src + (size_t)y*dimX;
+			float* out = dst + (size_t)y*dimX;
+			for (int k = 0; k < radius; k++)
+			{
+				padded[k] = row[0];
+				padded[radius + dimX + k] = row[dimX - 1];
+			}
+			std::copy(row, row + dimX, padded + radius);
+			const float* center = padded + radius;
+			int x = 0;
+#ifdef FLOW_SSE
+			__m128 w0 = _mm_set1_ps(weights[0]);
+			for (; x + 4 <= dimX; x += 4)
+			{
+				__m128 acc = _mm_mul_ps(w0, _mm_loadu_ps(center + x));
+				for (int k = 1; k <= radius; k++)
+				{
+					__m128 pair = _mm_add_ps(_mm_loadu_ps(center + x - k), _mm_loadu_ps(center + x + k));
+					acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[k]), pair));
+				}
+				_mm_storeu_ps(out + x, acc);
+			}
+#endif
+			for (; x < dimX; x++)
+			{
+				float acc = weights[0] * center[x];
+				for (int k = 1; k <= radius; k++)
+					acc += weights[k] * (center[x - k] + center[x + k]);
+				out[x] = acc;
+			}
+		}
+		delete[] padded;
+	}
+}
+
+void FlowFilter::convolveColumns(const float* src, float* dst, int dimX, int dimY, const float* weights, int radius)
+{
+	//tiles of FILTER_STRIP columns and FILTER_TILE_ROWS rows, the 2*radius+1 row segments a tile reads at a time stay in the cache
+	int strips = (dimX + FILTER_STRIP - 1) / FILTER_STRIP;
+	int blocks = (dimY + FILTER_TILE_ROWS - 1) / FILTER_TILE_ROWS;
+	#pragma omp parallel for schedule(dynamic)
+	for (int tile = 0; tile < strips*blocks; tile++)
+	{
+		int x0 = (tile % strips) * FILTER_STRIP;
+		int x1 = (x0 + FILTER_STRIP < dimX) ? x0 + FILTER_STRIP : dimX;
+		int y0 = (tile / strips) * FILTER_TILE_ROWS;
+		int y1 = (y0 + FILTER_TILE_ROWS < dimY) ? y0 + FILTER_TILE_ROWS : dimY;
+		for (int y = y0; y < y1; y++)
+		{
+			float* out = dst + (size_t)y*dimX;
+			const float* center = src + (size_t)y*dimX;
+			int x = x0;
+#ifdef FLOW_SSE
+			for (; x + 4 <= x1; x += 4)
+				_mm_storeu_ps(out + x, _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(center + x)));
+#endif
+			for (; x < x1; x++)
+				out[x] = weights[0] * center[x];
+			for (int k = 1; k <= radius; k++)
+			{
+				//the rows above and below, repeated at the border
+				const float* above = src + (size_t)((y - k > 0) ? y - k : 0)*dimX;
+				const float* below = src + (size_t)((y + k < dimY - 1) ? y + k : dimY - 1)*dimX;
+				x = x0;
+#ifdef FLOW_SSE
+				__m128 w = _mm_set1_ps(weights[k]);
+				for (; x + 4 <= x1; x += 4)
+				{
+					__m128 pair = _mm_add_ps(_mm_loadu_ps(above + x), _mm_loadu_ps(below + x));
+					_mm_storeu_ps(out + x, _mm_add_ps(_mm_loadu_ps(out + x), _mm_mul_ps(w, pair)));
+				}
+#endif
+				for (; x < x1; x++)
+					out[x] += weights[k] * (above[x] + below[x]);
+			}
+		}
+	}
+}
+
+bool FlowFilter::separable(FlowChannel* src, FlowGeometry* g, const float* weights, int radius, FlowChannel* dst, FlowArena* arena)
+{
+	int dimX = g->getDimX();
+	int dimY = g->getDimY();
+	bool rowMajor = (g->getVertexOrder() == ORDER_ROW_MAJOR);
+	float* buffer = rowMajor ? NULL : allocate(arena, (size_t)dimX*dimY);
+	float* rows = allocate(arena, (size_t)dimX*dimY);
+	//the row-major order takes the result directly, the others go through the gather buffer (which is no longer needed by then)
+	float* out = rowMajor ? dst->beginUpdate() : buffer;
+	if (!rows || !out || !src->getValueArray() || !dst->beginUpdate())
+	{
+		release(arena, rows);
+		release(arena, buffer);
+		return false;
+	}
+
+	const float* in = gather(src, g, buffer);
+	convolveRows(in, rows, dimX, dimY, weights, radius);
+	convolveColumns(rows, out, dimX, dimY, weights, radius);
+	scatter(out, g, dst);
+
+	release(arena, rows);
+	release(arena, buffer);
+	return true;
+}
+
+bool FlowFilter::gaussian(FlowChannel* src, FlowGeometry* g, float sigma, FlowChannel* dst, FlowArena* arena)
+{
+	int radius = (int)ceil(3.0f * sigma);
+	radius = (radius < 1) ? 1 : radius;
+	float* weights = new float[radius + 1];
+	float sum = 0.0f;
+	for (int k = 0; k <= radius; k++)
+	{
+		weights[k] = (sigma > 0.0f) ? (float)exp(-0.5 * k*k / (sigma*sigma)) : ((k == 0) ? 1.0f : 0.0f);
+		sum += (k == 0) ? weights[k] : 2.0f*weights[k];
+	}
+	for (int k = 0; k <= radius; k++)
+		weights[k] /= sum;
+	bool ok = separable(src, g, weights, radius, dst, arena);
+	delete[] weights;
+	return ok;
+}
+
+bool FlowFilter::box(FlowChannel* src, FlowGeometry* g, int radius, FlowChannel* dst, FlowArena* arena)
+{
+	int dimX = g->getDimX();
+	int dimY = g->getDimY();
+	bool rowMajor = (g->getVertexOrder() == ORDER_ROW_MAJOR);
+	float* buffer = rowMajor ? NULL : allocate(arena, (size_t)dimX*dimY);
+	float* rows = allocate(arena, (size_t)dimX*dimY);
+	float* out = rowMajor ? dst->beginUpdate() : buffer;
+	if (!rows || !out || !src->getValueArray() || !dst->beginUpdate())
+	{
+		release(arena, rows);
+		release(arena, buffer);
+		return false;
+	}
+	const float* in = gather(src, g, buffer);
+	//the repeated border vertices count as well, so every window has the same size
+	double scale = 1.0 / (2*radius + 1);
+
+	//running sums along the rows, in double so that they do not drift
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dimY; y++)
+	{
+		const float* row = in + (size_t)y*dimX;
+		float* out = rows + (size_t)y*dimX;
+		double sum = 0.0;
+		for (int k = -radius; k <= radius; k++)
+			sum += row[(k < 0) ? 0 : ((k > dimX - 1) ? dimX - 1 : k)];
+		out[0] = (float)(sum * scale);
+		for (int x = 1; x < dimX; x++)
+		{
+			int enter = (x + radius < dimX - 1) ? x + radius : dimX - 1;
+			int leave = (x - radius - 1 > 0) ? x - radius - 1 : 0;
+			sum += row[enter] - row[leave];
+			out[x] = (float)(sum * scale);
+		}
+	}
+
+	//and down the columns, a strip of running sums slides over the rows
+	int strips = (dimX + FILTER_STRIP - 1) / FILTER_STRIP;
+	#pragma omp parallel
+	{
+		double* sums = new double[FILTER_STRIP];
+		#pragma omp for schedule(dynamic)
+		for (int strip = 0; strip < strips; strip++)
+		{
+			int x0 = strip * FILTER_STRIP;
+			int width = (x0 + FILTER_STRIP < dimX) ? FILTER_STRIP : dimX - x0;
+			for (int x = 0; x < width; x++)
+				sums[x] = 0.0;
+			for (int k = -radius; k <= radius; k++)
+			{
+				const float* row = rows + (size_t)((k < 0) ? 0 : ((k > dimY - 1) ? dimY - 1 : k))*dimX + x0;
+				for (int x = 0; x < width; x++)
+					sums[x] += row[x];
+			}
+			for (int y = 0; y < dimY; y++)
+			{
+				if (y > 0)
+				{
+					const float* enter = rows + (size_t)((y + radius < dimY - 1) ? y + radius : dimY - 1)*dimX + x0;
+					const float* leave = rows + (size_t)((y - radius - 1 > 0) ? y - radius - 1 : 0)*dimX + x0;
+					for (int x = 0; x < width; x++)
+						sums[x] += (double)enter[x] - (double)leave[x];
+				}
+				float* dstRow = out + (size_t)y*dimX + x0;
+				for (int x = 0; x < width; x++)
+					dstRow[x] = (float)(sums[x] * scale);
+			}
+		}
+		delete[] sums;
+	}
+	scatter(out, g, dst);
+
+	release(arena, rows);
+	release(arena, buffer);
+	return true;
+}
+
+bool FlowFilter::median(FlowChannel* src, FlowGeometry* g, int radius, FlowChannel* dst, FlowArena* arena)
+{
+	int dimX = g->getDimX();
+	int dimY = g->getDimY();
+	bool rowMajor = (g->getVertexOrder() == ORDER_ROW_MAJOR);
+	float* buffer = rowMajor ? NULL : allocate(arena, (size_t)dimX*dimY);
+	float* result = allocate(arena, (size_t)dimX*dimY);
+	if (!result || (!rowMajor && !buffer) || !src->getValueArray() || !dst->beginUpdate())
+	{
+		release(arena, result);
+		release(arena, buffer);
+		return false;
+	}
+	const float* in = gather(src, g, buffer);
+	int size = (2*radius + 1)*(2*radius + 1);
+
+	#pragma omp parallel
+	{
+		float* window = new float[size];
+		#pragma omp for schedule(static)
+		for (int y = 0; y < dimY; y++)
+			for (int x = 0; x < dimX; x++)
+			{
+				int n = 0;
+				for (int j = y - radius; j <= y + radius; j++)
+				{
+					const float* row = in + (size_t)((j < 0) ? 0 : ((j > dimY - 1) ? dimY - 1 : j))*dimX;
+					for (int i = x - radius; i <= x + radius; i++)
+						window[n++] = row[(i < 0) ? 0 : ((i > dimX - 1) ? dimX - 1 : i)];
+				}
+				std::nth_element(window, window + size/2, window + size);
+				result[(size_t)y*dimX + x] = window[size/2];
+			}
+		delete[] window;
+	}
+	scatter(result, g, dst);
+
+	release(arena, result);
+	release(arena, buffer);
+	return true;
+}
+
+bool FlowFilter::bilateral(FlowChannel* src, FlowGeometry* g, float sigmaSpace, float sigmaRange, FlowChannel* dst, FlowArena* arena)
+{
+	int dimX = g->getDimX();
+	int dimY = g->getDimY();
+	bool rowMajor = (g->getVertexOrder() == ORDER_ROW_MAJOR);
+	float* buffer = rowMajor ? NULL : allocate(arena, (size_t)dimX*dimY);
+	float* result = allocate(arena, (size_t)dimX*dimY);
+	if (!result || (!rowMajor && !buffer) || !src->getValueArray() || !dst->beginUpdate())
+	{
+		release(arena, result);
+		release(arena, buffer);
+		return false;
+	}
+	const float* in = gather(src, g, buffer);
+
+	int radius = (int)ceil(2.0f * sigmaSpace);
+	radius = (radius < 1) ? 1 : radius;
+	int width = 2*radius + 1;
+	//the spatial weights are the same for every vertex
+	float* spatial = new float[width*width];
+	for (int j = -radius; j <= radius; j++)
+		for (int i = -radius; i <= radius; i++)
+			spatial[(j + radius)*width + i + radius] = (sigmaSpace > 0.0f) ? (float)exp(-0.5 * (i*i + j*j) / (sigmaSpace*sigmaSpace)) : 1.0f;
+	//without a range the standard deviation of the channel is taken, so edges stronger than the typical variation are kept
+	if (sigmaRange <= 0.0f)
+		sigmaRange = (float)sqrt(src->getStatistics()->getVariance());
+	//a constant channel has no edges to keep, all range weights are 1
+	float rangeFactor = (sigmaRange > 0.0f) ? -0.5f / (sigmaRange*sigmaRange) : 0.0f;
+
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dimY; y++)
+		for (int x = 0; x < dimX; x++)
+		{
+			float center = in[(size_t)y*dimX + x];
+			float sum = 0.0f;
+			float weight = 0.0f;
+			for (int j = -radius; j <= radius; j++)
+			{
+				const float* row = in + (size_t)((y + j < 0) ? 0 : ((y + j > dimY - 1) ? dimY - 1 : y + j))*dimX;
+				const float* w = spatial + (j + radius)*width + radius;
+				for (int i = -radius; i <= radius; i++)
+				{
+					float value = row[(x + i < 0) ? 0 : ((x + i > dimX - 1) ? dimX - 1 : x + i)];
+					float d = value - center;
+					float k = w[i] * (float)exp(rangeFactor * d*d);
+					sum += k * value;
+					weight += k;
+				}
+			}
+			result[(size_t)y*dimX + x] = sum / weight;
+		}
+	scatter(result, g, dst);
+
+	delete[] spatial;
+	release(arena, result);
+	release(arena, buffer);
+	return true;
+}
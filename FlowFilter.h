@@ -0,0 +1,60 @@
+#ifndef FLOWFILTER_H
+#define FLOWFILTER_H
+
+#include <stddef.h>
+
+class FlowChannel;
+class FlowGeometry;
+class FlowArena;
+
+///smoothing filters, see FlowFilter and FlowData::createChannelFiltered
+enum FilterType {
+	///Gaussian of the given standard deviation (in vertices), cut off at 3 standard deviations
+	FILTER_GAUSSIAN,
+	///mean over the (2*radius+1)^2 vertices around every vertex
+	FILTER_BOX,
+	///median of the (2*radius+1)^2 vertices around every vertex, removes single outliers without blurring edges
+	FILTER_MEDIAN,
+	///Gaussian in space weighted by a Gaussian of the value difference, smooths noise but keeps strong gradients
+	FILTER_BILATERAL
+};
+
+///width of the column strips of the separable filters in floats, the rows of a strip stay in the cache while the kernel slides over them
+#define FILTER_STRIP 256
+
+///filters channels in index space (the vertex indexes, not the physical positions of the curvilinear grid)
+/**
+* The separable filters (Gaussian, box) run a row pass and a column pass on row-major buffers. The row pass gives every thread whole rows,
+* the column pass works in strips of FILTER_STRIP columns that run down the rows, so both passes read memory contiguously and vectorize (four vertices at a time with SSE).
+* The box filter uses running sums, so its cost does not depend on the radius. Median and bilateral filters are not separable, they visit the whole window
+* of every vertex and are spread over the rows. The border is handled by repeating the outermost vertices.
+* The destination has to be a different channel than the source. It is written with beginUpdate/endUpdate, so its minimum, maximum and revision are up to date.
+* The scratch arrays are taken from the given arena (the heap without one). If they cannot be allocated, the filters return false and leave the destination untouched.
+*/
+class FlowFilter{
+	private:
+		///takes a scratch array of n floats from the arena, or from the heap if it is NULL. Returns NULL if the allocation fails.
+		static float* allocate(FlowArena* arena, size_t n);
+		///returns a scratch array taken by allocate, NULL is ignored
+		static void release(FlowArena* arena, float* p);
+		///copies the values of the channel into a row-major array (or returns the values themselves for the row-major order), buffer has to hold dimX*dimY floats
+		static const float* gather(FlowChannel* c, FlowGeometry* g, float* buffer);
+		///copies the row-major array into the channel, unless it already is the value storage of the channel
+		static void scatter(const float* src, FlowGeometry* g, FlowChannel* c);
+		///convolves every row of src with the symmetric kernel weights[0..radius] into dst
+		static void convolveRows(const float* src, float* dst, int dimX, int dimY, const float* weights, int radius);
+		///convolves every column of src with the symmetric kernel weights[0..radius] into dst
+		static void convolveColumns(const float* src, float* dst, int dimX, int dimY, const float* weights, int radius);
+		///runs the row and the column pass of a symmetric separable kernel
+		static bool separable(FlowChannel* src, FlowGeometry* g, const float* weights, int radius, FlowChannel* dst, FlowArena* arena);
+	public:
+		///smooths with a Gaussian of standard deviation sigma (in vertices)
+		static bool gaussian(FlowChannel* src, FlowGeometry* g, float sigma, FlowChannel* dst, FlowArena* arena = NULL);
+		///averages over the (2*radius+1)^2 window of every vertex
+		static bool box(FlowChannel* src, FlowGeometry* g, int radius, FlowChannel* dst, FlowArena* arena = NULL);
+		///takes the median of the (2*radius+1)^2 window of every vertex
+		static bool median(FlowChannel* src, FlowGeometry* g, int radius, FlowChannel* dst, FlowArena* arena = NULL);
+		///bilateral filter with the spatial standard deviation sigmaSpace (in vertices) and the standard deviation sigmaRange of the values, the standard deviation of the channel if sigmaRange <= 0
+		static bool bilateral(FlowChannel* src, FlowGeometry* g, float sigmaSpace, float sigmaRange, FlowChannel* dst, FlowArena* arena = NULL);
+};
+#endif
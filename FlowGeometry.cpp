@@ -1,11 +1,25 @@
 #include "FlowGeometry.h"
 #include "reverseBytes.h"
+#include "transpose.h"
+#include <math.h>
+#include <string.h>
 
 #include <QDebug>
 
-bool FlowGeometry::readFromFile(char* header, FILE* fp, bool bigEndian)
+///number of Newton iterations used to invert the bilinear mapping of a cell
+#define CELL_NEWTON_ITERATIONS 8
+///tolerance (in cell coordinates) for positions lying on the border of a cell
+#define CELL_EPSILON 1e-4f
+///maximum number of cells visited by the point location
+#define CELL_WALK_STEPS 256
+///maximum number of cells skipped in one step of the point location
+#define CELL_WALK_JUMP 8
+
+bool FlowGeometry::readFromFile(char* header, FILE* fp, bool bigEndian, VertexOrder vertexOrder)
 {
 	isFlipped = false;
+	//everything below works on the row-major layout of the file, the requested order is applied at the end
+	order = ORDER_ROW_MAJOR;
 	//determine the dimensions
     sscanf(header,"SN4DB %d %d %d",&dim[0],&dim[1],&dim[2]);
     std::cout << "Dimensions: " << dim[0] << " x " << dim[1] << " x " << dim[2] << std::endl;
@@ -15,19 +29,61 @@ bool FlowGeometry::readFromFile(char* header, FILE* fp, bool bigEndian)
         return false;
     }
 
-	geometryData = new vec3[dim[0]*dim[1]];
+	int n = dim[0]*dim[1];
+	//the file stores x, y, z for each vertex, read it in one go and split it into the x and y arrays afterwards
+	float* tmpArray = new float[n*3];
 	//read the data and check if everything went fine
-    int result = fread(geometryData,sizeof(vec3),dim[0]*dim[1],fp);
-	if (result != dim[0]*dim[1])
+    int result = fread(tmpArray,3*sizeof(float),n,fp);
+	if (result != n)
 	{
 		std::cerr << "+ Error reading grid file." << std::endl << std::endl;
+		delete[] tmpArray;
 		return false;
 	}
 
-	if (bigEndian)
-		for (int j = 0; j < getDimX()*getDimY(); j++)
-			for (int k = 0; k < 3; k++)
-				geometryData[j][k] = reverseBytes<float>(geometryData[j][k]);
+	//release the geometry of a previously loaded dataset
+	alignedFree(posX);
+	alignedFree(posY);
+	posX = alignedAlloc<float>(n);
+	posY = alignedAlloc<float>(n);
+
+	//the z coordinate is always 0 for our 2D grids, so it is dropped here
+	#pragma omp parallel for schedule(static)
+	for (int j = 0; j < n; j++)
+	{
+		posX[j] = (bigEndian) ? reverseBytes<float>(tmpArray[j*3]) : tmpArray[j*3];
+		posY[j] = (bigEndian) ? reverseBytes<float>(tmpArray[j*3+1]) : tmpArray[j*3+1];
+	}
+	delete[] tmpArray;
+
+	setup(vertexOrder);
+	return true;
+}
+
+void FlowGeometry::setFromArrays(int dimX, int dimY, const float* x, const float* y, VertexOrder vertexOrder)
+{
+	order = ORDER_ROW_MAJOR;
+	dim[0] = dimX;
+	dim[1] = dimY;
+	dim[2] = 1;
+	int n = dim[0]*dim[1];
+
+	alignedFree(posX);
+	alignedFree(posY);
+	posX = alignedAlloc<float>(n);
+	posY = alignedAlloc<float>(n);
+	memcpy(posX, x, n*sizeof(float));
+	memcpy(posY, y, n*sizeof(float));
+
+	setup(vertexOrder);
+}
+
+void FlowGeometry::setup(VertexOrder vertexOrder)
+{
+	int n = dim[0]*dim[1];
+	//the coarser levels and the mask of the previous vertices are outdated
+	releaseLevels();
+	setMask(NULL);
 
     //first vertex
 	boundaryMin = vec3(getPos(0));
@@ -38,8 +94,19 @@ bool FlowGeometry::readFromFile(char* header, FILE* fp, bool bigEndian)
     //if X and Y are swapped... meaning that going in a row the y value increases and x stays the same
     if (getPosY(dim[0]-1)>(boundaryMin[1] + boundaryMax[1])*0.5)
     {
-		//this flag will fix that, anywhere where it's neccerasy... watch it :)
+		//transpose the grid once, so that everything downstream can assume X running fastest
+		//the first and the last vertex stay in place, so the boundaries computed above are still valid
         isFlipped = true;
+		float* transposedX = alignedAlloc<float>(n);
+		float* transposedY = alignedAlloc<float>(n);
+		//the file holds dim[1] rows of dim[0] vertices each
+		transposeBlocked<float>(posX, transposedX, dim[1], dim[0]);
+		transposeBlocked<float>(posY, transposedY, dim[1], dim[0]);
+		alignedFree(posX);
+		alignedFree(posY);
+		posX = transposedX;
+		posY = transposedY;
+		std::swap(dim[0], dim[1]);
         std::cout << "Flipped Y and X dimensions." << std::endl;
     }
     else isFlipped = false;  
@@ -53,33 +120,217 @@ bool FlowGeometry::readFromFile(char* header, FILE* fp, bool bigEndian)
 	qDebug() << "Y Boundaries - Min: " << boundaryMin[1];
 	qDebug() << "Y Boundaries - Max: " << boundaryMax[1];
 
-	for (int j = 0; j < getDimX()*getDimY(); j++) {
-		/*if (geometryData[j][0] < boundaryMin[0])
-			geometryData[j][0] = 0.0;
-		else if (geometryData[j][0] < boundaryMax[0])
-			geometryData[j][0] = 1.0;
-		else if (geometryData[j][1] < boundaryMin[1])
-			geometryData[j][1] = 0.0;
-		else if(geometryData[j][1] < boundaryMax[1])
-			geometryData[j][1] = 1.0;
-		else {*/
-			geometryData[j][0] = (geometryData[j][0] - boundaryMin[0]) / boundarySize[0];
-			geometryData[j][1] = (geometryData[j][1] - boundaryMin[1]) / boundarySize[1];
-		//}
+	//scale both axes to <0,1>, the separate arrays let the compiler vectorize this
+	float minX = boundaryMin[0], minY = boundaryMin[1];
+	float invSizeX = 1.0f / boundarySize[0], invSizeY = 1.0f / boundarySize[1];
+	#pragma omp parallel for schedule(static)
+	for (int j = 0; j < n; j++)
+	{
+		posX[j] = (posX[j] - minX) * invSizeX;
+		posY[j] = (posY[j] - minY) * invSizeY;
 	}
 
-	return true;
+	order = vertexOrder;
+	tilesX = (dim[0] + VERTEX_TILE_SIZE - 1) >> VERTEX_TILE_SHIFT;
+	computeVertexOffsets();
+	if (vertexOrder != ORDER_ROW_MAJOR)
+	{
+		//switch to the tiled layout, the padding vertices are placed far away so that no search ever picks them
+		float* orderedX = alignedAlloc<float>(getStorageSize());
+		float* orderedY = alignedAlloc<float>(getStorageSize());
+		for (int j = 0; j < getStorageSize(); j++)
+		{
+			orderedX[j] = (float)HUGE_VAL;
+			orderedY[j] = (float)HUGE_VAL;
+		}
+		#pragma omp parallel for schedule(static)
+		for (int y = 0; y < dim[1]; y++)
+			for (int x = 0; x < dim[0]; x++)
+			{
+				orderedX[getVtx(x,y)] = posX[(y*dim[0]) + x];
+				orderedY[getVtx(x,y)] = posY[(y*dim[0]) + x];
+			}
+		alignedFree(posX);
+		alignedFree(posY);
+		posX = orderedX;
+		posY = orderedY;
+		std::cout << "Vertex order: " << ((order == ORDER_TILED) ? "tiled" : "Morton") << std::endl;
+	}
+
+	computeJacobians();
+	computeInverseGrid();
+}
+
+void FlowGeometry::computeVertexOffsets()
+{
+	delete[] rowOffset;
+	delete[] columnOffset;
+	//one more entry repeating the last vertex, so that the cell 0 of a grid a single vertex wide has its upper corners
+	rowOffset = new int[dim[1] + 1];
+	columnOffset = new int[dim[0] + 1];
+	const int inTile = VERTEX_TILE_SIZE - 1;
+	//the tiled orders: first the tile, then the position inside of the tile, both split into their x and y parts
+	for (int x = 0; x < dim[0]; x++)
+	{
+		if (order == ORDER_ROW_MAJOR)
+			columnOffset[x] = x;
+		else
+			columnOffset[x] = ((x >> VERTEX_TILE_SHIFT) << (2*VERTEX_TILE_SHIFT)) + ((order == ORDER_TILED) ? (x & inTile) : spreadBits(x & inTile));
+	}
+	for (int y = 0; y < dim[1]; y++)
+	{
+		if (order == ORDER_ROW_MAJOR)
+			rowOffset[y] = y*dim[0];
+		else
+			rowOffset[y] = (((y >> VERTEX_TILE_SHIFT) * tilesX) << (2*VERTEX_TILE_SHIFT)) + ((order == ORDER_TILED) ? ((y & inTile) << VERTEX_TILE_SHIFT) : (spreadBits(y & inTile) << 1));
+	}
+	columnOffset[dim[0]] = columnOffset[dim[0] - 1];
+	rowOffset[dim[1]] = rowOffset[dim[1] - 1];
+}
+
+void FlowGeometry::buildInverseAxis(const float* pos, int n, float* inverse)
+{
+	//both the sample positions k/n and the vertex positions only grow, so one pointer into each is enough
+	int j = 0;
+	for (int k = 0; k < n; k++)
+	{
+		float target = float(k)/float(n);
+		//advance to the first vertex at or right of the target
+		while ((j < n-1) && (pos[j] < target))
+			j++;
+		float index;
+		if ((j == 0) || (pos[j] < target))
+			//left of the first or right of the last vertex, clamp
+			index = float(j);
+		else
+		{
+			float span = pos[j] - pos[j-1];
+			index = (span > 0.0f) ? (j-1) + (target - pos[j-1]) / span : float(j);
+		}
+		inverse[k] = index / float(n);
+	}
+}
+
+void FlowGeometry::computeInverseGrid()
+{
+	int n = (dim[0] > dim[1]) ? dim[0] : dim[1];
+	float* line = new float[n];
+
+	//the first row, made non-decreasing by a running maximum if necessary
+	monotoneX = true;
+	for (int x = 0; x < dim[0]; x++)
+	{
+		line[x] = posX[getVtx(x,0)];
+		if ((x > 0) && (line[x] <= line[x-1]))
+		{
+			monotoneX = false;
+			line[x] = line[x-1];
+		}
+	}
+	delete[] inverseGridX;
+	inverseGridX = new float[dim[0]];
+	buildInverseAxis(line, dim[0], inverseGridX);
+
+	//the same for the first column
+	monotoneY = true;
+	for (int y = 0; y < dim[1]; y++)
+	{
+		line[y] = posY[getVtx(0,y)];
+		if ((y > 0) && (line[y] <= line[y-1]))
+		{
+			monotoneY = false;
+			line[y] = line[y-1];
+		}
+	}
+	delete[] inverseGridY;
+	inverseGridY = new float[dim[1]];
+	buildInverseAxis(line, dim[1], inverseGridY);
+	delete[] line;
+
+	//the tables are exact only if every row and column repeats the first one
+	const float eps = 1e-5f;
+	rectilinear = true;
+	for (int y = 0; (y < dim[1]) && rectilinear; y++)
+		for (int x = 0; x < dim[0]; x++)
+			if ((fabs(posX[getVtx(x,y)] - posX[getVtx(x,0)]) > eps) || (fabs(posY[getVtx(x,y)] - posY[getVtx(0,y)]) > eps))
+			{
+				rectilinear = false;
+				break;
+			}
+
+	if (!monotoneX || !monotoneY)
+		std::cout << "Grid axes are not monotone, the inverse grid is approximate." << std::endl;
+	if (!rectilinear)
+		std::cout << "Curvilinear grid, the inverse grid is approximate." << std::endl;
+}
+
+void FlowGeometry::computeJacobians()
+{
+	alignedFree(dXdI);
+	alignedFree(dXdJ);
+	alignedFree(dYdI);
+	alignedFree(dYdJ);
+	dXdI = alignedAlloc<float>(getStorageSize());
+	dXdJ = alignedAlloc<float>(getStorageSize());
+	dYdI = alignedAlloc<float>(getStorageSize());
+	dYdJ = alignedAlloc<float>(getStorageSize());
+
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dim[1]; y++)
+	{
+		//central differences inside, one-sided ones at the border (the distance h is then 1 instead of 2)
+		int yPrev = (y > 0) ? y-1 : y;
+		int yNext = (y+1 < dim[1]) ? y+1 : y;
+		float hy = (yNext - yPrev > 0) ? 1.0f / (yNext - yPrev) : 0.0f;
+		for (int x = 0; x < dim[0]; x++)
+		{
+			int xPrev = (x > 0) ? x-1 : x;
+			int xNext = (x+1 < dim[0]) ? x+1 : x;
+			float hx = (xNext - xPrev > 0) ? 1.0f / (xNext - xPrev) : 0.0f;
+			int v = getVtx(x,y);
+			dXdI[v] = (posX[getVtx(xNext,y)] - posX[getVtx(xPrev,y)]) * hx;
+			dYdI[v] = (posY[getVtx(xNext,y)] - posY[getVtx(xPrev,y)]) * hx;
+			dXdJ[v] = (posX[getVtx(x,yNext)] - posX[getVtx(x,yPrev)]) * hy;
+			dYdJ[v] = (posY[getVtx(x,yNext)] - posY[getVtx(x,yPrev)]) * hy;
+		}
+	}
 }
 
 FlowGeometry::FlowGeometry()
 {
-    geometryData = NULL;
+    order = ORDER_ROW_MAJOR;
+    tilesX = 0;
+    rowOffset = NULL;
+    columnOffset = NULL;
+    posX = NULL;
+    posY = NULL;
+    dXdI = NULL;
+    dXdJ = NULL;
+    dYdI = NULL;
+    dYdJ = NULL;
+    inverseGridX = NULL;
+    inverseGridY = NULL;
+    monotoneX = true;
+    monotoneY = true;
+    rectilinear = true;
+    mask = NULL;
+    maskRevision = 0;
 }
 
 FlowGeometry::~FlowGeometry()
 {
-    if (geometryData)
-        delete[] geometryData;
+    alignedFree(posX);
+    alignedFree(posY);
+    alignedFree(dXdI);
+    alignedFree(dXdJ);
+    alignedFree(dYdI);
+    alignedFree(dYdJ);
+    delete[] inverseGridX;
+    delete[] inverseGridY;
+    delete[] rowOffset;
+    delete[] columnOffset;
+    releaseLevels();
+    delete mask;
 }
 
 ///returns X index of the last vertex lying left to the position x and the Y index of the last vertex lying under the position y 
@@ -96,34 +347,22 @@ int FlowGeometry::getXYvtx(vec3 pos)
 	return getVtx((i<dim[0]) ? i : dim[0]-1, (j<dim[1]) ? j : dim[1]-1);
 }
 
-inline vec3 FlowGeometry::getPos(int vtxID)
-{
-	return geometryData[vtxID];
-}
-
-inline float FlowGeometry::getPosX(int vtxID)
-{
-	return geometryData[vtxID][0];
-}
-
-inline float FlowGeometry::getPosY(int vtxID)
-{
-	return geometryData[vtxID][1];
-}
-
 //TODO students: improve this
 ///a very slow and dumb routine, that finds the nearest vertex to the given position
 int FlowGeometry::getNearestVtx(vec3 pos)
 {
+	float px = pos[0];
+	float py = pos[1];
 	//take the norm to the first vertex
-	float dist = pos.dist2(getPos(0));
+	float dist = (posX[0]-px)*(posX[0]-px) + (posY[0]-py)*(posY[0]-py);
 	//mark the vertex 0 as the closest one
 	int closest = 0;
 	float newd;
-	//Iterate through all vertices and search for the nearest one. I know, this is so inefficient, that you'll have to rewrite it :P
-	for (int i = 1; i < dim[0]*dim[1]; i++)
+	//Iterate through all vertices and search for the nearest one. Still a full scan, but it only streams the x and y arrays.
+	//The padding of the tiled orders lies at infinity, so it is never picked.
+	for (int i = 1; i < getStorageSize(); i++)
 	{
-		newd = pos.dist2(getPos(i));
+		newd = (posX[i]-px)*(posX[i]-px) + (posY[i]-py)*(posY[i]-py);
 		if (newd < dist)
 		{
 			dist = newd;
@@ -133,76 +372,191 @@ int FlowGeometry::getNearestVtx(vec3 pos)
 	return closest;
 }
 
-bool FlowGeometry::getInterpolationAt(vec3 pos, int* vtxID, float* coef)
+const float* FlowGeometry::getPosXArray()
 {
-    //if we are outside of the dataset, return false
-	//please note, that this test is valid only for rectangular datasets (block, hurricane), but not for tube
-    if ((pos[0]<boundaryMin[0])||(pos[1]<boundaryMin[1])||(pos[0]>boundaryMax[0])||(pos[1]>boundaryMax[1]))
-        return false;
+	return posX;
+}
 
-	//example of a low-quality lookup with no interpolation
-	vtxID[0] = getNearestVtx(pos); //finds the nearest vertex to the given position and returns it's value as the dominanting one. The getNearestVtx needs to be improved to gain some speed.
-    vtxID[1] = 0;
-    vtxID[2] = 0;
-    vtxID[3] = 0;        
-    coef[0] = 1.0f;
-    coef[1] = 0.0f;
-    coef[2] = 0.0f;
-    coef[3] = 0.0f;
-    return true;
+const float* FlowGeometry::getPosYArray()
+{
+	return posY;
 }
 
-float FlowGeometry::getMinX()
+vec3 FlowGeometry::getPosAtIndex(float i, float j)
 {
-    return boundaryMin[0];
+	//lower left vertex of the cell, clamped so that the upper right one exists as well
+	int x0 = (int)i;
+	int y0 = (int)j;
+	x0 = (x0 < 0) ? 0 : ((x0 > dim[0]-2) ? dim[0]-2 : x0);
+	y0 = (y0 < 0) ? 0 : ((y0 > dim[1]-2) ? dim[1]-2 : y0);
+	float s = i - x0;
+	float t = j - y0;
+	int v00 = getVtx(x0,y0), v10 = getVtx(x0+1,y0), v01 = getVtx(x0,y0+1), v11 = getVtx(x0+1,y0+1);
+	return vec3((1-t)*((1-s)*posX[v00] + s*posX[v10]) + t*((1-s)*posX[v01] + s*posX[v11]),
+				(1-t)*((1-s)*posY[v00] + s*posY[v10]) + t*((1-s)*posY[v01] + s*posY[v11]));
 }
 
-float FlowGeometry::getMaxX()
+bool FlowGeometry::invertBilinear(const float* p00, const float* p10, const float* p01, const float* p11, float px, float py, float* s, float* t)
 {
-    return boundaryMax[0];
+	//p(s,t) = p00 + s*e + t*f + s*t*g
+	float e[2] = {p10[0] - p00[0], p10[1] - p00[1]};
+	float f[2] = {p01[0] - p00[0], p01[1] - p00[1]};
+	float g[2] = {p00[0] - p10[0] - p01[0] + p11[0], p00[1] - p10[1] - p01[1] + p11[1]};
+
+	//Newton iterations from the cell center, the mapping is close to affine for reasonable grids
+	float cs = 0.5f;
+	float ct = 0.5f;
+	for (int k = 0; k < CELL_NEWTON_ITERATIONS; k++)
+	{
+		float rx = p00[0] + cs*e[0] + ct*f[0] + cs*ct*g[0] - px;
+		float ry = p00[1] + cs*e[1] + ct*f[1] + cs*ct*g[1] - py;
+		float a = e[0] + ct*g[0];
+		float b = f[0] + cs*g[0];
+		float c = e[1] + ct*g[1];
+		float d = f[1] + cs*g[1];
+		float det = a*d - b*c;
+		if (fabs(det) < 1e-20f)
+			return false;
+		cs -= (d*rx - b*ry) / det;
+		ct -= (a*ry - c*rx) / det;
+	}
+	*s = cs;
+	*t = ct;
+	return true;
 }
 
-float FlowGeometry::getMinY()
+bool FlowGeometry::locateCell(float x, float y, int* cellX, int* cellY, float* s, float* t)
 {
-    return boundaryMin[1];
+	if ((dim[0] < 2) || (dim[1] < 2))
+		return false;
+
+	//first guess from the inverse grid tables
+	int kx = (int)(x * dim[0]);
+	int ky = (int)(y * dim[1]);
+	kx = (kx < 0) ? 0 : ((kx > dim[0]-1) ? dim[0]-1 : kx);
+	ky = (ky < 0) ? 0 : ((ky > dim[1]-1) ? dim[1]-1 : ky);
+	int cx = (int)(inverseGridX[kx] * dim[0]);
+	int cy = (int)(inverseGridY[ky] * dim[1]);
+
+	//upper bound first, grids of a single vertex in a direction have a cell 0 as well
+	cx = (cx > dim[0]-2) ? dim[0]-2 : cx;
+	cy = (cy > dim[1]-2) ? dim[1]-2 : cy;
+	cx = (cx < 0) ? 0 : cx;
+	cy = (cy < 0) ? 0 : cy;
+
+	//walk towards the cell the bilinear coordinates point to
+	for (int step = 0; step < CELL_WALK_STEPS; step++)
+	{
+		int v[4] = {getVtx(cx,cy), getVtx(cx+1,cy), getVtx(cx,cy+1), getVtx(cx+1,cy+1)};
+		float p[4][2];
+		for (int c = 0; c < 4; c++)
+		{
+			p[c][0] = posX[v[c]];
+			p[c][1] = posY[v[c]];
+		}
+		float cs, ct;
+		if (!invertBilinear(p[0], p[1], p[2], p[3], x, y, &cs, &ct))
+			return false;
+		if ((cs >= -CELL_EPSILON) && (ct >= -CELL_EPSILON) && (cs <= 1.0f + CELL_EPSILON) && (ct <= 1.0f + CELL_EPSILON))
+		{
+			*cellX = cx;
+			*cellY = cy;
+			*s = (cs < 0.0f) ? 0.0f : ((cs > 1.0f) ? 1.0f : cs);
+			*t = (ct < 0.0f) ? 0.0f : ((ct > 1.0f) ? 1.0f : ct);
+			return true;
+		}
+		//the step is limited, the bilinear coordinates are unreliable far outside of the cell
+		int dx = (int)floor(cs);
+		int dy = (int)floor(ct);
+		dx = (dx < -CELL_WALK_JUMP) ? -CELL_WALK_JUMP : ((dx > CELL_WALK_JUMP) ? CELL_WALK_JUMP : dx);
+		dy = (dy < -CELL_WALK_JUMP) ? -CELL_WALK_JUMP : ((dy > CELL_WALK_JUMP) ? CELL_WALK_JUMP : dy);
+		int nx = cx + dx;
+		int ny = cy + dy;
+		nx = (nx > dim[0]-2) ? dim[0]-2 : nx;
+		ny = (ny > dim[1]-2) ? dim[1]-2 : ny;
+		nx = (nx < 0) ? 0 : nx;
+		ny = (ny < 0) ? 0 : ny;
+		//a border cell pointing out of the grid, the position lies outside
+		if ((nx == cx) && (ny == cy))
+			return false;
+		cx = nx;
+		cy = ny;
+	}
+	return false;
 }
 
-float FlowGeometry::getMaxY()
+void FlowGeometry::getJacobian(int vtxID, float* J)
 {
-    return boundaryMax[1];
+	//the stored Jacobians refer to the normalized coordinates
+	J[0] = dXdI[vtxID] * boundarySize[0];
+	J[1] = dXdJ[vtxID] * boundarySize[0];
+	J[2] = dYdI[vtxID] * boundarySize[1];
+	J[3] = dYdJ[vtxID] * boundarySize[1];
+}
+
+void FlowGeometry::getPos(const int* vtxIDs, int count, float* x, float* y)
+{
+	for (int i = 0; i < count; i++)
+	{
+		x[i] = posX[vtxIDs[i]];
+		y[i] = posY[vtxIDs[i]];
+	}
 }
 
-inline int FlowGeometry::getDimX()
+void FlowGeometry::getInterleaved(float* dst, int components)
 {
-	return (isFlipped) ? dim[1] : dim[0];
+	//the output is always row-major, whatever the vertex order is
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dim[1]; y++)
+		for (int x = 0; x < dim[0]; x++)
+		{
+			int i = (y*dim[0]) + x;
+			dst[i*components] = posX[getVtx(x,y)];
+			dst[i*components+1] = posY[getVtx(x,y)];
+			for (int k = 2; k < components; k++)
+				dst[i*components+k] = 0.0f;
+		}
 }
 
-inline int FlowGeometry::getDimY()
+bool FlowGeometry::getInterpolationAt(vec3 pos, int* vtxID, float* coef)
 {
-	return (isFlipped) ? dim[0] : dim[1];
+	//the cells are located in normalized coordinates, positions outside of the grid fail there
+	vec3 n = normalizeCoords(pos);
+	int cx, cy;
+	float s, t;
+	if (!locateCell(n[0], n[1], &cx, &cy, &s, &t))
+		return false;
+
+	//bilinear weights of the cell vertices
+	vtxID[0] = getVtx(cx, cy);
+	vtxID[1] = getVtx(cx+1, cy);
+	vtxID[2] = getVtx(cx, cy+1);
+	vtxID[3] = getVtx(cx+1, cy+1);
+	coef[0] = (1-s)*(1-t);
+	coef[1] = s*(1-t);
+	coef[2] = (1-s)*t;
+	coef[3] = s*t;
+	return true;
 }
 
-inline int FlowGeometry::getDimZ()
+float FlowGeometry::getMinX()
 {
-    return dim[2];
+    return boundaryMin[0];
 }
 
-int FlowGeometry::getVtx(int x, int y)
+float FlowGeometry::getMaxX()
 {
-	//if we need to flip the rows and columns, we do it here 
-	return (isFlipped)? (x*dim[1]) + y : (y*dim[0]) + x;
+    return boundaryMax[0];
 }
 
-int FlowGeometry::getVtxX(int vtxID)
+float FlowGeometry::getMinY()
 {
-	//if we need to flip the rows and columns, we do it here
-	return (isFlipped)? vtxID / dim[1] : vtxID % dim[0];
+    return boundaryMin[1];
 }
 
-int FlowGeometry::getVtxY(int vtxID)
+float FlowGeometry::getMaxY()
 {
-	//if we need to flip the rows and columns, we do it here
-	return (isFlipped)? vtxID % dim[1] : vtxID / dim[0];
+    return boundaryMax[1];
 }
 
 int FlowGeometry::getRightNeigh(int vtxID)
@@ -254,4 +608,155 @@ vec3 FlowGeometry::unNormalizeCoords(vec3 pos)
 
 bool FlowGeometry::getFlipped(void) {
 	return isFlipped;
-}
\ No newline at end of file
+}
+
+const float* FlowGeometry::getInverseGridX()
+{
+	return inverseGridX;
+}
+
+const float* FlowGeometry::getInverseGridY()
+{
+	return inverseGridY;
+}
+
+bool FlowGeometry::isMonotoneX()
+{
+	return monotoneX;
+}
+
+bool FlowGeometry::isMonotoneY()
+{
+	return monotoneY;
+}
+
+bool FlowGeometry::isRectilinear()
+{
+	return rectilinear;
+}
+
+void FlowGeometry::releaseLevels()
+{
+	for (size_t l = 0; l < levels.size(); l++)
+		delete levels[l];
+	levels.clear();
+}
+
+int FlowGeometry::getNumLevels()
+{
+	int n = 1;
+	int x = dim[0];
+	int y = dim[1];
+	while (getCoarserDim(x) < x || getCoarserDim(y) < y)
+	{
+		x = getCoarserDim(x);
+		y = getCoarserDim(y);
+		n++;
+	}
+	return n;
+}
+
+size_t FlowGeometry::getMemory()
+{
+	size_t arrays = (posX ? 2 : 0) + (dXdI ? 4 : 0);
+	size_t bytes = arrays * getStorageSize() * sizeof(float);
+	if (inverseGridX)
+		bytes += (dim[0] + dim[1]) * sizeof(float);
+	if (rowOffset)
+		bytes += (dim[0] + dim[1] + 2) * sizeof(int);
+	if (mask)
+		bytes += mask->getMemory();
+	for (size_t l = 0; l < levels.size(); l++)
+		bytes += levels[l]->getMemory();
+	return bytes;
+}
+
+FlowGeometry* FlowGeometry::getLevel(int level)
+{
+	if (level <= 0)
+		return this;
+	while ((int)levels.size() < level)
+	{
+		FlowGeometry* finer = levels.empty() ? this : levels.back();
+		int fineX = finer->getDimX();
+		int fineY = finer->getDimY();
+		int coarseX = getCoarserDim(fineX);
+		int coarseY = getCoarserDim(fineY);
+		if (coarseX == fineX && coarseY == fineY)
+			break;
+		//the vertices are taken over, not averaged, so the boundary of the grid stays where it is.
+		//They are passed in real coordinates, setup normalizes them with the same first and last vertex again.
+		float* x = new float[coarseX*coarseY];
+		float* y = new float[coarseX*coarseY];
+		#pragma omp parallel for schedule(static)
+		for (int j = 0; j < coarseY; j++)
+			for (int i = 0; i < coarseX; i++)
+			{
+				int vtxID = finer->getVtx(getFinerIndex(i, fineX), getFinerIndex(j, fineY));
+				x[j*coarseX + i] = finer->getPosX(vtxID) * boundarySize[0] + boundaryMin[0];
+				y[j*coarseX + i] = finer->getPosY(vtxID) * boundarySize[1] + boundaryMin[1];
+			}
+		FlowGeometry* coarser = new FlowGeometry();
+		coarser->setFromArrays(coarseX, coarseY, x, y, order);
+		coarser->isFlipped = isFlipped;
+		delete[] x;
+		delete[] y;
+		levels.push_back(coarser);
+	}
+	//levels beyond the coarsest one give the coarsest one
+	if (levels.empty())
+		return this;
+	return ((int)levels.size() < level) ? levels.back() : levels[level - 1];
+}
+
+int FlowGeometry::findLevel(int resX, int resY)
+{
+	int level = 0;
+	int x = dim[0];
+	int y = dim[1];
+	while ((getCoarserDim(x) < x || getCoarserDim(y) < y) && getCoarserDim(x) >= resX && getCoarserDim(y) >= resY)
+	{
+		x = getCoarserDim(x);
+		y = getCoarserDim(y);
+		level++;
+	}
+	return level;
+}
+
+VertexOrder FlowGeometry::getVertexOrder()
+{
+	return order;
+}
+
+void FlowGeometry::setMask(FlowMask* m)
+{
+	if (m == mask)
+		return;
+	delete mask;
+	mask = m;
+	maskRevision++;
+}
+
+FlowMask* FlowGeometry::getMask()
+{
+	return mask;
+}
+
+unsigned int FlowGeometry::getMaskRevision()
+{
+	return maskRevision;
+}
+
+int FlowGeometry::getNumValid()
+{
+	return mask ? mask->getNumValid() : dim[0]*dim[1];
+}
+
+int FlowGeometry::getValidRuns(int y, int* runs)
+{
+	if (mask)
+		return mask->getRuns(y, runs);
+	runs[0] = 0;
+	runs[1] = dim[0];
+	return 1;
+}
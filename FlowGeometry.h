@@ -3,35 +3,101 @@
 
 #include <stdio.h>
 #include <iostream>
+#include <vector>
 #include "vec3.h"
+#include "alignedMemory.h"
+#include "FlowMask.h"
+
+///log2 of the tile edge length used by the tiled vertex orders (16x16 vertices per tile)
+#define VERTEX_TILE_SHIFT 4
+///tile edge length used by the tiled vertex orders
+#define VERTEX_TILE_SIZE (1 << VERTEX_TILE_SHIFT)
+
+///order in which the vertices (and thus the values of all channels) are stored in memory
+enum VertexOrder {
+	///rows of vertices one after another, X running fastest (the order of the files)
+	ORDER_ROW_MAJOR,
+	///square tiles of VERTEX_TILE_SIZE vertices stored one after another, row-major inside of each tile
+	ORDER_TILED,
+	///square tiles of VERTEX_TILE_SIZE vertices stored one after another, Z-order (Morton) inside of each tile
+	ORDER_MORTON
+};
 
 ///class for handling the geometry == rectangular grids organized in vertices and cells
 class FlowGeometry{
 		friend class FlowData;
 	private:
-		///resolution of the data for the dimensions X, Y
-		int dim[2]; 
+		///resolution of the data for the dimensions X, Y, Z
+		int dim[3]; 
+		///order of the vertices in the storage
+		VertexOrder order;
+		///number of tiles in X dimension (only used by the tiled orders)
+		int tilesX;
+		///part of the vertex ID contributed by the Y index, one entry per row and the last one repeated (see getVtx)
+		int* rowOffset;
+		///part of the vertex ID contributed by the X index, one entry per column and the last one repeated (see getVtx)
+		int* columnOffset;
+		///fills rowOffset and columnOffset for the current dimensions and vertex order
+		void computeVertexOffsets();
 		///minimum boundary values for the dataset geometry sotred as {minX, minY)
 		vec3 boundaryMin;
 		///maximum boundary values for the dataset geometry sotred as (maxX, maxY)
 		vec3 boundaryMax;
 		///boundary sizes for the dataset geometry sotred as (maX - minX, maxY - minY)
 		vec3 boundarySize;
-/*	    
-		///Storage for the geometry
-		vec3* geometryData;
-*/
-		///returns general vtxID for the vertex array indexes
-		int getVtx(int x, int y);
-		///returns X index for the general vtxID
-		int getVtxX(int vtxID);
-		///returns Y index for the general vtxID
-		int getVtxY(int vtxID);
+		///Storage for the geometry, x coordinates of all vertices (in the vertex order, aligned to DATA_ALIGNMENT)
+		float* posX;
+		///Storage for the geometry, y coordinates of all vertices (in the vertex order, aligned to DATA_ALIGNMENT)
+		float* posY;
+
+		///Jacobian of the mapping from vertex indexes to (normalized) positions, derivative of x along the X index. One value per storage slot.
+		float* dXdI;
+		///Jacobian of the mapping from vertex indexes to (normalized) positions, derivative of x along the Y index
+		float* dXdJ;
+		///Jacobian of the mapping from vertex indexes to (normalized) positions, derivative of y along the X index
+		float* dYdI;
+		///Jacobian of the mapping from vertex indexes to (normalized) positions, derivative of y along the Y index
+		float* dYdJ;
+		///everything that follows reading the vertex positions (row-major in posX, posY): boundaries, transposition of flipped grids, normalization, vertex order, Jacobians and inverse grid
+		void setup(VertexOrder vertexOrder);
+
+		///computes the Jacobians at all vertices using central differences (one-sided ones at the boundary)
+		void computeJacobians();
+
+		///inverse mapping of the X axis, for dimX equidistant normalized positions the normalized fractional X index
+		float* inverseGridX;
+		///inverse mapping of the Y axis, for dimY equidistant normalized positions the normalized fractional Y index
+		float* inverseGridY;
+		///true if the x coordinates along the first row strictly increase
+		bool monotoneX;
+		///true if the y coordinates along the first column strictly increase
+		bool monotoneY;
+		///true if every row has the x coordinates of the first row and every column the y coordinates of the first column
+		bool rectilinear;
+		///computes the inverse grid tables and the monotonicity flags, linear in the number of vertices
+		void computeInverseGrid();
+		///builds one inverse table in a single merge-style pass over the (sorted) sample positions and vertex positions
+		static void buildInverseAxis(const float* pos, int n, float* inverse);
+
+		///spreads the lower 16 bits of v to the even bit positions
+		static inline int spreadBits(int v);
+		///inverse of spreadBits, gathers the even bit positions of v into the lower 16 bits
+		static inline int compactBits(int v);
 	    
 		///returns X index of the last vertex lying left to the position x and the Y index of the last vertex lying under the position y 
 		int getXYvtx(vec3 pos);
 
-		///indicates whether the x and y axes have to be swaped
+		///the coarser levels of the grid (level 1 first), built on demand by getLevel
+		std::vector<FlowGeometry*> levels;
+		///deletes the coarser levels, called whenever the vertices change
+		void releaseLevels();
+
+		///valid and invalid vertices (e.g. solid obstacles), NULL if all vertices are valid
+		FlowMask* mask;
+		///incremented whenever the mask changes, so that statistics can tell whether they are outdated
+		unsigned int maskRevision;
+
+		///indicates whether the x and y axes were swapped in the file. The data is transposed during loading, so the storage is always row-major with X running fastest.
 		bool isFlipped;
 
 		
@@ -50,16 +116,29 @@ class FlowGeometry{
 		*/
 		bool getInterpolationAt(vec3 pos, int* vtxID, float* coef);
 	        
-		///reads the geometry gris data from a file
-		bool readFromFile(char* header, FILE* fp, bool bigEndian);
+		///reads the geometry gris data from a file and stores it in the given vertex order
+		bool readFromFile(char* header, FILE* fp, bool bigEndian, VertexOrder vertexOrder = ORDER_ROW_MAJOR);
+		///sets up the geometry from row-major arrays of vertex positions (e.g. a slice of a 3D grid), processed the same way as readFromFile does with file data
+		void setFromArrays(int dimX, int dimY, const float* x, const float* y, VertexOrder vertexOrder = ORDER_ROW_MAJOR);
+
+		///returns general vtxID for the vertex array indexes. x == getDimX() and y == getDimY() give the last column and row, the upper corner of the cell 0 of a grid a single vertex wide.
+		inline int getVtx(int x, int y);
+		///returns X index for the general vtxID
+		inline int getVtxX(int vtxID);
+		///returns Y index for the general vtxID
+		inline int getVtxY(int vtxID);
+		///returns the order in which the vertices are stored
+		VertexOrder getVertexOrder();
+		///returns the number of storage slots needed for one value per vertex. The tiled orders pad the grid to whole tiles, so this can be larger than getDimX()*getDimY().
+		inline int getStorageSize();
 	    
 		//remember that our grids are curvilinear and only 2D
 		///returns the number of vertices in X dimension
-		int getDimX();
+		inline int getDimX();
 		///returns the number of vertices in Y dimension
-		int getDimY();
+		inline int getDimY();
 		///returns the number of vertices in Z dimension, is always 1
-		int getDimZ();
+		inline int getDimZ();
 	    
 		///returns the minimum in the X dimension
 		float getMinX();
@@ -84,10 +163,25 @@ class FlowGeometry{
 		///inverts the compression. From values of <0,1> it restores the real geometrical coordinates
 		vec3 unNormalizeCoords(vec3 pos);
 
+		///returns the number of vertices of the next coarser level for a dimension of n vertices (n/2 + 1, grids of 2 vertices are not reduced any more)
+		static inline int getCoarserDim(int n);
+		///returns the index of the vertex of the finer level (of n vertices) that vertex i of the next coarser level lies on
+		static inline int getFinerIndex(int i, int n);
+		///returns the number of levels of the grid, including the grid itself as level 0
+		int getNumLevels();
+		///returns the grid downsampled level times, building the missing levels. Level 0 is the geometry itself.
+		/**
+		* Every coarser level keeps every second vertex of the finer one (see getFinerIndex), including the last one, so all levels cover exactly the same domain
+		* and vertex (i,j) of level l lies on vertex (i*2^l, j*2^l) of the full grid (clamped to the last vertex). The levels use the same vertex order and
+		* are owned by this geometry, they stay valid until the vertices change.
+		*/
+		FlowGeometry* getLevel(int level);
+		///returns the bytes of the coordinates, the Jacobians, the inverse grid tables, the vertex offsets and all built coarser levels
+		size_t getMemory();
+		///returns the coarsest level having at least resX x resY vertices (or level 0 if the grid itself is smaller), e.g. the number of pixels the grid covers on screen
+		int findLevel(int resX, int resY);
 
-		///Storage for the geometry
-		vec3* geometryData;
-
+		///returns true if the file stored the axes swapped and the geometry (and channels) had to be transposed while loading
 		bool getFlipped(void);
 		
 		//TODO for students: improve this
@@ -95,12 +189,159 @@ class FlowGeometry{
 		int getNearestVtx(vec3 pos);
 
 		///returns the position of the vertex
-		vec3 getPos(int vtxID);
+		inline vec3 getPos(int vtxID);
 		///returns the x position of the vertex
-		float getPosX(int vtxID);
+		inline float getPosX(int vtxID);
 		///returns the y position of the vertex
-		float getPosY(int vtxID); 
+		inline float getPosY(int vtxID); 
+
+		///returns the x coordinates of all vertices as one contiguous aligned array (getDimX()*getDimY() floats)
+		const float* getPosXArray();
+		///returns the y coordinates of all vertices as one contiguous aligned array (getDimX()*getDimY() floats)
+		const float* getPosYArray();
+		///returns the position at fractional vertex indexes (i from 0 to dimX-1, j from 0 to dimY-1) by bilinear interpolation of the surrounding vertices. No point location is needed.
+		vec3 getPosAtIndex(float i, float j);
+		///stores the Jacobian of the grid mapping at the given vertex in J as {dx/di, dx/dj, dy/di, dy/dj}, in real (not normalized) coordinates
+		void getJacobian(int vtxID, float* J);
+		///returns the inverse mapping of the X axis (getDimX() entries)
+		/**
+		* Entry k holds the fractional X index (divided by getDimX()) at which the normalized x coordinate k/getDimX() is reached along the first row.
+		* The table is exact for rectilinear grids with monotone axes (see isRectilinear, isMonotoneX). For non-monotone rows it inverts the running maximum of the x coordinates,
+		* and for curvilinear grids it is only a first guess that has to be refined by a real point location.
+		*/
+		const float* getInverseGridX();
+		///returns the inverse mapping of the Y axis (getDimY() entries), see getInverseGridX
+		const float* getInverseGridY();
+		///returns true if the x coordinates strictly increase along the first row
+		bool isMonotoneX();
+		///returns true if the y coordinates strictly increase along the first column
+		bool isMonotoneY();
+		///returns true if the grid is rectilinear, i.e. x depends only on the X index and y only on the Y index, so that the inverse grid tables are exact
+		bool isRectilinear();
+
+		///replaces the mask of valid vertices (NULL for all valid), the geometry takes over the mask and deletes it when the vertices change
+		void setMask(FlowMask* m);
+		///returns the mask of valid vertices, NULL if all vertices are valid
+		FlowMask* getMask();
+		///returns the revision of the mask, which changes with every setMask
+		unsigned int getMaskRevision();
+		///returns the number of valid vertices
+		int getNumValid();
+		///stores the runs of valid vertices of row y as pairs runs[2k] <= x < runs[2k+1] and returns their number, a single run over the whole row without a mask. runs has to hold getDimX()+1 ints.
+		int getValidRuns(int y, int* runs);
+		///gathers the positions of count vertices given by vtxIDs into the arrays x and y
+		void getPos(const int* vtxIDs, int count, float* x, float* y);
+		///writes the positions of all vertices interleaved into dst, using components floats per vertex (the remaining components are set to 0). Meant for texture uploads.
+		void getInterleaved(float* dst, int components = 3);
+
+		///finds the cell containing the position (in normalized coordinates). Returns false if the position lies outside of the grid.
+		/**
+		* The inverse grid tables give the first guess, which is refined by walking from cell to cell along the bilinear cell coordinates.
+		* @param cellX receives the X index of the lower left vertex of the cell
+		* @param cellY receives the Y index of the lower left vertex of the cell
+		* @param s receives the bilinear coordinate inside of the cell along X <0..1>
+		* @param t receives the bilinear coordinate inside of the cell along Y <0..1>
+		*/
+		bool locateCell(float x, float y, int* cellX, int* cellY, float* s, float* t);
+		///inverts the bilinear mapping of a cell with the corners p00, p10, p01, p11 (x,y pairs) at (px,py) by Newton iterations. s and t are not clamped, they lie in <0..1> only if the point is inside of the cell. Returns false for degenerate cells.
+		static bool invertBilinear(const float* p00, const float* p10, const float* p01, const float* p11, float px, float py, float* s, float* t);
 
 };
 
+//the accessors below are called for every sample, so they live here to be inlined.
+//Flipped files are transposed while loading, so only the selected vertex order has to be handled.
+
+inline int FlowGeometry::getDimX()
+{
+	return dim[0];
+}
+
+inline int FlowGeometry::getDimY()
+{
+	return dim[1];
+}
+
+inline int FlowGeometry::getDimZ()
+{
+    return dim[2];
+}
+
+inline int FlowGeometry::getCoarserDim(int n)
+{
+	return (n > 2) ? n/2 + 1 : n;
+}
+
+inline int FlowGeometry::getFinerIndex(int i, int n)
+{
+	return (2*i < n - 1) ? 2*i : n - 1;
+}
+
+inline int FlowGeometry::spreadBits(int v)
+{
+	v = (v | (v << 8)) & 0x00FF00FF;
+	v = (v | (v << 4)) & 0x0F0F0F0F;
+	v = (v | (v << 2)) & 0x33333333;
+	return (v | (v << 1)) & 0x55555555;
+}
+
+inline int FlowGeometry::compactBits(int v)
+{
+	v &= 0x55555555;
+	v = (v | (v >> 1)) & 0x33333333;
+	v = (v | (v >> 2)) & 0x0F0F0F0F;
+	v = (v | (v >> 4)) & 0x00FF00FF;
+	return (v | (v >> 8)) & 0x0000FFFF;
+}
+
+inline int FlowGeometry::getVtx(int x, int y)
+{
+	//every vertex order is a sum of a part depending on y and a part depending on x, so the order is resolved once per grid instead of per access
+	return rowOffset[y] + columnOffset[x];
+}
+
+inline int FlowGeometry::getVtxX(int vtxID)
+{
+	if (order == ORDER_ROW_MAJOR)
+		return vtxID % dim[0];
+	int tileX = (vtxID >> (2*VERTEX_TILE_SHIFT)) % tilesX;
+	int in = vtxID & (VERTEX_TILE_SIZE*VERTEX_TILE_SIZE - 1);
+	if (order == ORDER_TILED)
+		return (tileX << VERTEX_TILE_SHIFT) + (in & (VERTEX_TILE_SIZE - 1));
+	return (tileX << VERTEX_TILE_SHIFT) + compactBits(in);
+}
+
+inline int FlowGeometry::getVtxY(int vtxID)
+{
+	if (order == ORDER_ROW_MAJOR)
+		return vtxID / dim[0];
+	int tileY = (vtxID >> (2*VERTEX_TILE_SHIFT)) / tilesX;
+	int in = vtxID & (VERTEX_TILE_SIZE*VERTEX_TILE_SIZE - 1);
+	if (order == ORDER_TILED)
+		return (tileY << VERTEX_TILE_SHIFT) + (in >> VERTEX_TILE_SHIFT);
+	return (tileY << VERTEX_TILE_SHIFT) + compactBits(in >> 1);
+}
+
+inline int FlowGeometry::getStorageSize()
+{
+	if (order == ORDER_ROW_MAJOR)
+		return dim[0]*dim[1];
+	int tilesY = (dim[1] + VERTEX_TILE_SIZE - 1) >> VERTEX_TILE_SHIFT;
+	return (tilesX * tilesY) << (2*VERTEX_TILE_SHIFT);
+}
+
+inline vec3 FlowGeometry::getPos(int vtxID)
+{
+	return vec3(posX[vtxID], posY[vtxID]);
+}
+
+inline float FlowGeometry::getPosX(int vtxID)
+{
+	return posX[vtxID];
+}
+
+inline float FlowGeometry::getPosY(int vtxID)
+{
+	return posY[vtxID];
+}
+
 #endif
@@ -0,0 +1,275 @@
+#include "FlowJointHistogram.h"
+#include "FlowData.h"
+#include <math.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FLOW_SSE
+#endif
+
+FlowJointHistogram::FlowJointHistogram(FlowData* d)
+{
+	data = d;
+	channels[0] = channels[1] = -1;
+	bins[0] = bins[1] = 0;
+	for (int k = 0; k < 4; k++)
+	{
+		range[k] = 0.0f;
+		region[k] = 0;
+	}
+	counts = NULL;
+	local = NULL;
+	numThreads = 1;
+#ifdef _OPENMP
+	numThreads = omp_get_max_threads();
+#endif
+	mask = NULL;
+	revisions[0] = revisions[1] = 0;
+	built = false;
+}
+
+FlowJointHistogram::~FlowJointHistogram()
+{
+	delete[] counts;
+	delete[] local;
+}
+
+void FlowJointHistogram::build(int chX, int chY, int binsX, int binsY, const float* valueRange, const unsigned char* vertexMask)
+{
+	if (binsX != bins[0] || binsY != bins[1] || !counts)
+	{
+		delete[] counts;
+		delete[] local;
+		bins[0] = binsX;
+		bins[1] = binsY;
+		counts = new int[binsX*binsY];
+		local = new int[numThreads*(binsX*binsY + 1)];
+	}
+	channels[0] = chX;
+	channels[1] = chY;
+	for (int c = 0; c < 2; c++)
+	{
+		FlowChannel* channel = data->getChannel(channels[c]);
+		range[2*c] = valueRange ? valueRange[2*c] : channel->getMin();
+		range[2*c+1] = valueRange ? valueRange[2*c+1] : channel->getMax();
+	}
+	mask = vertexMask;
+	region[0] = region[1] = 0;
+	region[2] = data->getGeometry()->getDimX();
+	region[3] = data->getGeometry()->getDimY();
+	rebuild();
+}
+
+void FlowJointHistogram::rebuild()
+{
+	memset(counts, 0, sizeof(int)*bins[0]*bins[1]);
+	accumulate(region, 1);
+	revisions[0] = data->getChannel(channels[0])->getRevision();
+	revisions[1] = data->getChannel(channels[1])->getRevision();
+	built = true;
+}
+
+void FlowJointHistogram::update()
+{
+	if (counts)
+		rebuild();
+}
+
+void FlowJointHistogram::accumulate(const int* rect, int sign)
+{
+	FlowGeometry* geometry = data->getGeometry();
+	const float* values[2] = {data->getChannel(channels[0])->getValueArray(), data->getChannel(channels[1])->getValueArray()};
+	int dimX = geometry->getDimX();
+	bool rowMajor = (geometry->getVertexOrder() == ORDER_ROW_MAJOR);
+	int x0 = rect[0];
+	int n = rect[2] - rect[0];
+	if (n <= 0 || rect[3] <= rect[1])
+		return;
+	//the extra bin at the end collects everything that is not counted
+	int numBins = bins[0]*bins[1];
+	int size = numBins + 1;
+	memset(local, 0, sizeof(int)*numThreads*size);
+	float scale[2];
+	for (int c = 0; c < 2; c++)
+		scale[c] = (range[2*c+1] > range[2*c]) ? bins[c] / (range[2*c+1] - range[2*c]) : 0.0f;
+
+	#pragma omp parallel
+	{
+		int thread = 0;
+#ifdef _OPENMP
+		thread = omp_get_thread_num();
+#endif
+		int* hist = local + thread*size;
+		//rows of the tiled orders are not contiguous, they are gathered first
+		float* rowX = rowMajor ? NULL : new float[n];
+		float* rowY = rowMajor ? NULL : new float[n];
+		unsigned char* rowMask = (rowMajor || !mask) ? NULL : new unsigned char[n];
+
+		#pragma omp for schedule(static)
+		for (int y = rect[1]; y < rect[3]; y++)
+		{
+			const float* srcX = values[0] + y*dimX + x0;
+			const float* srcY = values[1] + y*dimX + x0;
+			const unsigned char* srcMask = mask ? mask + y*dimX + x0 : NULL;
+			if (!rowMajor)
+			{
+				for (int x = 0; x < n; x++)
+				{
+					int vtxID = geometry->getVtx(x0 + x, y);
+					rowX[x] = values[0][vtxID];
+					rowY[x] = values[1][vtxID];
+					if (mask)
+						rowMask[x] = mask[vtxID];
+				}
+				srcX = rowX;
+				srcY = rowY;
+				srcMask = rowMask;
+			}
+
+			int x = 0;
+#ifdef FLOW_SSE
+			__m128 loX = _mm_set1_ps(range[0]);
+			__m128 loY = _mm_set1_ps(range[2]);
+			__m128 scaleX = _mm_set1_ps(scale[0]);
+			__m128 scaleY = _mm_set1_ps(scale[1]);
+			__m128 binsX = _mm_set1_ps((float)bins[0]);
+			__m128 binsY = _mm_set1_ps((float)bins[1]);
+			__m128 topX = _mm_set1_ps((float)(bins[0] - 1));
+			__m128 topY = _mm_set1_ps((float)(bins[1] - 1));
+			__m128 zero = _mm_setzero_ps();
+			__m128i outside = _mm_set1_epi32(numBins);
+			for (; x + 4 <= n; x += 4)
+			{
+				__m128 fx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(srcX + x), loX), scaleX);
+				__m128 fy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(srcY + x), loY), scaleY);
+				//the upper end of the ranges belongs to the last bin, NaN fails all comparisons
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(fx, zero), _mm_cmple_ps(fx, binsX)), _mm_and_ps(_mm_cmpge_ps(fy, zero), _mm_cmple_ps(fy, binsY)));
+				fx = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_min_ps(fx, topX)));
+				fy = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_min_ps(fy, topY)));
+				//row*binsX + column is exact in float for any reasonable number of bins
+				__m128i index = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(fy, binsX), fx));
+				__m128i keep = _mm_castps_si128(inside);
+				index = _mm_or_si128(_mm_and_si128(keep, index), _mm_andnot_si128(keep, outside));
+				int idx[4];
+				_mm_storeu_si128((__m128i*)idx, index);
+				for (int k = 0; k < 4; k++)
+					hist[(srcMask && !srcMask[x+k]) ? numBins : idx[k]]++;
+			}
+#endif
+			for (; x < n; x++)
+			{
+				float fx = (srcX[x] - range[0]) * scale[0];
+				float fy = (srcY[x] - range[2]) * scale[1];
+				int index = numBins;
+				if (fx >= 0.0f && fx <= bins[0] && fy >= 0.0f && fy <= bins[1] && !(srcMask && !srcMask[x]))
+				{
+					int bx = (int)fx;
+					int by = (int)fy;
+					index = ((by < bins[1]) ? by : bins[1] - 1)*bins[0] + ((bx < bins[0]) ? bx : bins[0] - 1);
+				}
+				hist[index]++;
+			}
+		}
+		delete[] rowX;
+		delete[] rowY;
+		delete[] rowMask;
+	}
+
+	#pragma omp parallel for schedule(static)
+	for (int b = 0; b < numBins; b++)
+	{
+		int sum = 0;
+		for (int t = 0; t < numThreads; t++)
+			sum += local[t*size + b];
+		counts[b] += sign*sum;
+	}
+}
+
+void FlowJointHistogram::setRegion(int x0, int y0, int x1, int y1)
+{
+	FlowGeometry* geometry = data->getGeometry();
+	int next[4] = {x0, y0, x1, y1};
+	int dim[2] = {geometry->getDimX(), geometry->getDimY()};
+	for (int k = 0; k < 4; k++)
+		next[k] = (next[k] < 0) ? 0 : ((next[k] > dim[k%2]) ? dim[k%2] : next[k]);
+	next[2] = (next[2] < next[0]) ? next[0] : next[2];
+	next[3] = (next[3] < next[1]) ? next[1] : next[3];
+
+	int* previous = region;
+	bool current = built && data->getChannel(channels[0])->getRevision() == revisions[0] && data->getChannel(channels[1])->getRevision() == revisions[1];
+	//the overlap of the old and the new region stays, only the strips around it change
+	int overlap[4] = {(previous[0] > next[0]) ? previous[0] : next[0], (previous[1] > next[1]) ? previous[1] : next[1],
+		(previous[2] < next[2]) ? previous[2] : next[2], (previous[3] < next[3]) ? previous[3] : next[3]};
+	bool overlapping = (overlap[0] < overlap[2]) && (overlap[1] < overlap[3]);
+	double overlapArea = overlapping ? (double)(overlap[2] - overlap[0])*(overlap[3] - overlap[1]) : 0;
+	double previousArea = (double)(previous[2] - previous[0])*(previous[3] - previous[1]);
+	double nextArea = (double)(next[2] - next[0])*(next[3] - next[1]);
+	//an update touches everything outside of the overlap in both regions, a rebuild the whole new region
+	bool incremental = current && overlapping && (previousArea + nextArea - 2*overlapArea < nextArea);
+
+	if (!incremental)
+	{
+		for (int k = 0; k < 4; k++)
+			region[k] = next[k];
+		if (counts)
+			rebuild();
+		return;
+	}
+
+	//each region minus the overlap splits into the strips below, above, left and right of it
+	const int* rects[2] = {previous, next};
+	for (int r = 0; r < 2; r++)
+	{
+		const int* a = rects[r];
+		int strips[4][4] = {
+			{a[0], a[1], a[2], overlap[1]},
+			{a[0], overlap[3], a[2], a[3]},
+			{a[0], overlap[1], overlap[0], overlap[3]},
+			{overlap[2], overlap[1], a[2], overlap[3]}};
+		for (int s = 0; s < 4; s++)
+			accumulate(strips[s], (r == 0) ? -1 : 1);
+	}
+	for (int k = 0; k < 4; k++)
+		region[k] = next[k];
+}
+
+const int* FlowJointHistogram::getCounts()
+{
+	return counts;
+}
+
+int FlowJointHistogram::getBinsX()
+{
+	return bins[0];
+}
+
+int FlowJointHistogram::getBinsY()
+{
+	return bins[1];
+}
+
+int FlowJointHistogram::getMaxCount()
+{
+	int maximum = 0;
+	for (int b = 0; b < bins[0]*bins[1]; b++)
+		maximum = (counts[b] > maximum) ? counts[b] : maximum;
+	return maximum;
+}
+
+void FlowJointHistogram::getDensity(float* dst, bool logarithmic)
+{
+	int maximum = getMaxCount();
+	if (maximum == 0)
+	{
+		memset(dst, 0, sizeof(float)*bins[0]*bins[1]);
+		return;
+	}
+	float scale = logarithmic ? 1.0f / log(1.0f + maximum) : 1.0f / maximum;
+	for (int b = 0; b < bins[0]*bins[1]; b++)
+		dst[b] = (logarithmic ? log(1.0f + counts[b]) : (float)counts[b]) * scale;
+}
@@ -0,0 +1,73 @@
+#ifndef FLOWJOINTHISTOGRAM_H
+#define FLOWJOINTHISTOGRAM_H
+
+class FlowData;
+
+///joint (2D) histogram of two channels, e.g. pressure against velocity magnitude
+/**
+* Bin (bx,by) counts the vertices whose value of the first channel falls into bin bx and whose value of the second channel falls into bin by,
+* values outside of the ranges are not counted. The counts are stored row-major (binsX counts per row, binsY rows), ready to be shown as a density plot.
+* The histogram can be restricted to a region of vertices and to a mask. Moving the region only subtracts the vertices leaving it and adds the ones entering it,
+* so brushing does not rebuild everything. Every thread bins into a private histogram, the bin indexes of four vertices are computed at once with SSE where available.
+*/
+class FlowJointHistogram{
+	private:
+		///the data set the channels belong to
+		FlowData* data;
+		///ids of the two channels
+		int channels[2];
+		///number of bins along each axis
+		int bins[2];
+		///value ranges of the two channels as {minX, maxX, minY, maxY}
+		float range[4];
+		///the counts, bins[0]*bins[1] of them
+		int* counts;
+		///private histograms of the threads, each with one more bin collecting the masked out and out of range vertices
+		int* local;
+		///number of threads local was allocated for
+		int numThreads;
+		///one byte per vertex in the vertex order, 0 = not counted. NULL counts all vertices.
+		const unsigned char* mask;
+		///the counted region of vertices as {x0, y0, x1, y1}, x0 <= x < x1, y0 <= y < y1
+		int region[4];
+		///revisions of the channels the counts were computed from
+		unsigned int revisions[2];
+		///were the counts built at all?
+		bool built;
+
+		///adds (sign 1) or subtracts (sign -1) the vertices of the rectangle {x0, y0, x1, y1} to or from the counts
+		void accumulate(const int* rect, int sign);
+		///counts the region from scratch
+		void rebuild();
+
+		FlowJointHistogram(const FlowJointHistogram&);
+		FlowJointHistogram& operator=(const FlowJointHistogram&);
+	public:
+		///creates an empty histogram for channels of the given data set
+		FlowJointHistogram(FlowData* d);
+		///frees the counts
+		~FlowJointHistogram();
+
+		///counts the whole data set for the channels chX and chY
+		/**
+		* @param valueRange value ranges as {minX, maxX, minY, maxY}, NULL takes the ranges of the channels
+		* @param vertexMask one byte per vertex in the vertex order of the geometry (0 = not counted), NULL counts all vertices. It has to stay valid while the histogram is used.
+		*/
+		void build(int chX, int chY, int binsX, int binsY, const float* valueRange = 0, const unsigned char* vertexMask = 0);
+		///restricts the counts to the vertices x0 <= x < x1, y0 <= y < y1, updating them incrementally where that is cheaper than a rebuild
+		void setRegion(int x0, int y0, int x1, int y1);
+		///counts everything again, call this after the values of the channels or the mask were modified
+		void update();
+
+		///returns the counts, row-major with getBinsX() counts per row
+		const int* getCounts();
+		///returns the number of bins along the first channel
+		int getBinsX();
+		///returns the number of bins along the second channel
+		int getBinsY();
+		///returns the highest count
+		int getMaxCount();
+		///writes the counts scaled to <0..1> (relative to the highest count) into dst, the logarithmic scale keeps sparse regimes visible
+		void getDensity(float* dst, bool logarithmic = true);
+};
+#endif
@@ -0,0 +1,131 @@
+#include "FlowMask.h"
+
+FlowMask::FlowMask(int dimX, int dimY)
+{
+	dim[0] = dimX;
+	dim[1] = dimY;
+	wordsPerRow = (dimX + 31) >> 5;
+	bits.assign((size_t)wordsPerRow * dimY, ~0u);
+	tilesX = (dimX + MASK_TILE - 1) >> MASK_TILE_SHIFT;
+	tilesY = (dimY + MASK_TILE - 1) >> MASK_TILE_SHIFT;
+	tiles.assign((size_t)tilesX * tilesY, (unsigned char)MASK_TILE_VALID);
+	numValid = dimX * dimY;
+}
+
+int FlowMask::getDimX() const
+{
+	return dim[0];
+}
+
+int FlowMask::getDimY() const
+{
+	return dim[1];
+}
+
+void FlowMask::endUpdate()
+{
+	int valid = 0;
+	#pragma omp parallel for schedule(dynamic) reduction(+:valid)
+	for (int ty = 0; ty < tilesY; ty++)
+		for (int tx = 0; tx < tilesX; tx++)
+		{
+			int x0, y0, x1, y1;
+			getTileVertices(tx, ty, &x0, &y0, &x1, &y1);
+			int inside = 0;
+			for (int y = y0; y < y1; y++)
+				for (int x = x0; x < x1; x++)
+					inside += isValid(x, y);
+			valid += inside;
+			MaskTile tile = MASK_TILE_MIXED;
+			if (inside == 0)
+				tile = MASK_TILE_INVALID;
+			else if (inside == (x1 - x0) * (y1 - y0))
+				tile = MASK_TILE_VALID;
+			tiles[ty*tilesX + tx] = (unsigned char)tile;
+		}
+	numValid = valid;
+}
+
+int FlowMask::getNumValid() const
+{
+	return numValid;
+}
+
+int FlowMask::getNumInvalid() const
+{
+	return dim[0]*dim[1] - numValid;
+}
+
+int FlowMask::getTilesX() const
+{
+	return tilesX;
+}
+
+int FlowMask::getTilesY() const
+{
+	return tilesY;
+}
+
+void FlowMask::getTileVertices(int tx, int ty, int* x0, int* y0, int* x1, int* y1) const
+{
+	*x0 = tx << MASK_TILE_SHIFT;
+	*y0 = ty << MASK_TILE_SHIFT;
+	*x1 = (*x0 + MASK_TILE < dim[0]) ? *x0 + MASK_TILE : dim[0];
+	*y1 = (*y0 + MASK_TILE < dim[1]) ? *y0 + MASK_TILE : dim[1];
+}
+
+int FlowMask::getRuns(int y, int* runs) const
+{
+	int n = 0;
+	//the run being extended, -1 if the last vertex was invalid
+	int start = -1;
+	int ty = y >> MASK_TILE_SHIFT;
+	for (int tx = 0; tx < tilesX; tx++)
+	{
+		int x0 = tx << MASK_TILE_SHIFT;
+		int x1 = (x0 + MASK_TILE < dim[0]) ? x0 + MASK_TILE : dim[0];
+		MaskTile tile = getTile(tx, ty);
+		if (tile == MASK_TILE_VALID)
+		{
+			if (start < 0)
+				start = x0;
+			continue;
+		}
+		if (tile == MASK_TILE_INVALID)
+		{
+			if (start >= 0)
+			{
+				runs[2*n] = start;
+				runs[2*n + 1] = x0;
+				n++;
+				start = -1;
+			}
+			continue;
+		}
+		for (int x = x0; x < x1; x++)
+		{
+			bool valid = isValid(x, y);
+			if (valid && start < 0)
+				start = x;
+			else if (!valid && start >= 0)
+			{
+				runs[2*n] = start;
+				runs[2*n + 1] = x;
+				n++;
+				start = -1;
+			}
+		}
+	}
+	if (start >= 0)
+	{
+		runs[2*n] = start;
+		runs[2*n + 1] = dim[0];
+		n++;
+	}
+	return n;
+}
+
+size_t FlowMask::getMemory() const
+{
+	return bits.size() * sizeof(unsigned int) + tiles.size();
+}
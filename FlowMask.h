@@ -0,0 +1,129 @@
+#ifndef FLOWMASK_H
+#define FLOWMASK_H
+
+#include <stddef.h>
+#include <vector>
+
+///log2 of the edge length of the summary tiles of FlowMask
+#define MASK_TILE_SHIFT 4
+///edge length of the summary tiles of FlowMask in vertices, the same as the tiles of the tiled vertex orders
+#define MASK_TILE (1 << MASK_TILE_SHIFT)
+
+///summary of a tile of the mask
+enum MaskTile {
+	///no vertex of the tile is valid
+	MASK_TILE_INVALID,
+	///every vertex of the tile is valid
+	MASK_TILE_VALID,
+	///the tile holds valid and invalid vertices
+	MASK_TILE_MIXED
+};
+
+///marks the vertices of a grid as valid or invalid, e.g. those inside of solid obstacles
+/**
+* One bit per vertex, indexed by (x,y) independently of the vertex order of the geometry, rows padded to whole words.
+* Every tile of MASK_TILE x MASK_TILE vertices is summarized as all valid, all invalid or mixed, so loops over the grid skip invalid tiles
+* and take valid ones without looking at single bits (see getRuns). A cell counts as blocked if all four of its vertices are invalid,
+* so the cells along the surface of an obstacle, which still carry flow on their other vertices, stay open.
+* The bits are set with setValid and the summaries are brought up to date with endUpdate.
+*/
+class FlowMask{
+	private:
+		///number of vertices in X and Y
+		int dim[2];
+		///number of words per row of bits
+		int wordsPerRow;
+		///the bits, row after row, bit x%32 of word x/32 for vertex x
+		std::vector<unsigned int> bits;
+		///number of tiles in X
+		int tilesX;
+		///number of tiles in Y
+		int tilesY;
+		///MaskTile of every tile, row-major
+		std::vector<unsigned char> tiles;
+		///number of valid vertices
+		int numValid;
+	public:
+		///creates a mask of dimX x dimY vertices, all valid
+		FlowMask(int dimX, int dimY);
+
+		///returns the number of vertices in X
+		int getDimX() const;
+		///returns the number of vertices in Y
+		int getDimY() const;
+		///marks the vertex (x,y) as valid or invalid, endUpdate has to be called once all vertices are set
+		inline void setValid(int x, int y, bool valid);
+		///recomputes the tile summaries and the number of valid vertices after setValid
+		void endUpdate();
+
+		///returns true if the vertex (x,y) is valid
+		inline bool isValid(int x, int y) const;
+		///returns true if all four vertices of the cell (cx,cy) (between the vertices cx..cx+1, cy..cy+1) are invalid
+		inline bool isCellBlocked(int cx, int cy) const;
+		///returns true if the cell containing the fractional vertex indexes (i,j) is blocked, positions outside of the grid use the nearest cell
+		inline bool isBlockedAtIndex(float i, float j) const;
+		///returns the number of valid vertices
+		int getNumValid() const;
+		///returns the number of invalid vertices
+		int getNumInvalid() const;
+
+		///returns the number of tiles in X
+		int getTilesX() const;
+		///returns the number of tiles in Y
+		int getTilesY() const;
+		///returns the summary of the tile (tx,ty)
+		inline MaskTile getTile(int tx, int ty) const;
+		///returns the vertices x0 <= x < x1, y0 <= y < y1 of the tile (tx,ty)
+		void getTileVertices(int tx, int ty, int* x0, int* y0, int* x1, int* y1) const;
+		///stores the runs of valid vertices of row y as pairs runs[2k] <= x < runs[2k+1], returns their number. runs has to hold getDimX()+1 ints.
+		/**
+		* Valid tiles are taken as a whole and invalid ones skipped as a whole, only mixed tiles are looked at bit by bit.
+		* Adjacent runs are merged, so a row without invalid vertices gives a single run.
+		*/
+		int getRuns(int y, int* runs) const;
+		///returns the bytes of the bits and the tile summaries
+		size_t getMemory() const;
+};
+
+inline void FlowMask::setValid(int x, int y, bool valid)
+{
+	unsigned int& word = bits[y*wordsPerRow + (x >> 5)];
+	unsigned int bit = 1u << (x & 31);
+	word = valid ? (word | bit) : (word & ~bit);
+}
+
+inline bool FlowMask::isValid(int x, int y) const
+{
+	return (bits[y*wordsPerRow + (x >> 5)] >> (x & 31)) & 1u;
+}
+
+inline bool FlowMask::isCellBlocked(int cx, int cy) const
+{
+	int cx1 = (cx + 1 < dim[0]) ? cx + 1 : cx;
+	int cy1 = (cy + 1 < dim[1]) ? cy + 1 : cy;
+	//a corner in a valid tile opens the cell, a cell inside of an invalid tile is blocked, in both cases no bit has to be read
+	MaskTile tile = getTile(cx >> MASK_TILE_SHIFT, cy >> MASK_TILE_SHIFT);
+	if (tile == MASK_TILE_VALID)
+		return false;
+	if (tile == MASK_TILE_INVALID && (cx1 >> MASK_TILE_SHIFT) == (cx >> MASK_TILE_SHIFT) && (cy1 >> MASK_TILE_SHIFT) == (cy >> MASK_TILE_SHIFT))
+		return true;
+	return !isValid(cx, cy) && !isValid(cx1, cy) && !isValid(cx, cy1) && !isValid(cx1, cy1);
+}
+
+inline bool FlowMask::isBlockedAtIndex(float i, float j) const
+{
+	int cx = (int)i;
+	int cy = (int)j;
+	//grids of a single vertex in a direction have a cell 0 as well
+	cx = (cx > dim[0]-2) ? dim[0]-2 : cx;
+	cy = (cy > dim[1]-2) ? dim[1]-2 : cy;
+	cx = (cx < 0) ? 0 : cx;
+	cy = (cy < 0) ? 0 : cy;
+	return isCellBlocked(cx, cy);
+}
+
+inline MaskTile FlowMask::getTile(int tx, int ty) const
+{
+	return (MaskTile)tiles[ty*tilesX + tx];
+}
+#endif
@@ -0,0 +1,111 @@
+#include "FlowMemory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <iostream>
+
+FlowMemory::FlowMemory()
+{
+	for (int c = 0; c < MEMORY_CLASSES; c++)
+		usage[c] = 0;
+	budget = 0;
+	clock = 0;
+	spillFiles = 0;
+
+	//shared nodes set the ceiling from the outside
+	const char* limit = getenv("FLOW_MEMORY_BUDGET");
+	if (limit)
+		budget = (size_t)atoi(limit) << 20;
+	const char* directory = getenv("FLOW_SPILL_DIR");
+	if (!directory)
+		directory = getenv("TMPDIR");
+	if (!directory)
+		directory = getenv("TEMP");
+	if (directory && *directory)
+		spillDirectory = std::string(directory) + "/";
+}
+
+void FlowMemory::setBudget(size_t bytes)
+{
+	budget = bytes;
+}
+
+size_t FlowMemory::getBudget()
+{
+	return budget;
+}
+
+bool FlowMemory::fits(size_t bytes)
+{
+	return (budget == 0) || (getTotal() + bytes <= budget);
+}
+
+void FlowMemory::setUsage(MemoryClass c, size_t bytes)
+{
+	usage[c] = bytes;
+}
+
+size_t FlowMemory::getUsage(MemoryClass c)
+{
+	return usage[c];
+}
+
+size_t FlowMemory::getTotal()
+{
+	size_t total = 0;
+	for (int c = 0; c < MEMORY_CLASSES; c++)
+		if (c != MEMORY_TEXTURES)
+			total += usage[c];
+	return total;
+}
+
+void FlowMemory::print()
+{
+	for (int c = 0; c < MEMORY_CLASSES; c++)
+		std::cout << getName((MemoryClass)c) << ": " << (usage[c] >> 20) << " MB" << std::endl;
+	if (budget)
+		std::cout << "Total: " << (getTotal() >> 20) << " MB of " << (budget >> 20) << " MB" << std::endl;
+	else
+		std::cout << "Total: " << (getTotal() >> 20) << " MB, no budget" << std::endl;
+}
+
+const char* FlowMemory::getName(MemoryClass c)
+{
+	switch (c)
+	{
+	case MEMORY_GEOMETRY:
+		return "Geometry";
+	case MEMORY_CHANNELS:
+		return "Channels";
+	case MEMORY_DERIVED:
+		return "Derived channels";
+	case MEMORY_CACHES:
+		return "Channel caches";
+	case MEMORY_RESAMPLED:
+		return "Resampled grids";
+	case MEMORY_POOLED:
+		return "Pooled buffers";
+	case MEMORY_TEXTURES:
+		return "Textures";
+	default:
+		return "Unknown";
+	}
+}
+
+unsigned int FlowMemory::getClock()
+{
+	return clock;
+}
+
+void FlowMemory::advanceClock()
+{
+	clock++;
+}
+
+std::string FlowMemory::createSpillPath()
+{
+	//the time and the address keep the files of several processes and data sets apart
+	char name[96];
+	sprintf(name, "flow_%lx_%p_%d.spill", (unsigned long)time(NULL), (void*)this, spillFiles++);
+	return spillDirectory + name;
+}
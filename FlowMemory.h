@@ -0,0 +1,76 @@
+#ifndef FLOWMEMORY_H
+#define FLOWMEMORY_H
+
+#include <stddef.h>
+#include <string>
+
+///the kinds of memory accounted by FlowMemory
+enum MemoryClass {
+	///coordinates, Jacobians and inverse tables of the geometry and its coarser levels, the bricked 3D volume
+	MEMORY_GEOMETRY,
+	///values of the channels loaded from the data set and of channels filled by the caller
+	MEMORY_CHANNELS,
+	///values of the channels computed by FlowData (expressions, filters, derived quantities), they may be spilled to disk
+	MEMORY_DERIVED,
+	///bitmap indexes, summed-area tables and mip pyramids of the channels, they are built again when needed
+	MEMORY_CACHES,
+	///regular grids cached by the resampler and the channel groups
+	MEMORY_RESAMPLED,
+	///idle buffers kept by the arena of the data set for reuse (see FlowArena), they are freed first when the budget is exceeded
+	MEMORY_POOLED,
+	///textures on the graphics card, reported by the renderer
+	MEMORY_TEXTURES,
+	///number of memory classes
+	MEMORY_CLASSES
+};
+
+///accounts the memory of a data set per class and holds the budget it has to stay within, see FlowData::enforceBudget
+/**
+* The usage of the classes held by FlowData is measured by FlowData::updateMemoryUsage, the textures live on the graphics card
+* and are reported by the renderer with setUsage. The budget defaults to the environment variable FLOW_MEMORY_BUDGET (in MB), 0 means unlimited.
+* Spilled channels are written to the directory given by FLOW_SPILL_DIR (or TMPDIR, TEMP, the working directory).
+* The clock orders the uses of the evictable items, anything used since the last enforcement is considered in use and never evicted.
+*/
+class FlowMemory{
+	private:
+		///bytes used by every class
+		size_t usage[MEMORY_CLASSES];
+		///maximum number of bytes of all classes together except MEMORY_TEXTURES, 0 for no limit
+		size_t budget;
+		///incremented by every enforcement
+		unsigned int clock;
+		///directory of the spill files, ending with a separator (or empty for the working directory)
+		std::string spillDirectory;
+		///number of spill files created so far, makes their names unique
+		int spillFiles;
+	public:
+		///creates the accounting with the budget and the spill directory taken from the environment
+		FlowMemory();
+
+		///sets the budget in bytes (0 for no limit)
+		void setBudget(size_t bytes);
+		///returns the budget in bytes (0 for no limit)
+		size_t getBudget();
+		///returns true if bytes more fit into the budget
+		bool fits(size_t bytes);
+
+		///sets the bytes used by a class
+		void setUsage(MemoryClass c, size_t bytes);
+		///returns the bytes used by a class
+		size_t getUsage(MemoryClass c);
+		///returns the bytes used by all classes held in main memory (all except MEMORY_TEXTURES)
+		size_t getTotal();
+		///prints the usage of all classes and the budget
+		void print();
+		///returns the name of a class, e.g. for messages
+		static const char* getName(MemoryClass c);
+
+		///returns the current time of the use clock
+		unsigned int getClock();
+		///advances the use clock, everything used before counts as not in use any more
+		void advanceClock();
+
+		///returns the path of a new spill file
+		std::string createSpillPath();
+};
+#endif
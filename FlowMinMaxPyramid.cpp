@@ -0,0 +1,194 @@
+#include "FlowMinMaxPyramid.h"
+#include "FlowGeometry.h"
+#include <math.h>
+
+FlowMinMaxPyramid::FlowMinMaxPyramid(FlowGeometry* g)
+{
+	geometry = g;
+	//tiles of cells, a grid of dimX vertices has dimX-1 cells
+	int cellsX = (geometry->getDimX() > 1) ? geometry->getDimX() - 1 : 1;
+	int cellsY = (geometry->getDimY() > 1) ? geometry->getDimY() - 1 : 1;
+	int x = (cellsX + MINMAX_TILE - 1) / MINMAX_TILE;
+	int y = (cellsY + MINMAX_TILE - 1) / MINMAX_TILE;
+	while (true)
+	{
+		tilesX.push_back(x);
+		tilesY.push_back(y);
+		minimum.push_back(std::vector<float>(x*y, (float)HUGE_VAL));
+		maximum.push_back(std::vector<float>(x*y, (float)-HUGE_VAL));
+		if (x == 1 && y == 1)
+			break;
+		x = (x + 1) / 2;
+		y = (y + 1) / 2;
+	}
+	dirty = false;
+}
+
+void FlowMinMaxPyramid::build(const float* values)
+{
+	int dimX = geometry->getDimX();
+	int dimY = geometry->getDimY();
+	int numTiles = tilesX[0] * tilesY[0];
+	std::vector<float>& lo = minimum[0];
+	std::vector<float>& hi = maximum[0];
+
+	#pragma omp parallel for schedule(dynamic, 16)
+	for (int tile = 0; tile < numTiles; tile++)
+	{
+		int x0 = (tile % tilesX[0]) * MINMAX_TILE;
+		int y0 = (tile / tilesX[0]) * MINMAX_TILE;
+		//the vertices of the last cells belong to the tile as well
+		int x1 = (x0 + MINMAX_TILE < dimX - 1) ? x0 + MINMAX_TILE : dimX - 1;
+		int y1 = (y0 + MINMAX_TILE < dimY - 1) ? y0 + MINMAX_TILE : dimY - 1;
+		float tileMin = (float)HUGE_VAL;
+		float tileMax = (float)-HUGE_VAL;
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++)
+			{
+				float value = values[geometry->getVtx(x,y)];
+				tileMin = (value < tileMin) ? value : tileMin;
+				tileMax = (value > tileMax) ? value : tileMax;
+			}
+		lo[tile] = tileMin;
+		hi[tile] = tileMax;
+	}
+	buildLevels();
+}
+
+void FlowMinMaxPyramid::buildLevels()
+{
+	for (size_t level = 1; level < tilesX.size(); level++)
+	{
+		int finerX = tilesX[level-1];
+		int finerY = tilesY[level-1];
+		const std::vector<float>& finerMin = minimum[level-1];
+		const std::vector<float>& finerMax = maximum[level-1];
+		for (int ty = 0; ty < tilesY[level]; ty++)
+			for (int tx = 0; tx < tilesX[level]; tx++)
+			{
+				float tileMin = (float)HUGE_VAL;
+				float tileMax = (float)-HUGE_VAL;
+				for (int y = 2*ty; y < 2*ty + 2 && y < finerY; y++)
+					for (int x = 2*tx; x < 2*tx + 2 && x < finerX; x++)
+					{
+						tileMin = (finerMin[y*finerX + x] < tileMin) ? finerMin[y*finerX + x] : tileMin;
+						tileMax = (finerMax[y*finerX + x] > tileMax) ? finerMax[y*finerX + x] : tileMax;
+					}
+				minimum[level][ty*tilesX[level] + tx] = tileMin;
+				maximum[level][ty*tilesX[level] + tx] = tileMax;
+			}
+	}
+	dirty = false;
+}
+
+void FlowMinMaxPyramid::expand(int x, int y, float value)
+{
+	//a vertex on a tile border belongs to the tiles on both sides
+	int txs[2] = {x / MINMAX_TILE, x / MINMAX_TILE - 1};
+	int tys[2] = {y / MINMAX_TILE, y / MINMAX_TILE - 1};
+	bool sharedX = (x % MINMAX_TILE == 0);
+	bool sharedY = (y % MINMAX_TILE == 0);
+	for (int j = 0; j < (sharedY ? 2 : 1); j++)
+		for (int i = 0; i < (sharedX ? 2 : 1); i++)
+		{
+			int tx = txs[i];
+			int ty = tys[j];
+			if (tx < 0 || ty < 0 || tx >= tilesX[0] || ty >= tilesY[0])
+				continue;
+			int tile = ty*tilesX[0] + tx;
+			minimum[0][tile] = (value < minimum[0][tile]) ? value : minimum[0][tile];
+			maximum[0][tile] = (value > maximum[0][tile]) ? value : maximum[0][tile];
+		}
+	//the coarser levels are updated when they are needed
+	dirty = true;
+}
+
+void FlowMinMaxPyramid::findTiles(float lo, float hi, std::vector<int>* tiles)
+{
+	if (dirty)
+		buildLevels();
+	//tiles still to look at, as (level, tile) pairs
+	std::vector<int> stack;
+	int top = (int)tilesX.size() - 1;
+	stack.push_back(top);
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		int tile = stack.back();
+		stack.pop_back();
+		int level = stack.back();
+		stack.pop_back();
+		if (maximum[level][tile] < lo || minimum[level][tile] > hi)
+			continue;
+		if (level == 0)
+		{
+			tiles->push_back(tile);
+			continue;
+		}
+		int tx = tile % tilesX[level];
+		int ty = tile / tilesX[level];
+		//the children are pushed in reverse, so that the tiles come out row by row inside of every coarse tile
+		for (int y = 2*ty + 1; y >= 2*ty; y--)
+			for (int x = 2*tx + 1; x >= 2*tx; x--)
+				if (x < tilesX[level-1] && y < tilesY[level-1])
+				{
+					stack.push_back(level - 1);
+					stack.push_back(y*tilesX[level-1] + x);
+				}
+	}
+}
+
+void FlowMinMaxPyramid::getTileCells(int tile, int* x0, int* y0, int* x1, int* y1)
+{
+	int cellsX = (geometry->getDimX() > 1) ? geometry->getDimX() - 1 : 1;
+	int cellsY = (geometry->getDimY() > 1) ? geometry->getDimY() - 1 : 1;
+	*x0 = (tile % tilesX[0]) * MINMAX_TILE;
+	*y0 = (tile / tilesX[0]) * MINMAX_TILE;
+	*x1 = (*x0 + MINMAX_TILE < cellsX) ? *x0 + MINMAX_TILE : cellsX;
+	*y1 = (*y0 + MINMAX_TILE < cellsY) ? *y0 + MINMAX_TILE : cellsY;
+}
+
+int FlowMinMaxPyramid::getNumLevels()
+{
+	return (int)tilesX.size();
+}
+
+int FlowMinMaxPyramid::getTilesX()
+{
+	return tilesX[0];
+}
+
+int FlowMinMaxPyramid::getTilesY()
+{
+	return tilesY[0];
+}
+
+float FlowMinMaxPyramid::getMin(int level, int tx, int ty)
+{
+	if (dirty)
+		buildLevels();
+	return minimum[level][ty*tilesX[level] + tx];
+}
+
+float FlowMinMaxPyramid::getMax(int level, int tx, int ty)
+{
+	if (dirty)
+		buildLevels();
+	return maximum[level][ty*tilesX[level] + tx];
+}
+
+void FlowMinMaxPyramid::getRange(float* lo, float* hi)
+{
+	if (dirty)
+		buildLevels();
+	*lo = minimum.back()[0];
+	*hi = maximum.back()[0];
+}
+
+size_t FlowMinMaxPyramid::getMemory()
+{
+	size_t tiles = 0;
+	for (size_t l = 0; l < minimum.size(); l++)
+		tiles += minimum[l].size() + maximum[l].size();
+	return tiles * sizeof(float);
+}
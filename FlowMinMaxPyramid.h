@@ -0,0 +1,65 @@
+#ifndef FLOWMINMAXPYRAMID_H
+#define FLOWMINMAXPYRAMID_H
+
+#include <stddef.h>
+#include <vector>
+
+class FlowGeometry;
+
+///edge length of the tiles of the min/max pyramid in cells
+#define MINMAX_TILE 16
+
+///minimum and maximum of a channel over tiles of cells, and over groups of 2x2 tiles on every coarser level
+/**
+* Tile (tx,ty) of level 0 holds the cells tx*MINMAX_TILE <= x < (tx+1)*MINMAX_TILE (same for y), its range covers all the vertices of these cells,
+* including the ones shared with the next tiles. So a value not inside of the range of a tile cannot appear anywhere inside of its cells,
+* e.g. no isoline of that value crosses the tile. The last level consists of a single tile holding the range of the whole channel.
+* Ranges may be wider than the values (setValue only widens them), never narrower, so candidate tiles are never missed.
+*/
+class FlowMinMaxPyramid{
+	private:
+		///the geometry of the channel
+		FlowGeometry* geometry;
+		///number of tiles of every level in X
+		std::vector<int> tilesX;
+		///number of tiles of every level in Y
+		std::vector<int> tilesY;
+		///minimum of every tile of every level, row-major
+		std::vector< std::vector<float> > minimum;
+		///maximum of every tile of every level, row-major
+		std::vector< std::vector<float> > maximum;
+		///have tiles of level 0 been widened since the coarser levels were built?
+		bool dirty;
+
+		///builds the coarser levels from level 0
+		void buildLevels();
+	public:
+		///creates the levels for the geometry, all tiles are empty
+		FlowMinMaxPyramid(FlowGeometry* g);
+
+		///computes all tiles from the values (in the vertex order of the geometry), in parallel
+		void build(const float* values);
+		///widens the tiles containing the vertex (x,y) so that they include the value
+		void expand(int x, int y, float value);
+
+		///appends the level 0 tiles (ty*getTilesX() + tx) whose range intersects <lo, hi>, descending only into the coarse tiles that do
+		void findTiles(float lo, float hi, std::vector<int>* tiles);
+		///returns the cells x0 <= x < x1, y0 <= y < y1 of a level 0 tile
+		void getTileCells(int tile, int* x0, int* y0, int* x1, int* y1);
+
+		///returns the number of levels
+		int getNumLevels();
+		///returns the number of level 0 tiles in X
+		int getTilesX();
+		///returns the number of level 0 tiles in Y
+		int getTilesY();
+		///returns the minimum of the tile (tx,ty) of the given level
+		float getMin(int level, int tx, int ty);
+		///returns the maximum of the tile (tx,ty) of the given level
+		float getMax(int level, int tx, int ty);
+		///returns the range of the whole channel (the single tile of the last level)
+		void getRange(float* lo, float* hi);
+		///returns the bytes of all tiles
+		size_t getMemory();
+};
+#endif
@@ -0,0 +1,171 @@
+#include "FlowMipPyramid.h"
+#include "FlowChannel.h"
+#include <math.h>
+
+FlowMipPyramid::FlowMipPyramid(FlowChannel* c, FlowGeometry* g)
+{
+	channel = c;
+	geometry = g;
+	revision = c->getRevision();
+}
+
+FlowMipPyramid::~FlowMipPyramid()
+{
+	release();
+}
+
+void FlowMipPyramid::release()
+{
+	for (int r = 0; r < MIP_REDUCTIONS; r++)
+	{
+		for (size_t l = 0; l < levels[r].size(); l++)
+			delete levels[r][l];
+		levels[r].clear();
+	}
+}
+
+///combines two values according to the reduction (the average is handled by the callers)
+static inline float combine(float a, float b, MipReduction reduction)
+{
+	switch (reduction)
+	{
+	case MIP_MIN:
+		return (b < a) ? b : a;
+	case MIP_MAX:
+		return (b > a) ? b : a;
+	default:
+		return (fabs(b) > fabs(a)) ? b : a;
+	}
+}
+
+void FlowMipPyramid::reduce(FlowChannel* fine, FlowGeometry* fineGeometry, FlowChannel* coarse, FlowGeometry* coarseGeometry, MipReduction reduction)
+{
+	int fineX = fineGeometry->getDimX();
+	int fineY = fineGeometry->getDimY();
+	int coarseX = coarseGeometry->getDimX();
+	int coarseY = coarseGeometry->getDimY();
+	const float* src = fine->getValueArray();
+	float* dst = coarse->beginUpdate();
+	bool rowMajor = (fineGeometry->getVertexOrder() == ORDER_ROW_MAJOR);
+
+	#pragma omp parallel
+	{
+		//one fine row and the (at most three) fine rows reduced along X
+		float* row = new float[fineX];
+		float* reduced = new float[3*coarseX];
+		#pragma omp for schedule(static)
+		for (int j = 0; j < coarseY; j++)
+		{
+			int center = FlowGeometry::getFinerIndex(j, fineY);
+			int first = (center > 0) ? center - 1 : 0;
+			int last = (center < fineY - 1) ? center + 1 : fineY - 1;
+			for (int y = first; y <= last; y++)
+			{
+				const float* line = row;
+				if (rowMajor)
+					line = src + y*fineX;
+				else
+					for (int x = 0; x < fineX; x++)
+						row[x] = src[fineGeometry->getVtx(x,y)];
+				float* out = reduced + (y - first)*coarseX;
+				for (int i = 0; i < coarseX; i++)
+				{
+					int c = FlowGeometry::getFinerIndex(i, fineX);
+					bool left = (c > 0);
+					bool right = (c < fineX - 1);
+					if (reduction == MIP_AVERAGE)
+					{
+						//tent weights, renormalized at the boundary
+						float sum = 2.0f*line[c];
+						float weight = 2.0f;
+						if (left) { sum += line[c-1]; weight += 1.0f; }
+						if (right) { sum += line[c+1]; weight += 1.0f; }
+						out[i] = sum / weight;
+					}
+					else
+					{
+						float v = line[c];
+						if (left) v = combine(v, line[c-1], reduction);
+						if (right) v = combine(v, line[c+1], reduction);
+						out[i] = v;
+					}
+				}
+			}
+			//now the same along Y, the center row is the one at center - first
+			int middle = center - first;
+			int rows = last - first + 1;
+			for (int i = 0; i < coarseX; i++)
+			{
+				float v;
+				if (reduction == MIP_AVERAGE)
+				{
+					float sum = 2.0f*reduced[middle*coarseX + i];
+					float weight = 2.0f;
+					for (int k = 0; k < rows; k++)
+						if (k != middle)
+						{
+							sum += reduced[k*coarseX + i];
+							weight += 1.0f;
+						}
+					v = sum / weight;
+				}
+				else
+				{
+					v = reduced[i];
+					for (int k = 1; k < rows; k++)
+						v = combine(v, reduced[k*coarseX + i], reduction);
+				}
+				dst[coarseGeometry->getVtx(i,j)] = v;
+			}
+		}
+		delete[] row;
+		delete[] reduced;
+	}
+	coarse->endUpdate();
+}
+
+FlowChannel* FlowMipPyramid::getLevel(int level, MipReduction reduction)
+{
+	if (level <= 0)
+		return channel;
+	if (revision != channel->getRevision())
+	{
+		release();
+		revision = channel->getRevision();
+	}
+	std::vector<FlowChannel*>& built = levels[reduction];
+	while ((int)built.size() < level)
+	{
+		int l = (int)built.size() + 1;
+		FlowGeometry* fineGeometry = geometry->getLevel(l - 1);
+		FlowGeometry* coarseGeometry = geometry->getLevel(l);
+		//the coarsest level of the geometry was reached
+		if (coarseGeometry == fineGeometry)
+			break;
+		FlowChannel* coarse = new FlowChannel(coarseGeometry);
+		reduce(built.empty() ? channel : built.back(), fineGeometry, coarse, coarseGeometry, reduction);
+		built.push_back(coarse);
+	}
+	if (built.empty())
+		return channel;
+	return ((int)built.size() < level) ? built.back() : built[level - 1];
+}
+
+FlowGeometry* FlowMipPyramid::getGeometry(int level)
+{
+	return geometry->getLevel(level);
+}
+
+int FlowMipPyramid::findLevel(int resX, int resY)
+{
+	return geometry->findLevel(resX, resY);
+}
+
+size_t FlowMipPyramid::getMemory()
+{
+	size_t bytes = 0;
+	for (int r = 0; r < MIP_REDUCTIONS; r++)
+		for (size_t l = 0; l < levels[r].size(); l++)
+			bytes += levels[r][l]->getMemory();
+	return bytes;
+}
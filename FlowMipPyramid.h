@@ -0,0 +1,65 @@
+#ifndef FLOWMIPPYRAMID_H
+#define FLOWMIPPYRAMID_H
+
+#include <stddef.h>
+#include <vector>
+
+class FlowChannel;
+class FlowGeometry;
+
+///how the values of a finer level are combined into a vertex of the next coarser level
+enum MipReduction {
+	///weighted average (tent filter 1/4, 1/2, 1/4 in both directions), for displaying smooth fields
+	MIP_AVERAGE,
+	///minimum of the 3x3 neighbourhood, never larger than any value it stands for
+	MIP_MIN,
+	///maximum of the 3x3 neighbourhood, never smaller than any value it stands for
+	MIP_MAX,
+	///value of the largest magnitude in the 3x3 neighbourhood (with its sign), keeps peaks of signed fields such as vorticity
+	MIP_MAX_ABS,
+	///number of reductions
+	MIP_REDUCTIONS
+};
+
+///downsampled versions of one channel on the coarser levels of its geometry, built on demand
+/**
+* Level l of the pyramid is a FlowChannel defined on FlowGeometry::getLevel(l), so it can be sampled, normalized or analysed like any other channel,
+* only with 4^l times fewer vertices. Vertex (i,j) of a level lies on vertex (2i,2j) of the finer level, its value reduces the values of that vertex and its 8 neighbours.
+* Since the neighbourhoods overlap, MIP_MIN and MIP_MAX bound all values of the cells around a coarse vertex.
+* Every reduction has its own levels, a level is built from the finer level of the same reduction the first time it is asked for.
+* All levels are dropped when the channel is modified.
+*/
+class FlowMipPyramid{
+	private:
+		///the channel at level 0
+		FlowChannel* channel;
+		///geometry of the channel
+		FlowGeometry* geometry;
+		///levels 1, 2, ... of every reduction
+		std::vector<FlowChannel*> levels[MIP_REDUCTIONS];
+		///revision of the channel the levels were built from
+		unsigned int revision;
+
+		///deletes all levels
+		void release();
+		///reduces the values of the finer level into the coarser one, coarse rows in parallel
+		static void reduce(FlowChannel* fine, FlowGeometry* fineGeometry, FlowChannel* coarse, FlowGeometry* coarseGeometry, MipReduction reduction);
+
+		FlowMipPyramid(const FlowMipPyramid&);
+		FlowMipPyramid& operator=(const FlowMipPyramid&);
+	public:
+		///creates an empty pyramid for the channel
+		FlowMipPyramid(FlowChannel* c, FlowGeometry* g);
+		///deletes the levels
+		~FlowMipPyramid();
+
+		///returns the channel at the given level (0 is the channel itself), building it and the missing finer levels. Levels beyond the coarsest one give the coarsest one.
+		FlowChannel* getLevel(int level, MipReduction reduction = MIP_AVERAGE);
+		///returns the geometry of the given level, see FlowGeometry::getLevel
+		FlowGeometry* getGeometry(int level);
+		///returns the coarsest level with at least resX x resY vertices, see FlowGeometry::findLevel
+		int findLevel(int resX, int resY);
+		///returns the bytes of all built levels
+		size_t getMemory();
+};
+#endif
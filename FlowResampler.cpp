@@ -0,0 +1,182 @@
+#include "FlowResampler.h"
+#include "FlowData.h"
+#include <math.h>
+#include <string.h>
+
+///tolerance (in cell coordinates) for pixels lying on the border of a cell
+#define RESAMPLE_EPSILON 1e-4f
+
+FlowResampler::FlowResampler(FlowData* d)
+{
+	data = d;
+}
+
+FlowResampler::~FlowResampler()
+{
+	clearCache();
+}
+
+void FlowResampler::clearCache()
+{
+	//the grids go back to the arena, the next data set of the same size takes them again
+	for (size_t e = 0; e < cache.size(); e++)
+		data->getArena()->release(cache[e].values);
+	cache.clear();
+}
+
+size_t FlowResampler::getMemory()
+{
+	size_t bytes = 0;
+	for (size_t e = 0; e < cache.size(); e++)
+		bytes += (size_t)cache[e].res[0] * cache[e].res[1] * cache[e].channels.size() * sizeof(float);
+	return bytes;
+}
+
+size_t FlowResampler::releaseLeastRecent(unsigned int since)
+{
+	size_t oldest = cache.size();
+	for (size_t e = 0; e < cache.size(); e++)
+		if ((cache[e].lastUse < since) && ((oldest == cache.size()) || (cache[e].lastUse < cache[oldest].lastUse)))
+			oldest = e;
+	if (oldest == cache.size())
+		return 0;
+	size_t bytes = (size_t)cache[oldest].res[0] * cache[oldest].res[1] * cache[oldest].channels.size() * sizeof(float);
+	data->getArena()->release(cache[oldest].values);
+	cache.erase(cache.begin() + oldest);
+	return bytes;
+}
+
+const float* FlowResampler::resample(const int* channels, int count, int resX, int resY, float minX, float minY, float maxX, float maxY)
+{
+	float roi[4] = {minX, minY, maxX, maxY};
+	FlowGeometry* geometry = data->getGeometry();
+	return resampleRegion(channels, count, resX, resY, roi, 0, 0, geometry->getDimX(), geometry->getDimY(), 1);
+}
+
+const float* FlowResampler::resampleRegion(const int* channels, int count, int resX, int resY, const float* roi, int x0, int y0, int x1, int y1, int stride)
+{
+	int range[5] = {x0, y0, x1, y1, stride};
+	if ((count < 1) || (resX < 1) || (resY < 1) || (stride < 1))
+		return NULL;
+
+	//already computed?
+	for (size_t e = 0; e < cache.size(); e++)
+	{
+		CacheEntry& entry = cache[e];
+		if ((entry.res[0] != resX) || (entry.res[1] != resY) || ((int)entry.channels.size() != count) || memcmp(entry.roi, roi, sizeof(entry.roi)) || memcmp(entry.range, range, sizeof(range)))
+			continue;
+		bool same = true;
+		for (int c = 0; c < count; c++)
+			same = same && (entry.channels[c] == channels[c]);
+		if (!same)
+			continue;
+		//the inputs are in use as long as their result is, otherwise they would be spilled while the grid is shown
+		bool current = true;
+		for (int c = 0; c < count; c++)
+			current = (data->touchChannel(channels[c])->getRevision() == entry.revisions[c]) && current;
+		if (current)
+		{
+			entry.lastUse = data->getMemory()->getClock();
+			return entry.values;
+		}
+		//a channel was modified in place, the grid is computed again
+		data->getArena()->release(entry.values);
+		cache.erase(cache.begin() + e);
+		break;
+	}
+
+	FlowChannel** ch = new FlowChannel*[count];
+	for (int c = 0; c < count; c++)
+	{
+		if (!data->hasChannel(channels[c]))
+		{
+			std::cerr << "Cannot resample the non-existing channel " << channels[c] << "." << std::endl;
+			delete[] ch;
+			return NULL;
+		}
+		ch[c] = data->getChannel(channels[c]);
+	}
+
+	FlowGeometry* geometry = data->getGeometry();
+	//number of rasterized vertices in each dimension, the cells lie between them
+	int vertsX = (x1 - x0 + stride - 1) / stride;
+	int vertsY = (y1 - y0 + stride - 1) / stride;
+	size_t size = (size_t)resX*resY*count;
+	float* values = data->getArena()->allocate<float>(size);
+	if (!values)
+	{
+		delete[] ch;
+		return NULL;
+	}
+	memset(values, 0, size * sizeof(float));
+
+	//neighbouring cells may both claim the pixels on their common border, cells two rows apart never do. Rasterizing the even and the odd rows in two passes avoids any locking.
+	for (int pass = 0; pass < 2; pass++)
+	{
+		#pragma omp parallel for schedule(dynamic, 4)
+		for (int cy = pass; cy < vertsY - 1; cy += 2)
+			for (int cx = 0; cx < vertsX - 1; cx++)
+				rasterizeCell(geometry, ch, count, x0 + cx*stride, y0 + cy*stride, x0 + (cx+1)*stride, y0 + (cy+1)*stride, roi, resX, resY, values);
+	}
+
+	CacheEntry entry;
+	entry.channels.assign(channels, channels + count);
+	for (int c = 0; c < count; c++)
+		entry.revisions.push_back(ch[c]->getRevision());
+	delete[] ch;
+	memcpy(entry.roi, roi, sizeof(entry.roi));
+	memcpy(entry.range, range, sizeof(range));
+	entry.res[0] = resX;
+	entry.res[1] = resY;
+	entry.values = values;
+	entry.lastUse = data->getMemory()->getClock();
+	cache.push_back(entry);
+	return values;
+}
+
+void FlowResampler::rasterizeCell(FlowGeometry* geometry, FlowChannel** ch, int count, int x0, int y0, int x1, int y1, const float* roi, int resX, int resY, float* dst)
+{
+	int vtx[4] = {geometry->getVtx(x0,y0), geometry->getVtx(x1,y0), geometry->getVtx(x0,y1), geometry->getVtx(x1,y1)};
+	float p[4][2];
+	for (int v = 0; v < 4; v++)
+	{
+		p[v][0] = geometry->getPosX(vtx[v]);
+		p[v][1] = geometry->getPosY(vtx[v]);
+	}
+
+	//bounding box of the cell in pixels, only pixel centers inside of it can belong to the cell
+	float cellMin[2], cellMax[2];
+	int pixelMin[2], pixelMax[2];
+	int res[2] = {resX, resY};
+	for (int d = 0; d < 2; d++)
+	{
+		cellMin[d] = cellMax[d] = p[0][d];
+		for (int v = 1; v < 4; v++)
+		{
+			cellMin[d] = (p[v][d] < cellMin[d]) ? p[v][d] : cellMin[d];
+			cellMax[d] = (p[v][d] > cellMax[d]) ? p[v][d] : cellMax[d];
+		}
+		float scale = res[d] / (roi[d+2] - roi[d]);
+		pixelMin[d] = (int)ceil((cellMin[d] - roi[d]) * scale - 0.5f);
+		pixelMax[d] = (int)floor((cellMax[d] - roi[d]) * scale - 0.5f);
+		pixelMin[d] = (pixelMin[d] < 0) ? 0 : pixelMin[d];
+		pixelMax[d] = (pixelMax[d] > res[d] - 1) ? res[d] - 1 : pixelMax[d];
+	}
+
+	for (int py = pixelMin[1]; py <= pixelMax[1]; py++)
+		for (int px = pixelMin[0]; px <= pixelMax[0]; px++)
+		{
+			float cx = roi[0] + (px + 0.5f) * (roi[2] - roi[0]) / resX;
+			float cy = roi[1] + (py + 0.5f) * (roi[3] - roi[1]) / resY;
+			float s, t;
+			if (!FlowGeometry::invertBilinear(p[0], p[1], p[2], p[3], cx, cy, &s, &t))
+				continue;
+			if ((s < -RESAMPLE_EPSILON) || (t < -RESAMPLE_EPSILON) || (s > 1.0f + RESAMPLE_EPSILON) || (t > 1.0f + RESAMPLE_EPSILON))
+				continue;
+			s = (s < 0.0f) ? 0.0f : ((s > 1.0f) ? 1.0f : s);
+			t = (t < 0.0f) ? 0.0f : ((t > 1.0f) ? 1.0f : t);
+			float* pixel = dst + ((size_t)py*resX + px)*count;
+			for (int c = 0; c < count; c++)
+				pixel[c] = (1-t)*((1-s)*ch[c]->getValue(vtx[0]) + s*ch[c]->getValue(vtx[1])) + t*((1-s)*ch[c]->getValue(vtx[2]) + s*ch[c]->getValue(vtx[3]));
+		}
+}
@@ -0,0 +1,76 @@
+#ifndef FLOWRESAMPLER_H
+#define FLOWRESAMPLER_H
+
+#include <stddef.h>
+#include <vector>
+
+class FlowData;
+class FlowGeometry;
+class FlowChannel;
+
+///resamples channels of the curvilinear grid onto a regular grid, entirely on the CPU
+/**
+* Every cell of the curvilinear grid is rasterized into the target grid: the pixel centers inside of the bounding box of the cell
+* are mapped back to the cell by inverting its bilinear mapping, and the channels are interpolated bilinearly there.
+* The region of interest is given in normalized coordinates <0..1>, pixel (px,py) of the result lies at the center
+* minX + (px+0.5)*(maxX-minX)/resX, minY + (py+0.5)*(maxY-minY)/resY. Pixels not covered by any cell are 0.
+* Results are cached per (channels, region of interest, resolution) until clearCache is called, which FlowData does whenever channels are deleted or reloaded.
+* To stay within its memory budget FlowData may also drop results not requested since its last enforcement (see FlowData::enforceBudget),
+* so a result should be requested again rather than kept across frames; a cache hit costs a few comparisons.
+*/
+class FlowResampler{
+	private:
+		///one cached resampling result
+		struct CacheEntry{
+			///ids of the resampled channels, in the order of the components
+			std::vector<int> channels;
+			///revisions of the channels at the time of the resampling, a modified channel makes the entry stale
+			std::vector<unsigned int> revisions;
+			///region of interest as {minX, minY, maxX, maxY}
+			float roi[4];
+			///resolution of the target grid
+			int res[2];
+			///rasterized vertex range as {x0, y0, x1, y1, stride}
+			int range[5];
+			///resX*resY pixels, row-major, channels.size() values per pixel
+			float* values;
+			///time of the use clock of the data set (see FlowMemory) of the last request
+			unsigned int lastUse;
+		};
+
+		///the data set the channels belong to
+		FlowData* data;
+		///all cached results
+		std::vector<CacheEntry> cache;
+
+		///rasterizes the cell spanned by the vertices (x0,y0) and (x1,y1) into dst
+		void rasterizeCell(FlowGeometry* geometry, FlowChannel** ch, int count, int x0, int y0, int x1, int y1, const float* roi, int resX, int resY, float* dst);
+
+		FlowResampler(const FlowResampler&);
+		FlowResampler& operator=(const FlowResampler&);
+	public:
+		///creates a resampler for the channels of the given data set
+		FlowResampler(FlowData* d);
+		///frees all cached results
+		~FlowResampler();
+
+		///returns the given channels resampled onto a resX x resY grid covering the region of interest (normalized coordinates)
+		/**
+		* @param channels ids of the channels, every pixel of the result holds one value per channel in this order
+		* @param count number of channels
+		* @return resX*resY*count values, row-major, owned by the resampler and valid until clearCache, until they are evicted or until the next request after one of the channels was modified. NULL if a channel does not exist.
+		*/
+		const float* resample(const int* channels, int count, int resX, int resY, float minX = 0.0f, float minY = 0.0f, float maxX = 1.0f, float maxY = 1.0f);
+		///same as resample, but only rasterizes the cells between the vertices x0 <= x < x1, y0 <= y < y1 taking every stride-th vertex (see FlowView)
+		/**
+		* @param roi region of interest in normalized coordinates as {minX, minY, maxX, maxY}
+		*/
+		const float* resampleRegion(const int* channels, int count, int resX, int resY, const float* roi, int x0, int y0, int x1, int y1, int stride);
+		///drops all cached results, e.g. when the geometry changes. Modified channels are detected by their revisions and need no call.
+		void clearCache();
+		///returns the bytes of all cached results
+		size_t getMemory();
+		///drops the result used least recently, unless it was requested at or after the time since of the use clock. Returns the bytes freed, 0 if nothing was dropped.
+		size_t releaseLeastRecent(unsigned int since);
+};
+#endif
@@ -0,0 +1,241 @@
+#include "FlowSampler.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FLOW_SSE
+#endif
+
+FlowSampler::FlowSampler(FlowGeometry* g)
+{
+	geometry = g;
+	count = 0;
+	capacity = 0;
+	numValid = 0;
+	valid = NULL;
+	cellX = cellY = NULL;
+	cellS = cellT = NULL;
+	for (int c = 0; c < 4; c++)
+	{
+		vtx[c] = NULL;
+		weight[c] = NULL;
+	}
+}
+
+FlowSampler::~FlowSampler()
+{
+	for (int c = 0; c < 4; c++)
+	{
+		alignedFree(vtx[c]);
+		alignedFree(weight[c]);
+	}
+	alignedFree(valid);
+	alignedFree(cellX);
+	alignedFree(cellY);
+	alignedFree(cellS);
+	alignedFree(cellT);
+}
+
+void FlowSampler::reserve(int n)
+{
+	if (n <= capacity)
+		return;
+	capacity = n;
+	for (int c = 0; c < 4; c++)
+	{
+		alignedFree(vtx[c]);
+		alignedFree(weight[c]);
+		vtx[c] = alignedAlloc<int>(capacity);
+		weight[c] = alignedAlloc<float>(capacity);
+	}
+	alignedFree(valid);
+	alignedFree(cellX);
+	alignedFree(cellY);
+	alignedFree(cellS);
+	alignedFree(cellT);
+	valid = alignedAlloc<unsigned char>(capacity);
+	cellX = alignedAlloc<int>(capacity);
+	cellY = alignedAlloc<int>(capacity);
+	cellS = alignedAlloc<float>(capacity);
+	cellT = alignedAlloc<float>(capacity);
+}
+
+void FlowSampler::locate(const float* x, const float* y, int n)
+{
+	reserve(n);
+	count = n;
+	int found = 0;
+
+	#pragma omp parallel for schedule(static) reduction(+:found)
+	for (int p = 0; p < n; p++)
+	{
+		int cx, cy;
+		float s, t;
+		if (geometry->locateCell(x[p], y[p], &cx, &cy, &s, &t))
+		{
+			vtx[0][p] = geometry->getVtx(cx, cy);
+			vtx[1][p] = geometry->getVtx(cx+1, cy);
+			vtx[2][p] = geometry->getVtx(cx, cy+1);
+			vtx[3][p] = geometry->getVtx(cx+1, cy+1);
+			weight[0][p] = (1-s)*(1-t);
+			weight[1][p] = s*(1-t);
+			weight[2][p] = (1-s)*t;
+			weight[3][p] = s*t;
+			cellX[p] = cx;
+			cellY[p] = cy;
+			cellS[p] = s;
+			cellT[p] = t;
+			valid[p] = 1;
+			found++;
+		}
+		else
+		{
+			//vertex 0 with zero weights gives 0 without any branch in sample
+			for (int c = 0; c < 4; c++)
+			{
+				vtx[c][p] = 0;
+				weight[c][p] = 0.0f;
+			}
+			cellX[p] = cellY[p] = 0;
+			cellS[p] = cellT[p] = 0.0f;
+			valid[p] = 0;
+		}
+	}
+	numValid = found;
+}
+
+void FlowSampler::sample(FlowChannel* channel, float* out)
+{
+	const float* values = channel->getValueArray();
+	int groups = count / 4;
+
+	#pragma omp parallel for schedule(static)
+	for (int g = 0; g < groups; g++)
+	{
+		int p = g*4;
+#ifdef FLOW_SSE
+		//there is no gather in SSE, the values are collected by hand, the weighting runs on all 4 positions at once
+		__m128 sum = _mm_mul_ps(_mm_load_ps(weight[0] + p), _mm_set_ps(values[vtx[0][p+3]], values[vtx[0][p+2]], values[vtx[0][p+1]], values[vtx[0][p]]));
+		for (int c = 1; c < 4; c++)
+		{
+			__m128 v = _mm_set_ps(values[vtx[c][p+3]], values[vtx[c][p+2]], values[vtx[c][p+1]], values[vtx[c][p]]);
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(weight[c] + p), v));
+		}
+		_mm_storeu_ps(out + p, sum);
+#else
+		for (int q = p; q < p + 4; q++)
+			out[q] = weight[0][q]*values[vtx[0][q]] + weight[1][q]*values[vtx[1][q]] + weight[2][q]*values[vtx[2][q]] + weight[3][q]*values[vtx[3][q]];
+#endif
+	}
+	//the remaining positions
+	for (int q = groups*4; q < count; q++)
+		out[q] = weight[0][q]*values[vtx[0][q]] + weight[1][q]*values[vtx[1][q]] + weight[2][q]*values[vtx[2][q]] + weight[3][q]*values[vtx[3][q]];
+}
+
+void FlowSampler::sampleGradient(FlowChannel* channel, float* out, float* gradX, float* gradY)
+{
+	const float* values = channel->getValueArray();
+	//the cells work in normalized coordinates, the physical gradient is scaled by the size of the domain
+	float sizeX = geometry->getMaxX() - geometry->getMinX();
+	float sizeY = geometry->getMaxY() - geometry->getMinY();
+	float scaleX = (sizeX != 0.0f) ? 1.0f / sizeX : 0.0f;
+	float scaleY = (sizeY != 0.0f) ? 1.0f / sizeY : 0.0f;
+	int groups = count / 4;
+
+#ifdef FLOW_SSE
+	#pragma omp parallel for schedule(static)
+	for (int g = 0; g < groups; g++)
+	{
+		int p = g*4;
+		__m128 f[4], x[4], y[4];
+		for (int c = 0; c < 4; c++)
+		{
+			const int* v = vtx[c] + p;
+			f[c] = _mm_set_ps(values[v[3]], values[v[2]], values[v[1]], values[v[0]]);
+			x[c] = _mm_set_ps(geometry->getPosX(v[3]), geometry->getPosX(v[2]), geometry->getPosX(v[1]), geometry->getPosX(v[0]));
+			y[c] = _mm_set_ps(geometry->getPosY(v[3]), geometry->getPosY(v[2]), geometry->getPosY(v[1]), geometry->getPosY(v[0]));
+		}
+		__m128 s = _mm_load_ps(cellS + p);
+		__m128 t = _mm_load_ps(cellT + p);
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 s1 = _mm_sub_ps(one, s);
+		__m128 t1 = _mm_sub_ps(one, t);
+
+		//the invalid positions have zero weights, so the value is 0 there
+		__m128 value = _mm_mul_ps(_mm_load_ps(weight[0] + p), f[0]);
+		for (int c = 1; c < 4; c++)
+			value = _mm_add_ps(value, _mm_mul_ps(_mm_load_ps(weight[c] + p), f[c]));
+
+		//derivatives along s and t, vertices 0..3 are lower left, lower right, upper left, upper right
+		#define ALONG_S(a) _mm_add_ps(_mm_mul_ps(t1, _mm_sub_ps(a[1], a[0])), _mm_mul_ps(t, _mm_sub_ps(a[3], a[2])))
+		#define ALONG_T(a) _mm_add_ps(_mm_mul_ps(s1, _mm_sub_ps(a[2], a[0])), _mm_mul_ps(s, _mm_sub_ps(a[3], a[1])))
+		__m128 fs = ALONG_S(f), ft = ALONG_T(f);
+		__m128 xs = ALONG_S(x), xt = ALONG_T(x);
+		__m128 ys = ALONG_S(y), yt = ALONG_T(y);
+		#undef ALONG_S
+		#undef ALONG_T
+
+		//degenerate cells (and the invalid positions, whose vertices all coincide) get a zero gradient
+		__m128 det = _mm_sub_ps(_mm_mul_ps(xs, yt), _mm_mul_ps(xt, ys));
+		__m128 nonZero = _mm_cmpneq_ps(det, _mm_setzero_ps());
+		__m128 inverse = _mm_and_ps(nonZero, _mm_div_ps(one, _mm_or_ps(det, _mm_andnot_ps(nonZero, one))));
+		__m128 gx = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(yt, fs), _mm_mul_ps(ys, ft)), inverse);
+		__m128 gy = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(xs, ft), _mm_mul_ps(xt, fs)), inverse);
+		_mm_storeu_ps(out + p, value);
+		_mm_storeu_ps(gradX + p, _mm_mul_ps(gx, _mm_set1_ps(scaleX)));
+		_mm_storeu_ps(gradY + p, _mm_mul_ps(gy, _mm_set1_ps(scaleY)));
+	}
+#else
+	groups = 0;
+#endif
+	#pragma omp parallel for schedule(static)
+	for (int q = groups*4; q < count; q++)
+	{
+		float gradient[2] = {0.0f, 0.0f};
+		out[q] = 0.0f;
+		if (valid[q])
+			sampleBilinearGradient(values, geometry, cellX[q], cellY[q], cellS[q], cellT[q], out + q, gradient);
+		gradX[q] = gradient[0] * scaleX;
+		gradY[q] = gradient[1] * scaleY;
+	}
+}
+
+void FlowSampler::sample(FlowChannel** channels, int numChannels, float** out)
+{
+	//the cells were located once, every channel only repeats the weighting
+	for (int c = 0; c < numChannels; c++)
+		sample(channels[c], out[c]);
+}
+
+void FlowSampler::sample(FlowChannel* channel, float* out, InterpolationMode mode)
+{
+	switch (mode)
+	{
+		case INTERPOLATE_NEAREST:
+			sampleWith<InterpolateNearest>(channel, out);
+			break;
+		case INTERPOLATE_CATMULL_ROM:
+			sampleWith<InterpolateCatmullRom>(channel, out);
+			break;
+		case INTERPOLATE_MONOTONE_CUBIC:
+			sampleWith<InterpolateMonotoneCubic>(channel, out);
+			break;
+		default:
+			//the precomputed weights are faster than the generic policy
+			sample(channel, out);
+	}
+}
+
+int FlowSampler::getCount()
+{
+	return count;
+}
+
+int FlowSampler::getNumValid()
+{
+	return numValid;
+}
+
+const unsigned char* FlowSampler::getValid()
+{
+	return valid;
+}
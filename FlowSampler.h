@@ -0,0 +1,85 @@
+#ifndef FLOWSAMPLER_H
+#define FLOWSAMPLER_H
+
+#include "FlowGeometry.h"
+#include "FlowChannel.h"
+#include "interpolation.h"
+
+///samples channels at many positions at once
+/**
+* locate finds the cells of a batch of positions once and keeps the four vertices and bilinear weights of every position,
+* sample then interpolates any number of channels at these positions, bilinearly four positions at a time with SSE where available,
+* or with any interpolation policy (see interpolation.h) chosen once per call. sampleGradient differentiates the bilinear interpolant at the same time.
+* Positions outside of the grid get a validity flag of 0 and the value 0, nothing is printed.
+* The buffers only grow, so sampling batches of similar size every frame does not allocate.
+*/
+class FlowSampler{
+	private:
+		///the geometry the positions are located in
+		FlowGeometry* geometry;
+		///number of located positions
+		int count;
+		///number of positions the buffers can hold
+		int capacity;
+		///the four vertices of the cell of every position (lower left, lower right, upper left, upper right)
+		int* vtx[4];
+		///the bilinear weights of the four vertices for every position, 0 for invalid positions
+		float* weight[4];
+		///the cell (lower left vertex) and the cell coordinates of every position, used by the interpolation policies
+		int* cellX;
+		///see cellX
+		int* cellY;
+		///see cellX
+		float* cellS;
+		///see cellX
+		float* cellT;
+		///1 for positions inside of the grid, 0 otherwise
+		unsigned char* valid;
+		///number of valid positions
+		int numValid;
+
+		///makes the buffers big enough for n positions
+		void reserve(int n);
+
+		FlowSampler(const FlowSampler&);
+		FlowSampler& operator=(const FlowSampler&);
+	public:
+		///creates a sampler for the given geometry
+		FlowSampler(FlowGeometry* g);
+		///frees the buffers
+		~FlowSampler();
+
+		///locates n positions (in normalized coordinates <0..1>) given as separate x and y arrays
+		void locate(const float* x, const float* y, int n);
+		///interpolates the channel at all located positions, out receives getCount() values
+		void sample(FlowChannel* channel, float* out);
+		///interpolates several channels at all located positions, out[c] receives getCount() values of channels[c]
+		void sample(FlowChannel** channels, int numChannels, float** out);
+		///interpolates the channel at all located positions with the given scheme, the choice is made once for the whole batch
+		void sample(FlowChannel* channel, float* out, InterpolationMode mode);
+		///interpolates the channel bilinearly at all located positions together with its gradient in physical units, from the same cells and vertices
+		/**
+		* Four positions at a time with SSE where available. Invalid positions get the value 0 and a zero gradient.
+		* @param gradX receives d/dx of every position
+		* @param gradY receives d/dy of every position
+		*/
+		void sampleGradient(FlowChannel* channel, float* out, float* gradX, float* gradY);
+		///interpolates the channel at all located positions with the interpolation policy given as template parameter, invalid positions get 0
+		template < class Policy > void sampleWith(FlowChannel* channel, float* out);
+
+		///returns the number of located positions
+		int getCount();
+		///returns the number of located positions inside of the grid
+		int getNumValid();
+		///returns the validity flags of the located positions (1 inside of the grid, 0 outside)
+		const unsigned char* getValid();
+};
+
+template < class Policy > void FlowSampler::sampleWith(FlowChannel* channel, float* out)
+{
+	const float* values = channel->getValueArray();
+	#pragma omp parallel for schedule(static)
+	for (int p = 0; p < count; p++)
+		out[p] = valid[p] ? Policy::sample(values, geometry, cellX[p], cellY[p], cellS[p], cellT[p]) : 0.0f;
+}
+#endif
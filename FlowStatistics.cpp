@@ -0,0 +1,385 @@
+#include "FlowStatistics.h"
+#include "FlowChannel.h"
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FLOW_SSE
+#endif
+
+FlowStatistics::FlowStatistics(FlowChannel* c, FlowGeometry* g)
+{
+	channel = c;
+	geometry = g;
+	numBins = 0;
+	bins = NULL;
+	rangeMin = rangeMax = 0.0f;
+	count = 0;
+	mean = variance = 0.0;
+	revision = 0;
+	maskRevision = 0;
+	robustTail = -1.0f;
+	robustMin = robustMax = 0.0f;
+	computed = false;
+}
+
+FlowStatistics::~FlowStatistics()
+{
+	delete[] bins;
+}
+
+void FlowStatistics::histogram(FlowChannel* c, FlowGeometry* g, int numBins, float lo, float hi, int* dst, double* sum, double* sumSquares)
+{
+	const float* values = c->getValueArray();
+	int dimX = g->getDimX();
+	int dimY = g->getDimY();
+	bool rowMajor = (g->getVertexOrder() == ORDER_ROW_MAJOR);
+	float scale = (hi > lo) ? numBins / (hi - lo) : 0.0f;
+	float top = (float)(numBins - 1);
+
+	int numThreads = 1;
+#ifdef _OPENMP
+	numThreads = omp_get_max_threads();
+#endif
+	//one private histogram per thread, merged at the end
+	int* local = new int[numThreads * numBins]();
+	double totalSum = 0.0;
+	double totalSquares = 0.0;
+
+	#pragma omp parallel reduction(+:totalSum,totalSquares)
+	{
+		int thread = 0;
+#ifdef _OPENMP
+		thread = omp_get_thread_num();
+#endif
+		int* hist = local + thread*numBins;
+		//rows of the tiled orders are not contiguous, they are gathered first
+		float* row = rowMajor ? NULL : new float[dimX];
+		//only the valid vertices count, see FlowMask
+		int* runs = new int[dimX + 1];
+
+		#pragma omp for schedule(static)
+		for (int y = 0; y < dimY; y++)
+		{
+			int numRuns = g->getValidRuns(y, runs);
+			if (numRuns == 0)
+				continue;
+			const float* src = values + y*dimX;
+			if (!rowMajor)
+			{
+				for (int x = 0; x < dimX; x++)
+					row[x] = values[g->getVtx(x,y)];
+				src = row;
+			}
+			for (int r = 0; r < numRuns; r++)
+			{
+				int x = runs[2*r];
+				int end = runs[2*r + 1];
+#ifdef FLOW_SSE
+				__m128 vLo = _mm_set1_ps(lo);
+				__m128 vScale = _mm_set1_ps(scale);
+				__m128 vZero = _mm_setzero_ps();
+				__m128 vTop = _mm_set1_ps(top);
+				__m128d vSum = _mm_setzero_pd();
+				__m128d vSquares = _mm_setzero_pd();
+				for (; x + 4 <= end; x += 4)
+				{
+					__m128 v = _mm_loadu_ps(src + x);
+					//the bin index is clamped while still a float, NaN ends up in bin 0
+					__m128 f = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(v, vLo), vScale), vZero), vTop);
+					int index[4];
+					_mm_storeu_si128((__m128i*)index, _mm_cvttps_epi32(f));
+					hist[index[0]]++;
+					hist[index[1]]++;
+					hist[index[2]]++;
+					hist[index[3]]++;
+					__m128d low = _mm_cvtps_pd(v);
+					__m128d high = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+					vSum = _mm_add_pd(vSum, _mm_add_pd(low, high));
+					vSquares = _mm_add_pd(vSquares, _mm_add_pd(_mm_mul_pd(low, low), _mm_mul_pd(high, high)));
+				}
+				double partial[2];
+				_mm_storeu_pd(partial, vSum);
+				totalSum += partial[0] + partial[1];
+				_mm_storeu_pd(partial, vSquares);
+				totalSquares += partial[0] + partial[1];
+#endif
+				for (; x < end; x++)
+				{
+					float f = (src[x] - lo) * scale;
+					f = (f > 0.0f) ? ((f < top) ? f : top) : 0.0f;
+					hist[(int)f]++;
+					totalSum += src[x];
+					totalSquares += (double)src[x]*src[x];
+				}
+			}
+		}
+		delete[] row;
+		delete[] runs;
+	}
+
+	for (int b = 0; b < numBins; b++)
+	{
+		int n = 0;
+		for (int t = 0; t < numThreads; t++)
+			n += local[t*numBins + b];
+		dst[b] = n;
+	}
+	delete[] local;
+	if (sum)
+		*sum = totalSum;
+	if (sumSquares)
+		*sumSquares = totalSquares;
+}
+
+void FlowStatistics::compute(int n)
+{
+	if (n != numBins)
+	{
+		delete[] bins;
+		numBins = n;
+		bins = new int[numBins];
+	}
+	rangeMin = channel->getMin();
+	rangeMax = channel->getMax();
+	count = geometry->getNumValid();
+	double sum, sumSquares;
+	histogram(channel, geometry, numBins, rangeMin, rangeMax, bins, &sum, &sumSquares);
+	mean = (count > 0) ? sum / count : 0.0;
+	variance = (count > 0) ? sumSquares / count - mean*mean : 0.0;
+	variance = (variance > 0.0) ? variance : 0.0;
+	revision = channel->getRevision();
+	maskRevision = geometry->getMaskRevision();
+	robustTail = -1.0f;
+	computed = true;
+}
+
+bool FlowStatistics::isCurrent()
+{
+	return computed && (revision == channel->getRevision()) && (maskRevision == geometry->getMaskRevision());
+}
+
+int FlowStatistics::getNumBins()
+{
+	return numBins;
+}
+
+const int* FlowStatistics::getHistogram()
+{
+	return bins;
+}
+
+float FlowStatistics::getRangeMin()
+{
+	return rangeMin;
+}
+
+float FlowStatistics::getRangeMax()
+{
+	return rangeMax;
+}
+
+int FlowStatistics::getCount()
+{
+	return count;
+}
+
+double FlowStatistics::getMean()
+{
+	return mean;
+}
+
+double FlowStatistics::getVariance()
+{
+	return variance;
+}
+
+float FlowStatistics::getPercentile(float p)
+{
+	if (count == 0)
+		return 0.0f;
+	p = (p < 0.0f) ? 0.0f : ((p > 1.0f) ? 1.0f : p);
+	int rank = (int)(p * (count - 1));
+	int first = 0;
+	int b = 0;
+	while (b < numBins - 1 && rank >= first + bins[b])
+		first += bins[b++];
+	//the values are assumed to be spread evenly over the bin
+	float width = (rangeMax - rangeMin) / numBins;
+	return rangeMin + width * (b + (rank - first + 0.5f) / bins[b]);
+}
+
+int FlowStatistics::scanWindow(float lo, float hi, int* hist, int* inside)
+{
+	const float* values = channel->getValueArray();
+	int dimX = geometry->getDimX();
+	int dimY = geometry->getDimY();
+	bool rowMajor = (geometry->getVertexOrder() == ORDER_ROW_MAJOR);
+	float scale = (hi > lo) ? numBins / (hi - lo) : 0.0f;
+	float top = (float)(numBins - 1);
+	int numThreads = 1;
+#ifdef _OPENMP
+	numThreads = omp_get_max_threads();
+#endif
+	int* local = new int[numThreads * numBins]();
+	int below = 0;
+	int in = 0;
+	#pragma omp parallel reduction(+:below,in)
+	{
+		int thread = 0;
+#ifdef _OPENMP
+		thread = omp_get_thread_num();
+#endif
+		int* h = local + thread*numBins;
+		float* row = rowMajor ? NULL : new float[dimX];
+		int* runs = new int[dimX + 1];
+		#pragma omp for schedule(static)
+		for (int y = 0; y < dimY; y++)
+		{
+			int numRuns = geometry->getValidRuns(y, runs);
+			if (numRuns == 0)
+				continue;
+			const float* src = values + y*dimX;
+			if (!rowMajor)
+			{
+				for (int x = 0; x < dimX; x++)
+					row[x] = values[geometry->getVtx(x,y)];
+				src = row;
+			}
+			for (int r = 0; r < numRuns; r++)
+				for (int x = runs[2*r]; x < runs[2*r + 1]; x++)
+				{
+					float value = src[x];
+					if (value < lo)
+						below++;
+					else if (value <= hi)
+					{
+						float f = (value - lo) * scale;
+						h[(int)((f < top) ? f : top)]++;
+						in++;
+					}
+				}
+		}
+		delete[] row;
+		delete[] runs;
+	}
+	for (int b = 0; b < numBins; b++)
+	{
+		hist[b] = 0;
+		for (int t = 0; t < numThreads; t++)
+			hist[b] += local[t*numBins + b];
+	}
+	delete[] local;
+	*inside = in;
+	return below;
+}
+
+float FlowStatistics::getPercentileExact(float p)
+{
+	if (count == 0)
+		return 0.0f;
+	if (rangeMax <= rangeMin)
+		return rangeMin;
+	p = (p < 0.0f) ? 0.0f : ((p > 1.0f) ? 1.0f : p);
+	double position = p * (double)(count - 1);
+	int rank = (int)position;
+	int next = (rank + 1 < count) ? rank + 1 : rank;
+
+	//the window <lo, hi> holds the values with the ranks below+0 .. below+inside-1, at first all of them
+	float lo = rangeMin;
+	float hi = rangeMax;
+	int below = 0;
+	int inside = count;
+	int* hist = new int[numBins];
+	for (int b = 0; b < numBins; b++)
+		hist[b] = bins[b];
+	//the window is narrowed down to the bins holding the two ranks until few enough values are left to select among them
+	for (int pass = 0; inside > STATISTICS_SELECT && pass < STATISTICS_PASSES; pass++)
+	{
+		int first = below;
+		int b0 = 0;
+		while (b0 < numBins - 1 && rank >= first + hist[b0])
+			first += hist[b0++];
+		int b1 = b0;
+		int last = first + hist[b0];
+		while (b1 < numBins - 1 && next >= last)
+			last += hist[++b1];
+		float width = (hi - lo) / numBins;
+		float newLo = lo + b0*width;
+		float newHi = (b1 == numBins - 1) ? hi : lo + (b1 + 1)*width;
+		if (newLo <= lo && newHi >= hi)
+			break;
+		int newInside;
+		int newBelow = scanWindow(newLo, newHi, hist, &newInside);
+		//rounding at the bin borders may move the ranks out of the window, then the last window is kept
+		if (rank < newBelow || next >= newBelow + newInside)
+			break;
+		lo = newLo;
+		hi = newHi;
+		below = newBelow;
+		inside = newInside;
+	}
+	delete[] hist;
+
+	//collects the values of the window, with the same comparisons as scanWindow
+	const float* values = channel->getValueArray();
+	int dimX = geometry->getDimX();
+	int dimY = geometry->getDimY();
+	bool rowMajor = (geometry->getVertexOrder() == ORDER_ROW_MAJOR);
+	std::vector<float> candidates;
+	candidates.reserve(inside);
+	#pragma omp parallel
+	{
+		std::vector<float> found;
+		std::vector<int> runs(dimX + 1);
+		#pragma omp for schedule(static)
+		for (int y = 0; y < dimY; y++)
+		{
+			int numRuns = geometry->getValidRuns(y, &runs[0]);
+			for (int r = 0; r < numRuns; r++)
+				for (int x = runs[2*r]; x < runs[2*r + 1]; x++)
+				{
+					float value = rowMajor ? values[y*dimX + x] : values[geometry->getVtx(x,y)];
+					if (value >= lo && value <= hi)
+						found.push_back(value);
+				}
+		}
+		#pragma omp critical
+		candidates.insert(candidates.end(), found.begin(), found.end());
+	}
+
+	std::vector<float>::iterator lower = candidates.begin() + (rank - below);
+	std::nth_element(candidates.begin(), lower, candidates.end());
+	float result = *lower;
+	if (next != rank)
+	{
+		//the next value is the smallest one above the lower one
+		float upper = *std::min_element(lower + 1, candidates.end());
+		result += (float)(position - rank) * (upper - result);
+	}
+	return result;
+}
+
+void FlowStatistics::getRobustRange(float* lo, float* hi, float tail)
+{
+	if (tail != robustTail)
+	{
+		robustMin = getPercentileExact(tail);
+		robustMax = getPercentileExact(1.0f - tail);
+		//mostly constant channels have no spread between the percentiles
+		if (robustMax <= robustMin)
+		{
+			robustMin = rangeMin;
+			robustMax = rangeMax;
+		}
+		robustTail = tail;
+	}
+	*lo = robustMin;
+	*hi = robustMax;
+}
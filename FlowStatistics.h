@@ -0,0 +1,106 @@
+#ifndef FLOWSTATISTICS_H
+#define FLOWSTATISTICS_H
+
+class FlowChannel;
+class FlowGeometry;
+
+///default number of histogram bins of the channel statistics
+#define STATISTICS_BINS 1024
+///default fraction of the values cut off at each end by getRobustRange
+#define STATISTICS_TAIL 0.01f
+///exact percentiles select among at most this many values, larger bins are narrowed down first
+#define STATISTICS_SELECT 65536
+///maximum number of narrowing passes of an exact percentile
+#define STATISTICS_PASSES 4
+
+///histogram, mean, variance and percentiles of one channel
+/**
+* The histogram is built in parallel: every thread bins its rows into a private histogram (four values at a time with SSE where available),
+* the private histograms are merged at the end, so there are no atomic increments. Mean and variance are accumulated in double in the same pass.
+* Only the valid vertices count (see FlowMask, invalid tiles are skipped as a whole), the padding of the tiled vertex orders is skipped.
+* Approximate percentiles interpolate linearly inside of the histogram bins. Exact ones narrow the histogram down to the bin holding the percentile with further passes
+* (a single pass for evenly spread values) and then select among the values of that bin, so a few outliers do not make them sort the whole channel.
+*/
+class FlowStatistics{
+	private:
+		///the channel the statistics describe
+		FlowChannel* channel;
+		///geometry of the channel
+		FlowGeometry* geometry;
+		///number of histogram bins
+		int numBins;
+		///the histogram over <rangeMin, rangeMax>
+		int* bins;
+		///value range covered by the histogram (the range of the channel)
+		float rangeMin;
+		///see rangeMin
+		float rangeMax;
+		///number of valid vertices
+		int count;
+		///mean of all values
+		double mean;
+		///variance of all values
+		double variance;
+		///revision of the channel the statistics were computed from
+		unsigned int revision;
+		///revision of the mask of the geometry the statistics were computed with
+		unsigned int maskRevision;
+		///tail of the cached robust range, negative if there is none (see getRobustRange)
+		float robustTail;
+		///cached robust range, valid for robustTail until the next compute
+		float robustMin;
+		///see robustMin
+		float robustMax;
+		///were the statistics computed at all?
+		bool computed;
+
+		///bins the values inside of <lo, hi> into hist (numBins ints), returns the number of values below lo and the number inside in inside
+		int scanWindow(float lo, float hi, int* hist, int* inside);
+
+		FlowStatistics(const FlowStatistics&);
+		FlowStatistics& operator=(const FlowStatistics&);
+	public:
+		///creates empty statistics for the channel, see compute
+		FlowStatistics(FlowChannel* c, FlowGeometry* g);
+		///frees the histogram
+		~FlowStatistics();
+
+		///computes histogram with the given number of bins over the range of the channel, mean and variance
+		void compute(int bins = STATISTICS_BINS);
+		///returns false if the channel was modified since compute or compute was never called
+		bool isCurrent();
+
+		///bins the values of the valid vertices of the channel into dst (numBins ints) over <lo, hi>, values outside go to the first or last bin
+		/**
+		* This is the parallel kernel behind compute, usable for histograms with their own range (e.g. the transfer function display).
+		* @param sum if not NULL receives the sum of all values
+		* @param sumSquares if not NULL receives the sum of the squares of all values
+		*/
+		static void histogram(FlowChannel* c, FlowGeometry* g, int numBins, float lo, float hi, int* dst, double* sum = 0, double* sumSquares = 0);
+
+		///returns the number of histogram bins
+		int getNumBins();
+		///returns the histogram (getNumBins() counts)
+		const int* getHistogram();
+		///returns the lower end of the histogram range
+		float getRangeMin();
+		///returns the upper end of the histogram range
+		float getRangeMax();
+		///returns the number of values
+		int getCount();
+		///returns the mean of all values
+		double getMean();
+		///returns the variance of all values
+		double getVariance();
+
+		///returns the value below which the fraction p <0..1> of the values lies, interpolated inside of the histogram bin
+		float getPercentile(float p);
+		///same as getPercentile, but exact (interpolated between the two closest values), which costs one pass over the channel
+		float getPercentileExact(float p);
+		///returns the exact percentiles tail and 1-tail, a range that is not blown up by a few outliers
+		/**
+		* The range is cached until the statistics are computed again, so asking for it with the same tail costs no pass over the channel.
+		*/
+		void getRobustRange(float* lo, float* hi, float tail = STATISTICS_TAIL);
+};
+#endif
@@ -0,0 +1,177 @@
+#include "FlowSummedArea.h"
+#include "FlowChannel.h"
+
+///number of columns of the tables summed up by one thread at a time
+#define SUMMED_AREA_STRIP 256
+
+FlowSummedArea::FlowSummedArea(FlowChannel* c, FlowGeometry* g)
+{
+	channel = c;
+	geometry = g;
+	width = 0;
+	height = 0;
+	shift = 0.0;
+	sum = NULL;
+	sumSquares = NULL;
+	revision = 0;
+	built = false;
+}
+
+FlowSummedArea::~FlowSummedArea()
+{
+	delete[] sum;
+	delete[] sumSquares;
+}
+
+void FlowSummedArea::build()
+{
+	int dimX = geometry->getDimX();
+	int dimY = geometry->getDimY();
+	if (width != dimX + 1 || height != dimY + 1)
+	{
+		delete[] sum;
+		delete[] sumSquares;
+		width = dimX + 1;
+		height = dimY + 1;
+		sum = new double[width*height];
+		sumSquares = new double[width*height];
+	}
+	shift = 0.5 * ((double)channel->getMin() + (double)channel->getMax());
+	const float* values = channel->getValueArray();
+
+	//the first row and column stay 0, so that the lookups need no special cases
+	for (int x = 0; x < width; x++)
+	{
+		sum[x] = 0.0;
+		sumSquares[x] = 0.0;
+	}
+
+	//running sums along the rows
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dimY; y++)
+	{
+		double* s = sum + (y+1)*width;
+		double* q = sumSquares + (y+1)*width;
+		double runningSum = 0.0;
+		double runningSquares = 0.0;
+		s[0] = 0.0;
+		q[0] = 0.0;
+		for (int x = 0; x < dimX; x++)
+		{
+			double value = values[geometry->getVtx(x,y)] - shift;
+			runningSum += value;
+			runningSquares += value*value;
+			s[x+1] = runningSum;
+			q[x+1] = runningSquares;
+		}
+	}
+
+	//then down the columns, every thread takes strips of columns and walks through all rows
+	int numStrips = (width + SUMMED_AREA_STRIP - 1) / SUMMED_AREA_STRIP;
+	#pragma omp parallel for schedule(dynamic)
+	for (int strip = 0; strip < numStrips; strip++)
+	{
+		int x0 = strip * SUMMED_AREA_STRIP;
+		int x1 = (x0 + SUMMED_AREA_STRIP < width) ? x0 + SUMMED_AREA_STRIP : width;
+		for (int y = 2; y < height; y++)
+		{
+			double* s = sum + y*width;
+			double* q = sumSquares + y*width;
+			for (int x = x0; x < x1; x++)
+			{
+				s[x] += s[x - width];
+				q[x] += q[x - width];
+			}
+		}
+	}
+	revision = channel->getRevision();
+	built = true;
+}
+
+bool FlowSummedArea::isCurrent()
+{
+	return built && (revision == channel->getRevision());
+}
+
+bool FlowSummedArea::clamp(int* x0, int* y0, int* x1, int* y1)
+{
+	*x0 = (*x0 < 0) ? 0 : *x0;
+	*y0 = (*y0 < 0) ? 0 : *y0;
+	*x1 = (*x1 > width - 1) ? width - 1 : *x1;
+	*y1 = (*y1 > height - 1) ? height - 1 : *y1;
+	return (*x1 > *x0) && (*y1 > *y0);
+}
+
+inline double FlowSummedArea::lookup(const double* table, int x0, int y0, int x1, int y1)
+{
+	return table[y1*width + x1] - table[y0*width + x1] - table[y1*width + x0] + table[y0*width + x0];
+}
+
+int FlowSummedArea::getCount(int x0, int y0, int x1, int y1)
+{
+	if (!clamp(&x0, &y0, &x1, &y1))
+		return 0;
+	return (x1 - x0) * (y1 - y0);
+}
+
+double FlowSummedArea::getSum(int x0, int y0, int x1, int y1)
+{
+	if (!clamp(&x0, &y0, &x1, &y1))
+		return 0.0;
+	return lookup(sum, x0, y0, x1, y1) + shift * (x1 - x0) * (y1 - y0);
+}
+
+double FlowSummedArea::getMean(int x0, int y0, int x1, int y1)
+{
+	if (!clamp(&x0, &y0, &x1, &y1))
+		return 0.0;
+	return lookup(sum, x0, y0, x1, y1) / ((x1 - x0) * (double)(y1 - y0)) + shift;
+}
+
+double FlowSummedArea::getVariance(int x0, int y0, int x1, int y1)
+{
+	double mean, variance;
+	getMeanVariance(x0, y0, x1, y1, &mean, &variance);
+	return variance;
+}
+
+void FlowSummedArea::getMeanVariance(int x0, int y0, int x1, int y1, double* mean, double* variance)
+{
+	if (!clamp(&x0, &y0, &x1, &y1))
+	{
+		*mean = 0.0;
+		*variance = 0.0;
+		return;
+	}
+	double n = (x1 - x0) * (double)(y1 - y0);
+	//both moments of the shifted values, the variance does not depend on the shift
+	double m = lookup(sum, x0, y0, x1, y1) / n;
+	double v = lookup(sumSquares, x0, y0, x1, y1) / n - m*m;
+	*mean = m + shift;
+	*variance = (v > 0.0) ? v : 0.0;
+}
+
+void FlowSummedArea::boxFilter(int radius, FlowChannel* out)
+{
+	int dimX = geometry->getDimX();
+	int dimY = geometry->getDimY();
+	float* dst = out->beginUpdate();
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < dimY; y++)
+	{
+		int y0 = (y - radius > 0) ? y - radius : 0;
+		int y1 = (y + radius + 1 < dimY) ? y + radius + 1 : dimY;
+		for (int x = 0; x < dimX; x++)
+		{
+			int x0 = (x - radius > 0) ? x - radius : 0;
+			int x1 = (x + radius + 1 < dimX) ? x + radius + 1 : dimX;
+			dst[geometry->getVtx(x,y)] = (float)(lookup(sum, x0, y0, x1, y1) / ((x1 - x0) * (y1 - y0)) + shift);
+		}
+	}
+	out->endUpdate();
+}
+
+size_t FlowSummedArea::getMemory()
+{
+	return (size_t)width * height * 2 * sizeof(double);
+}
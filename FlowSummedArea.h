@@ -0,0 +1,71 @@
+#ifndef FLOWSUMMEDAREA_H
+#define FLOWSUMMEDAREA_H
+
+#include <stddef.h>
+
+class FlowChannel;
+class FlowGeometry;
+
+///summed-area tables of the values and their squares, give sum, mean and variance of any index-space rectangle in constant time
+/**
+* Entry (x,y) of a table holds the sum over all vertices x' < x, y' < y, so a rectangle costs four lookups whatever its size.
+* The tables are accumulated in double and the values are shifted by the center of the channel range first,
+* which keeps the variance (difference of two large sums otherwise) accurate even for channels with a large offset.
+* Rows are summed up in parallel, then the columns in parallel strips.
+*/
+class FlowSummedArea{
+	private:
+		///the channel the tables are built from
+		FlowChannel* channel;
+		///geometry of the channel
+		FlowGeometry* geometry;
+		///width of the tables (dimX + 1)
+		int width;
+		///height of the tables (dimY + 1)
+		int height;
+		///value subtracted from all values before summing them up
+		double shift;
+		///sums of the shifted values, width*height entries, row-major
+		double* sum;
+		///sums of the squares of the shifted values
+		double* sumSquares;
+		///revision of the channel the tables were built from
+		unsigned int revision;
+		///were the tables built at all?
+		bool built;
+
+		///clamps the rectangle to the grid, returns false if it is empty
+		bool clamp(int* x0, int* y0, int* x1, int* y1);
+		///returns the sum of the table over the (clamped) rectangle
+		inline double lookup(const double* table, int x0, int y0, int x1, int y1);
+
+		FlowSummedArea(const FlowSummedArea&);
+		FlowSummedArea& operator=(const FlowSummedArea&);
+	public:
+		///creates empty tables for the channel, see build
+		FlowSummedArea(FlowChannel* c, FlowGeometry* g);
+		///frees the tables
+		~FlowSummedArea();
+
+		///builds both tables from the values of the channel
+		void build();
+		///returns false if the channel was modified since build or build was never called
+		bool isCurrent();
+
+		///returns the number of vertices x0 <= x < x1, y0 <= y < y1 (the rectangle is clamped to the grid)
+		int getCount(int x0, int y0, int x1, int y1);
+		///returns the sum of the values of the rectangle
+		double getSum(int x0, int y0, int x1, int y1);
+		///returns the mean of the values of the rectangle, 0 for an empty one
+		double getMean(int x0, int y0, int x1, int y1);
+		///returns the (population) variance of the values of the rectangle, 0 for an empty one
+		double getVariance(int x0, int y0, int x1, int y1);
+		///computes mean and variance of the rectangle in one go
+		void getMeanVariance(int x0, int y0, int x1, int y1, double* mean, double* variance);
+
+		///writes the mean over the (2*radius+1)^2 vertices around every vertex (clipped at the boundary) into out, the cost does not depend on the radius
+		void boxFilter(int radius, FlowChannel* out);
+		///returns the bytes of both tables
+		size_t getMemory();
+};
+#endif
@@ -0,0 +1,177 @@
+#include "FlowView.h"
+#include "FlowResampler.h"
+#include "FlowSummedArea.h"
+#include <math.h>
+
+FlowView::FlowView(FlowData* d)
+{
+	data = d;
+	setup(0, 0, data->getGeometry()->getDimX(), data->getGeometry()->getDimY(), 1);
+}
+
+FlowView::FlowView(FlowData* d, int x0, int y0, int x1, int y1, int step)
+{
+	data = d;
+	setup(x0, y0, x1, y1, step);
+}
+
+void FlowView::setup(int x0, int y0, int x1, int y1, int step)
+{
+	int first[2] = {x0, y0};
+	int last[2] = {x1, y1};
+	int gridDim[2] = {data->getGeometry()->getDimX(), data->getGeometry()->getDimY()};
+	stride = (step < 1) ? 1 : step;
+	for (int d = 0; d < 2; d++)
+	{
+		begin[d] = (first[d] < 0) ? 0 : first[d];
+		int end = (last[d] > gridDim[d]) ? gridDim[d] : last[d];
+		//every stride-th vertex starting at begin, an empty range gives an empty view
+		dim[d] = (end > begin[d]) ? (end - begin[d] + stride - 1) / stride : 0;
+	}
+}
+
+int FlowView::getDimX()
+{
+	return dim[0];
+}
+
+int FlowView::getDimY()
+{
+	return dim[1];
+}
+
+int FlowView::getStride()
+{
+	return stride;
+}
+
+void FlowView::getRange(int channel, float* minimum, float* maximum)
+{
+	FlowChannel* ch = data->getChannel(channel);
+	//one partial result per row, merged afterwards (OpenMP 2.0 has no min/max reductions)
+	float* rowMin = new float[dim[1]];
+	float* rowMax = new float[dim[1]];
+	#pragma omp parallel for schedule(static)
+	for (int vy = 0; vy < dim[1]; vy++)
+	{
+		float lo = HUGE_VAL;
+		float hi = -HUGE_VAL;
+		for (int vx = 0; vx < dim[0]; vx++)
+		{
+			float value = ch->getValue(getVtx(vx,vy));
+			lo = (value < lo) ? value : lo;
+			hi = (value > hi) ? value : hi;
+		}
+		rowMin[vy] = lo;
+		rowMax[vy] = hi;
+	}
+	*minimum = HUGE_VAL;
+	*maximum = -HUGE_VAL;
+	for (int vy = 0; vy < dim[1]; vy++)
+	{
+		*minimum = (rowMin[vy] < *minimum) ? rowMin[vy] : *minimum;
+		*maximum = (rowMax[vy] > *maximum) ? rowMax[vy] : *maximum;
+	}
+	delete[] rowMin;
+	delete[] rowMax;
+}
+
+void FlowView::getMeanVariance(int channel, double* mean, double* variance)
+{
+	FlowChannel* ch = data->getChannel(channel);
+	if (stride == 1)
+	{
+		//a rectangle of the grid, four lookups
+		ch->getSummedArea()->getMeanVariance(begin[0], begin[1], begin[0] + dim[0], begin[1] + dim[1], mean, variance);
+		return;
+	}
+	//the tables cannot skip vertices, so strided views sum up their vertices (shifted by the first one for accuracy)
+	int n = dim[0]*dim[1];
+	if (n == 0)
+	{
+		*mean = 0.0;
+		*variance = 0.0;
+		return;
+	}
+	double shift = ch->getValue(getVtx(0,0));
+	double sum = 0.0;
+	double sumSquares = 0.0;
+	#pragma omp parallel for schedule(static) reduction(+:sum,sumSquares)
+	for (int vy = 0; vy < dim[1]; vy++)
+		for (int vx = 0; vx < dim[0]; vx++)
+		{
+			double value = ch->getValue(getVtx(vx,vy)) - shift;
+			sum += value;
+			sumSquares += value*value;
+		}
+	double m = sum / n;
+	double v = sumSquares / n - m*m;
+	*mean = m + shift;
+	*variance = (v > 0.0) ? v : 0.0;
+}
+
+void FlowView::extract(int channel, float* dst)
+{
+	FlowChannel* ch = data->getChannel(channel);
+	#pragma omp parallel for schedule(static)
+	for (int vy = 0; vy < dim[1]; vy++)
+		for (int vx = 0; vx < dim[0]; vx++)
+			dst[vy*dim[0] + vx] = ch->getValue(getVtx(vx,vy));
+}
+
+void FlowView::extractNormalized(int channel, float* dst, float minimum, float maximum)
+{
+	FlowChannel* ch = data->getChannel(channel);
+	float scale = (maximum > minimum) ? 1.0f / (maximum - minimum) : 0.0f;
+	#pragma omp parallel for schedule(static)
+	for (int vy = 0; vy < dim[1]; vy++)
+		for (int vx = 0; vx < dim[0]; vx++)
+			dst[vy*dim[0] + vx] = (ch->getValue(getVtx(vx,vy)) - minimum) * scale;
+}
+
+void FlowView::getBounds(float* roi)
+{
+	FlowGeometry* geometry = data->getGeometry();
+	roi[0] = roi[1] = HUGE_VAL;
+	roi[2] = roi[3] = -HUGE_VAL;
+	for (int vy = 0; vy < dim[1]; vy++)
+		for (int vx = 0; vx < dim[0]; vx++)
+		{
+			int vtxID = getVtx(vx,vy);
+			float x = geometry->getPosX(vtxID);
+			float y = geometry->getPosY(vtxID);
+			roi[0] = (x < roi[0]) ? x : roi[0];
+			roi[1] = (y < roi[1]) ? y : roi[1];
+			roi[2] = (x > roi[2]) ? x : roi[2];
+			roi[3] = (y > roi[3]) ? y : roi[3];
+		}
+}
+
+int FlowView::createChannelVectorLength(int chX, int chY, int chZ)
+{
+	int result = data->createChannel();
+	if (result < 0)
+		return result;
+	FlowChannel* x = data->getChannel(chX);
+	FlowChannel* y = data->getChannel(chY);
+	FlowChannel* z = (chZ >= 0) ? data->getChannel(chZ) : NULL;
+	FlowChannel* out = data->getChannel(result);
+	//setValue keeps track of the minimum and maximum, so it is not run in parallel
+	for (int vy = 0; vy < dim[1]; vy++)
+		for (int vx = 0; vx < dim[0]; vx++)
+		{
+			int i = getVtx(vx,vy);
+			float length = x->getValue(i)*x->getValue(i) + y->getValue(i)*y->getValue(i);
+			if (z)
+				length += z->getValue(i)*z->getValue(i);
+			out->setValue(i, sqrt(length));
+		}
+	return result;
+}
+
+const float* FlowView::resample(const int* channels, int count, int resX, int resY)
+{
+	float roi[4];
+	getBounds(roi);
+	return data->getResampler()->resampleRegion(channels, count, resX, resY, roi, begin[0], begin[1], begin[0] + dim[0]*stride, begin[1] + dim[1]*stride, stride);
+}
@@ -0,0 +1,76 @@
+#ifndef FLOWVIEW_H
+#define FLOWVIEW_H
+
+#include "FlowData.h"
+
+///a region of interest of a FlowData: an index-space sub-rectangle of the grid, optionally sampled with a stride
+/**
+* A view does not copy anything, it only maps its own vertex indexes (vx,vy) to the vertices (x0 + vx*stride, y0 + vy*stride) of the dataset.
+* Statistics, derived channels, extraction for texture uploads and resampling done through a view only touch the vertices of the view,
+* so their cost is proportional to the region and not to the whole dataset. The view stays valid as long as the geometry of the dataset does not change.
+*/
+class FlowView{
+	private:
+		///the viewed dataset
+		FlowData* data;
+		///first vertex of the view in X and Y
+		int begin[2];
+		///number of view vertices in X and Y
+		int dim[2];
+		///distance between two view vertices in dataset vertices
+		int stride;
+
+		///restricts the view to the grid of the dataset
+		void setup(int x0, int y0, int x1, int y1, int step);
+	public:
+		///creates a view covering the whole dataset
+		FlowView(FlowData* d);
+		///creates a view of the vertices x0 <= x < x1, y0 <= y < y1 of the dataset, taking every stride-th vertex. The rectangle is clamped to the grid.
+		FlowView(FlowData* d, int x0, int y0, int x1, int y1, int step = 1);
+
+		///returns the number of view vertices in X dimension
+		int getDimX();
+		///returns the number of view vertices in Y dimension
+		int getDimY();
+		///returns the stride of the view
+		int getStride();
+		///returns the dataset vertex index in X of the view vertex index vx
+		inline int toDatasetX(int vx);
+		///returns the dataset vertex index in Y of the view vertex index vy
+		inline int toDatasetY(int vy);
+		///returns the vertex id (as used by the geometry and the channels) of the view vertex (vx,vy)
+		inline int getVtx(int vx, int vy);
+
+		///computes the minimum and maximum of the channel over the vertices of the view
+		void getRange(int channel, float* minimum, float* maximum);
+		///computes the mean and the variance of the channel over the vertices of the view, in constant time from the summed-area tables of the channel if the stride is 1
+		void getMeanVariance(int channel, double* mean, double* variance);
+		///copies the values of the channel at the view vertices into dst (getDimX()*getDimY() values, row-major)
+		void extract(int channel, float* dst);
+		///copies the values of the channel at the view vertices into dst, scaled so that minimum maps to 0 and maximum to 1
+		void extractNormalized(int channel, float* dst, float minimum, float maximum);
+		///computes the bounding box of the view in normalized coordinates as {minX, minY, maxX, maxY}
+		void getBounds(float* roi);
+
+		///creates a new channel containing the vector lengths for the given channels, computed only at the view vertices (the others stay 0 and do not count for the minimum and maximum). Returns the address of the created channel.
+		int createChannelVectorLength(int chX, int chY, int chZ = -1);
+		///resamples the given channels of the view onto a regular grid covering the bounding box of the view, see FlowResampler
+		const float* resample(const int* channels, int count, int resX, int resY);
+};
+
+inline int FlowView::toDatasetX(int vx)
+{
+	return begin[0] + vx*stride;
+}
+
+inline int FlowView::toDatasetY(int vy)
+{
+	return begin[1] + vy*stride;
+}
+
+inline int FlowView::getVtx(int vx, int vy)
+{
+	return data->getGeometry()->getVtx(toDatasetX(vx), toDatasetY(vy));
+}
+
+#endif
@@ -0,0 +1,147 @@
+#include "FlowVolume.h"
+#include "reverseBytes.h"
+#include <iostream>
+
+FlowVolume::FlowVolume()
+{
+	dim[0] = dim[1] = dim[2] = 0;
+	numChannels = 0;
+	channels = NULL;
+}
+
+FlowVolume::~FlowVolume()
+{
+	clear();
+}
+
+void FlowVolume::clear()
+{
+	posX.clear();
+	posY.clear();
+	posZ.clear();
+	delete[] channels;
+	channels = NULL;
+	numChannels = 0;
+	//a cleared volume is not 3D any more, see FlowData::is3D
+	dim[0] = dim[1] = dim[2] = 0;
+}
+
+bool FlowVolume::readBlock(FILE* fp, float* buffer, size_t count, bool bigEndian)
+{
+	if (fread(buffer, sizeof(float), count, fp) != count)
+		return false;
+	if (bigEndian)
+		for (size_t j = 0; j < count; j++)
+			buffer[j] = reverseBytes<float>(buffer[j]);
+	return true;
+}
+
+bool FlowVolume::readGrid(FILE* fp, int dimX, int dimY, int dimZ, bool bigEndian)
+{
+	clear();
+	dim[0] = dimX;
+	dim[1] = dimY;
+	dim[2] = dimZ;
+	posX.resize(dimX, dimY, dimZ);
+	posY.resize(dimX, dimY, dimZ);
+	posZ.resize(dimX, dimY, dimZ);
+
+	//one slab of slices at a time, each vertex stores x, y, z
+	size_t sliceSize = (size_t)dimX*dimY;
+	float* slab = new float[sliceSize*3*BRICK_SIZE];
+	for (int z0 = 0; z0 < dimZ; z0 += BRICK_SIZE)
+	{
+		int depth = (z0 + BRICK_SIZE < dimZ) ? BRICK_SIZE : dimZ - z0;
+		if (!readBlock(fp, slab, sliceSize*3*depth, bigEndian))
+		{
+			std::cerr << "+ Error reading grid file." << std::endl << std::endl;
+			delete[] slab;
+			return false;
+		}
+		if (!posX.copySlab(slab, z0, depth, 3, 0) || !posY.copySlab(slab, z0, depth, 3, 1) || !posZ.copySlab(slab, z0, depth, 3, 2))
+		{
+			std::cerr << "Cannot allocate the bricks of the grid." << std::endl;
+			delete[] slab;
+			return false;
+		}
+	}
+	delete[] slab;
+	return true;
+}
+
+bool FlowVolume::readChannels(FILE* fp, int channelCount, bool bigEndian)
+{
+	delete[] channels;
+	numChannels = channelCount;
+	channels = new BrickedArray[numChannels];
+	for (int c = 0; c < numChannels; c++)
+		channels[c].resize(dim[0], dim[1], dim[2]);
+
+	size_t sliceSize = (size_t)dim[0]*dim[1];
+	float* slab = new float[sliceSize*numChannels*BRICK_SIZE];
+	for (int z0 = 0; z0 < dim[2]; z0 += BRICK_SIZE)
+	{
+		int depth = (z0 + BRICK_SIZE < dim[2]) ? BRICK_SIZE : dim[2] - z0;
+		if (!readBlock(fp, slab, sliceSize*numChannels*depth, bigEndian))
+		{
+			std::cerr << "+ Error reading dat file." << std::endl << std::endl;
+			delete[] slab;
+			return false;
+		}
+		for (int c = 0; c < numChannels; c++)
+			if (!channels[c].copySlab(slab, z0, depth, numChannels, c))
+			{
+				std::cerr << "Cannot allocate the bricks of channel " << c << "." << std::endl;
+				delete[] slab;
+				return false;
+			}
+	}
+	delete[] slab;
+	return true;
+}
+
+int FlowVolume::getDimX()
+{
+	return dim[0];
+}
+
+int FlowVolume::getDimY()
+{
+	return dim[1];
+}
+
+int FlowVolume::getDimZ()
+{
+	return dim[2];
+}
+
+int FlowVolume::getNumChannels()
+{
+	return numChannels;
+}
+
+size_t FlowVolume::getMemory()
+{
+	size_t memory = posX.getMemory() + posY.getMemory() + posZ.getMemory();
+	for (int c = 0; c < numChannels; c++)
+		memory += channels[c].getMemory();
+	return memory;
+}
+
+float FlowVolume::sampleChannel(int channel, float i, float j, float k)
+{
+	return channels[channel].sample(i, j, k);
+}
+
+vec3 FlowVolume::samplePos(float i, float j, float k)
+{
+	return vec3(posX.sample(i, j, k), posY.sample(i, j, k), posZ.sample(i, j, k));
+}
+
+void FlowVolume::extractSliceZ(int z, float* x, float* y, float* rawdata)
+{
+	posX.extractSliceZ(z, x);
+	posY.extractSliceZ(z, y);
+	for (int c = 0; c < numChannels; c++)
+		channels[c].extractSliceZ(z, rawdata + c, numChannels);
+}
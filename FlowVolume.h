@@ -0,0 +1,67 @@
+#ifndef FLOWVOLUME_H
+#define FLOWVOLUME_H
+
+#include <stdio.h>
+#include "vec3.h"
+#include "BrickedArray.h"
+
+///class holding a 3D structured dataset (geometry and all channels of one time step) in bricked storage
+/**
+* The files are read slab by slab (BRICK_SIZE slices at a time), so the only temporary storage is one slab and not the whole grid.
+* The renderer works on 2D data, FlowData extracts XY slices from here and hands them to FlowGeometry and FlowChannel.
+*/
+class FlowVolume{
+	private:
+		///resolution of the data for the dimensions X, Y, Z
+		int dim[3];
+		///number of channels (incl. the 3 velocity components)
+		int numChannels;
+		///x coordinates of the vertices
+		BrickedArray posX;
+		///y coordinates of the vertices
+		BrickedArray posY;
+		///z coordinates of the vertices
+		BrickedArray posZ;
+		///values of all channels, numChannels arrays
+		BrickedArray* channels;
+
+		///reads count floats into buffer and swaps the byte order if needed, returns false if the file is too short
+		static bool readBlock(FILE* fp, float* buffer, size_t count, bool bigEndian);
+	public:
+		FlowVolume();
+		///releases all data
+		~FlowVolume();
+
+		///reads the grid file (the header has been read already)
+		bool readGrid(FILE* fp, int dimX, int dimY, int dimZ, bool bigEndian);
+		///reads the data file of one time step containing numChannels values per vertex
+		bool readChannels(FILE* fp, int channelCount, bool bigEndian);
+		///releases all data
+		void clear();
+
+		///returns the number of vertices in X dimension
+		int getDimX();
+		///returns the number of vertices in Y dimension
+		int getDimY();
+		///returns the number of vertices in Z dimension
+		int getDimZ();
+		///returns the number of channels
+		int getNumChannels();
+		///returns the number of bytes used by the geometry and all channels
+		size_t getMemory();
+
+		///returns the value of a channel at fractional vertex indexes, interpolated trilinearly
+		float sampleChannel(int channel, float i, float j, float k);
+		///returns the position at fractional vertex indexes, interpolated trilinearly
+		vec3 samplePos(float i, float j, float k);
+
+		///extracts the XY slice z as 2D data
+		/**
+		* @param z index of the slice
+		* @param x row-major x coordinates of the slice vertices (getDimX()*getDimY() floats)
+		* @param y row-major y coordinates of the slice vertices (getDimX()*getDimY() floats)
+		* @param rawdata row-major channel values of the slice, numChannels per vertex like in the dat files
+		*/
+		void extractSliceZ(int z, float* x, float* y, float* rawdata);
+};
+#endif
@@ -3,7 +3,6 @@
 uniform sampler2DRect tex_grid, tex_channel3;
 uniform sampler2D tex_transfer;
 uniform sampler2DRect tex_inverseX, tex_inverseY;
-uniform bool flipped;
 uniform float width, height;
 
 void main (void) 
@@ -0,0 +1,450 @@
+#include "SharedExchange.h"
+#include <QThread>
+#include <limits.h>
+#include <string.h>
+#include <iostream>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+///marks a fully initialized segment
+#define EXCHANGE_READY 0x5e6d0001
+///default of the longest wait in milliseconds
+#define EXCHANGE_TIMEOUT 30000
+
+///bookkeeping at the start of the shared segment, only accessed while the segment is locked
+struct ExchangeHeader{
+	///EXCHANGE_READY once rank 0 initialized the segment
+	int ready;
+	///number of workers that reached the current barrier
+	int barrierCount;
+	///incremented every time all workers passed the barrier
+	int barrierGeneration;
+	///number of particles not yet finished
+	int particlesInFlight;
+	///non-zero once a worker gave up, see SharedExchange::abort
+	int aborted;
+	///padding to a cache line
+	int reserved[11];
+};
+
+///runs the job of one worker of SharedExchange::runLocal
+class ExchangeThread : public QThread{
+	public:
+		///the exchange of this worker
+		SharedExchange* exchange;
+		///the work
+		ExchangeJob* job;
+		///rank of this worker
+		int rank;
+		///true if the job succeeded
+		bool ok;
+	protected:
+		void run()
+		{
+			ok = exchange->attach();
+			ok = ok && job->run(*exchange, rank);
+			//the others would wait for this worker at the next barrier
+			if (!ok)
+				exchange->abort();
+		}
+};
+
+SharedExchange::SharedExchange(const QString& key, const DomainDecomposition* d, int workerRank, int fields, int capacity) : memory(key)
+{
+	decomposition = d;
+	rank = workerRank;
+	fieldCount = fields;
+	mailboxCapacity = capacity;
+	timeout = EXCHANGE_TIMEOUT;
+
+	//the rings of all blocks one after another, every row of a ring either complete or only its two ends
+	int numBlocks = decomposition->getNumBlocks();
+	ringOffset.resize(numBlocks + 1);
+	rowOffset.resize(numBlocks);
+	ringOffset[0] = 0;
+	int ghost = decomposition->getGhostWidth();
+	for (int r = 0; r < numBlocks; r++)
+	{
+		const DomainBlock& b = decomposition->getBlock(r);
+		int width = b.end[0] - b.begin[0];
+		size_t offset = 0;
+		rowOffset[r].resize(b.end[1] - b.begin[1]);
+		for (int y = b.begin[1]; y < b.end[1]; y++)
+		{
+			rowOffset[r][y - b.begin[1]] = offset;
+			offset += isFullRingRow(b, y) ? width : 2*ghost;
+		}
+		ringOffset[r+1] = ringOffset[r] + offset;
+	}
+}
+
+SharedExchange::~SharedExchange()
+{
+	if (memory.isAttached())
+		memory.detach();
+}
+
+bool SharedExchange::isFullRingRow(const DomainBlock& b, int y)
+{
+	int ghost = decomposition->getGhostWidth();
+	return (y < b.begin[1] + ghost) || (y >= b.end[1] - ghost) || (b.end[0] - b.begin[0] <= 2*ghost);
+}
+
+size_t SharedExchange::ringIndex(int block, int x, int y)
+{
+	const DomainBlock& b = decomposition->getBlock(block);
+	int ghost = decomposition->getGhostWidth();
+	size_t row = ringOffset[block] + rowOffset[block][y - b.begin[1]];
+	if (isFullRingRow(b, y) || (x < b.begin[0] + ghost))
+		return row + (x - b.begin[0]);
+	return row + ghost + (x - (b.end[0] - ghost));
+}
+
+size_t SharedExchange::segmentSize()
+{
+	size_t fieldSize = ringOffset.back() * sizeof(float);
+	size_t mailboxSize = 16 + (size_t)mailboxCapacity * sizeof(TracedParticle);
+	return sizeof(ExchangeHeader) + fieldCount * fieldSize + decomposition->getNumBlocks() * mailboxSize;
+}
+
+ExchangeHeader* SharedExchange::header()
+{
+	return (ExchangeHeader*)memory.data();
+}
+
+float* SharedExchange::field(int slot)
+{
+	return (float*)((char*)memory.data() + sizeof(ExchangeHeader)) + (size_t)slot * ringOffset.back();
+}
+
+int* SharedExchange::mailboxCount(int block)
+{
+	char* mailboxes = (char*)field(fieldCount);
+	return (int*)(mailboxes + (size_t)block * (16 + mailboxCapacity * sizeof(TracedParticle)));
+}
+
+TracedParticle* SharedExchange::mailbox(int block)
+{
+	return (TracedParticle*)((char*)mailboxCount(block) + 16);
+}
+
+void SharedExchange::pause()
+{
+#ifdef _WIN32
+	Sleep(1);
+#else
+	usleep(1000);
+#endif
+}
+
+bool SharedExchange::wait(int* waited)
+{
+	pause();
+	(*waited)++;
+	if (memory.isAttached() && isAborted())
+		return false;
+	if (*waited < timeout)
+		return true;
+	std::cerr << "Worker " << rank << " gave up the shared exchange after " << timeout << " ms." << std::endl;
+	//the others would run into the same wait
+	abort();
+	return false;
+}
+
+void SharedExchange::setTimeout(int milliseconds)
+{
+	timeout = milliseconds;
+}
+
+bool SharedExchange::attach()
+{
+	if (rank == 0)
+	{
+		//the API of QSharedMemory takes the size as an int
+		size_t size = segmentSize();
+		if (size > (size_t)INT_MAX)
+		{
+			std::cerr << "The shared exchange segment of " << (size >> 20) << " MB is too large." << std::endl;
+			return false;
+		}
+		if (!memory.create((int)size))
+		{
+			std::cerr << "Cannot create the shared exchange segment: " << memory.errorString().toStdString() << std::endl;
+			return false;
+		}
+		memory.lock();
+		memset(memory.data(), 0, size);
+		header()->ready = EXCHANGE_READY;
+		memory.unlock();
+		return true;
+	}
+
+	//the other workers wait for rank 0 to create and initialize the segment, which may never happen if it failed
+	int waited = 0;
+	while (!memory.attach())
+		if (!wait(&waited))
+			return false;
+	while (true)
+	{
+		memory.lock();
+		bool ready = (header()->ready == EXCHANGE_READY);
+		memory.unlock();
+		if (ready)
+			return true;
+		if (!wait(&waited))
+			return false;
+	}
+}
+
+void SharedExchange::abort()
+{
+	if (!memory.isAttached())
+		return;
+	memory.lock();
+	header()->aborted = 1;
+	memory.unlock();
+}
+
+bool SharedExchange::isAborted()
+{
+	memory.lock();
+	bool aborted = (header()->aborted != 0);
+	memory.unlock();
+	return aborted;
+}
+
+bool SharedExchange::barrier()
+{
+	int numWorkers = decomposition->getNumBlocks();
+	memory.lock();
+	if (header()->aborted)
+	{
+		memory.unlock();
+		return false;
+	}
+	int generation = header()->barrierGeneration;
+	if (++header()->barrierCount == numWorkers)
+	{
+		//the last one releases everybody
+		header()->barrierCount = 0;
+		header()->barrierGeneration++;
+		memory.unlock();
+		return true;
+	}
+	memory.unlock();
+
+	int waited = 0;
+	while (true)
+	{
+		if (!wait(&waited))
+			return false;
+		memory.lock();
+		bool released = (header()->barrierGeneration != generation);
+		memory.unlock();
+		if (released)
+			return true;
+	}
+}
+
+bool SharedExchange::exchangeHalos(BlockField& f, int slot)
+{
+	const DomainBlock& b = f.getBlock();
+	float* strips = field(slot);
+
+	//publish the owned vertices the neighbours need, i.e. the ring of ghost width along the block border
+	//(the blocks write disjoint parts of the slot, so no locking is needed)
+	for (int y = b.begin[1]; y < b.end[1]; y++)
+	{
+		size_t row = ringIndex(b.rank, b.begin[0], y);
+		if (isFullRingRow(b, y))
+		{
+			for (int x = b.begin[0]; x < b.end[0]; x++)
+				strips[row + (x - b.begin[0])] = f.at(x,y);
+		}
+		else
+		{
+			int ghost = decomposition->getGhostWidth();
+			for (int k = 0; k < ghost; k++)
+			{
+				strips[row + k] = f.at(b.begin[0] + k, y);
+				strips[row + ghost + k] = f.at(b.end[0] - ghost + k, y);
+			}
+		}
+	}
+	if (!barrier())
+		return false;
+
+	//pick up the ghost layer from the rings of the owners
+	for (int y = b.ghostBegin[1]; y < b.ghostEnd[1]; y++)
+		for (int x = b.ghostBegin[0]; x < b.ghostEnd[0]; x++)
+			if (!b.owns(x,y))
+				f.at(x,y) = strips[ringIndex(decomposition->findOwner(x,y), x, y)];
+	//nobody may overwrite the strips before everybody read them
+	return barrier();
+}
+
+bool SharedExchange::diffuse(BlockField& f, int slot, int iterations, float rate)
+{
+	const DomainBlock& b = f.getBlock();
+	int width = b.end[0] - b.begin[0];
+	int dimX = decomposition->getDimX();
+	int dimY = decomposition->getDimY();
+	std::vector<float> next((size_t)width * (b.end[1] - b.begin[1]));
+	for (int it = 0; it < iterations; it++)
+	{
+		if (!exchangeHalos(f, slot))
+			return false;
+		for (int y = b.begin[1]; y < b.end[1]; y++)
+		{
+			int y0 = (y > 0) ? y-1 : y;
+			int y1 = (y < dimY-1) ? y+1 : y;
+			for (int x = b.begin[0]; x < b.end[0]; x++)
+			{
+				int x0 = (x > 0) ? x-1 : x;
+				int x1 = (x < dimX-1) ? x+1 : x;
+				float v = f.at(x,y);
+				next[(size_t)(y - b.begin[1])*width + (x - b.begin[0])] = v + rate * (f.at(x0,y) + f.at(x1,y) + f.at(x,y0) + f.at(x,y1) - 4.0f*v);
+			}
+		}
+		for (int y = b.begin[1]; y < b.end[1]; y++)
+			for (int x = b.begin[0]; x < b.end[0]; x++)
+				f.at(x,y) = next[(size_t)(y - b.begin[1])*width + (x - b.begin[0])];
+	}
+	return true;
+}
+
+bool SharedExchange::runLocal(const QString& key, const DomainDecomposition* d, int fields, ExchangeJob* job)
+{
+	int numWorkers = d->getNumBlocks();
+	std::vector<SharedExchange*> exchanges(numWorkers);
+	std::vector<ExchangeThread*> threads(numWorkers);
+	for (int r = 0; r < numWorkers; r++)
+	{
+		exchanges[r] = new SharedExchange(key, d, r, fields);
+		threads[r] = new ExchangeThread();
+		threads[r]->exchange = exchanges[r];
+		threads[r]->job = job;
+		threads[r]->rank = r;
+		threads[r]->ok = false;
+	}
+	for (int r = 0; r < numWorkers; r++)
+		threads[r]->start();
+	bool ok = true;
+	for (int r = 0; r < numWorkers; r++)
+	{
+		threads[r]->wait();
+		ok = ok && threads[r]->ok;
+	}
+	//rank 0 holds the segment until all others detached
+	for (int r = numWorkers; r-- > 0; )
+	{
+		delete threads[r];
+		delete exchanges[r];
+	}
+	return ok;
+}
+
+bool SharedExchange::traceParticles(BlockField& velI, BlockField& velJ, float stepSize, int maxSteps, const TracedParticle* seeds, int numSeeds, std::vector<TracePoint>& trace)
+{
+	const DomainBlock& b = velI.getBlock();
+	float maxI = decomposition->getDimX() - 1;
+	float maxJ = decomposition->getDimY() - 1;
+
+	//keep the own seeds, seeds outside of the grid are dropped by everybody
+	std::vector<TracedParticle> active;
+	int validSeeds = 0;
+	for (int p = 0; p < numSeeds; p++)
+	{
+		//the cast truncates toward zero, seeds just below 0 have to be rejected here (NaN as well) instead of going to the first block
+		if (!((seeds[p].i >= 0) && (seeds[p].j >= 0) && (seeds[p].i <= maxI) && (seeds[p].j <= maxJ)))
+			continue;
+		int owner = decomposition->findOwner((int)seeds[p].i, (int)seeds[p].j);
+		if (owner >= 0)
+			validSeeds++;
+		if (owner == rank)
+			active.push_back(seeds[p]);
+	}
+
+	if (rank == 0)
+	{
+		memory.lock();
+		header()->particlesInFlight = validSeeds;
+		memory.unlock();
+	}
+	if (!barrier())
+		return false;
+
+	std::vector<TracedParticle> outgoing;
+	while (true)
+	{
+		//take the particles handed over by the neighbours
+		memory.lock();
+		int incoming = *mailboxCount(rank);
+		for (int p = 0; p < incoming; p++)
+			active.push_back(mailbox(rank)[p]);
+		*mailboxCount(rank) = 0;
+		memory.unlock();
+
+		int finished = 0;
+		for (size_t p = 0; p < active.size(); p++)
+		{
+			TracedParticle particle = active[p];
+			while (true)
+			{
+				TracePoint point = {particle.id, particle.step, particle.i, particle.j};
+				trace.push_back(point);
+				if (particle.step >= maxSteps)
+				{
+					finished++;
+					break;
+				}
+				float u = velI.sample(particle.i, particle.j);
+				float v = velJ.sample(particle.i, particle.j);
+				particle.i += stepSize * u;
+				particle.j += stepSize * v;
+				particle.step++;
+				if ((particle.i < 0) || (particle.j < 0) || (particle.i > maxI) || (particle.j > maxJ) || ((u == 0.0f) && (v == 0.0f)))
+				{
+					finished++;
+					break;
+				}
+				if (!b.owns((int)particle.i, (int)particle.j))
+				{
+					//the next step belongs to a neighbour, the position is traced there
+					outgoing.push_back(particle);
+					break;
+				}
+			}
+		}
+		active.clear();
+
+		//hand the particles over, full mailboxes are retried in the next round
+		std::vector<TracedParticle> retry;
+		memory.lock();
+		for (size_t p = 0; p < outgoing.size(); p++)
+		{
+			int owner = decomposition->findOwner((int)outgoing[p].i, (int)outgoing[p].j);
+			int* count = mailboxCount(owner);
+			if (*count < mailboxCapacity)
+				mailbox(owner)[(*count)++] = outgoing[p];
+			else
+				retry.push_back(outgoing[p]);
+		}
+		header()->particlesInFlight -= finished;
+		memory.unlock();
+		outgoing = retry;
+
+		if (!barrier())
+			return false;
+		memory.lock();
+		int inFlight = header()->particlesInFlight;
+		memory.unlock();
+		if (!barrier())
+			return false;
+		if (inFlight == 0)
+			return true;
+	}
+}
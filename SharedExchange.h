@@ -0,0 +1,140 @@
+#ifndef SHAREDEXCHANGE_H
+#define SHAREDEXCHANGE_H
+
+#include <QSharedMemory>
+#include <QString>
+#include <stddef.h>
+#include <vector>
+#include "DomainDecomposition.h"
+
+///a particle traced through a decomposed domain, positions are fractional vertex indexes of the whole grid
+struct TracedParticle{
+	///position in X (vertex index)
+	float i;
+	///position in Y (vertex index)
+	float j;
+	///number of steps done so far
+	int step;
+	///id of the particle (e.g. the index of its seed)
+	int id;
+};
+
+///one traced position, produced by the worker owning the particle at that moment
+struct TracePoint{
+	///id of the particle
+	int id;
+	///number of the step
+	int step;
+	///position in X (vertex index)
+	float i;
+	///position in Y (vertex index)
+	float j;
+};
+
+class SharedExchange;
+
+///the work of one worker, see SharedExchange::runLocal
+class ExchangeJob{
+	public:
+		virtual ~ExchangeJob() {}
+		///does the work of the worker with the given rank, returns false on failure
+		virtual bool run(SharedExchange& exchange, int rank) = 0;
+};
+
+///halo and particle exchange between the workers of a DomainDecomposition through a shared memory segment
+/**
+* All workers (threads or local processes) create a SharedExchange with the same key and decomposition, each with its own rank.
+* Rank 0 creates the segment, the others attach to it. The segment holds fieldCount slots of halo strips, a barrier and one particle mailbox per block.
+* A slot only holds the ring of owned vertices within the ghost width of the border of every block, the part the neighbours read,
+* so the segment grows with the block perimeters and not with the grid.
+* All collective calls (exchangeHalos, barrier, diffuse, traceParticles) have to be made by all workers in the same order. They return false once
+* a worker aborted the exchange or a wait took longer than the timeout, so a failed worker does not leave the others spinning.
+*/
+class SharedExchange{
+	private:
+		///the shared segment
+		QSharedMemory memory;
+		///the decomposition shared by all workers
+		const DomainDecomposition* decomposition;
+		///rank of this worker
+		int rank;
+		///number of field slots in the segment
+		int fieldCount;
+		///capacity of each particle mailbox
+		int mailboxCapacity;
+		///longest wait in milliseconds before the exchange is given up
+		int timeout;
+		///offset of the ring of every block inside of a slot, in floats, and the size of a slot as the last entry
+		std::vector<size_t> ringOffset;
+		///offset of every row of the ring of a block relative to the ring, indexed by block and by row - begin[1]
+		std::vector< std::vector<size_t> > rowOffset;
+
+		///returns the header at the start of the segment
+		struct ExchangeHeader* header();
+		///returns the halo strips of the field slot
+		float* field(int slot);
+		///returns true if the row y of the block is stored completely in the ring, otherwise only the ghost width at both ends
+		bool isFullRingRow(const DomainBlock& b, int y);
+		///returns the index of the owned vertex (x,y) of the block inside of a slot, the vertex has to lie within the ghost width of the block border
+		size_t ringIndex(int block, int x, int y);
+		///returns the number of particles in the mailbox of the given block
+		int* mailboxCount(int block);
+		///returns the particles in the mailbox of the given block
+		TracedParticle* mailbox(int block);
+		///returns the size of the segment in bytes
+		size_t segmentSize();
+		///yields the processor for a short while during busy waits
+		static void pause();
+		///waits a while, counting the waited milliseconds in waited. Returns false once the timeout or an abort is reached.
+		bool wait(int* waited);
+
+		SharedExchange(const SharedExchange&);
+		SharedExchange& operator=(const SharedExchange&);
+	public:
+		///prepares the exchange, call attach before use
+		SharedExchange(const QString& key, const DomainDecomposition* d, int workerRank, int fields, int capacity = 4096);
+		///detaches from the segment (the segment disappears with the last worker)
+		~SharedExchange();
+
+		///sets the longest wait (for rank 0 to create the segment, for the other workers at a barrier) in milliseconds, 30 s by default
+		void setTimeout(int milliseconds);
+		///creates (rank 0) or attaches to (other ranks) the segment, waits until it is initialized. Returns false on failure or after the timeout.
+		bool attach();
+		///tells all workers to give up, their collective calls return false from now on
+		void abort();
+		///returns true if a worker aborted the exchange
+		bool isAborted();
+		///waits until all workers reached the barrier, returns false if the exchange was aborted or timed out
+		bool barrier();
+		///refreshes the ghost layer of the field from the neighbouring blocks, using the given field slot of the segment. Returns false if the exchange was aborted.
+		bool exchangeHalos(BlockField& field, int slot);
+		///smooths the field by iterations Jacobi steps of the diffusion stencil v += rate * (sum of the 4 neighbours - 4 v), refreshing the ghost layer before every step
+		/**
+		* The ghost layer has to be at least 1 wide, rate has to lie in (0, 0.25] for the steps to be stable. Neighbours beyond the grid border take the value of the border vertex.
+		* Returns false if the exchange was aborted.
+		*/
+		bool diffuse(BlockField& field, int slot, int iterations, float rate = 0.25f);
+
+		///traces particles through all blocks, handing them over to the owning worker whenever they cross a block boundary
+		/**
+		* Every worker passes the same list of seeds and keeps the ones it owns. Particles advance with Euler steps in vertex index space,
+		* using a velocity in computational space (see FlowData::createChannelComputationalVelocity), until they leave the grid, stop moving or did maxSteps steps.
+		* @param velI i component of the velocity on this block (ghost layer at least 1)
+		* @param velJ j component of the velocity on this block (ghost layer at least 1)
+		* @param stepSize size of each integration step
+		* @param maxSteps maximum number of steps per particle
+		* @param seeds start positions of all particles
+		* @param numSeeds number of seeds
+		* @param trace receives all positions computed by this worker
+		* @return false if the exchange was aborted
+		*/
+		bool traceParticles(BlockField& velI, BlockField& velJ, float stepSize, int maxSteps, const TracedParticle* seeds, int numSeeds, std::vector<TracePoint>& trace);
+
+		///runs one worker thread per block of the decomposition in this process, each with its own SharedExchange on the key, and waits for them
+		/**
+		* Every worker attaches and calls job->run with its exchange and rank. A failing worker aborts the exchange, so the others return as well.
+		* Returns true if all workers succeeded.
+		*/
+		static bool runLocal(const QString& key, const DomainDecomposition* d, int fields, ExchangeJob* job);
+};
+#endif
@@ -16,6 +16,9 @@ TFTexture::TFTexture(QWidget *parent)
 
 	addNode(TFNode(0, 0.0, 0.0, 0.7, 0.0));
 	addNode(TFNode(2047, 0.8, 0, 0, 1));
+
+	for (int i = 0; i < 256; i++)
+		histogram[i] = 0.0f;
 }
 
 TFTexture::~TFTexture(void)
@@ -56,12 +59,12 @@ void TFTexture::setFBO(GLuint fbo, GLuint texture)
 void TFTexture::setHistogram(int* histogram)
 {
 	int histHeight = 0;
-	for (int i = 1; i < 256; i++) {
+	for (int i = 0; i < 256; i++) {
 		if (histogram[i] > histHeight)
 			histHeight = histogram[i];
 	}
-	for (int i = 1; i < 256; i++) {
-		this->histogram[i] = static_cast<float>(histogram[i]) / histHeight;
+	for (int i = 0; i < 256; i++) {
+		this->histogram[i] = (histHeight > 0) ? static_cast<float>(histogram[i]) / histHeight : 0.0f;
 	}
 }
 
@@ -88,7 +88,8 @@ public:
 
 	//! Sets the histogram used in the transfer function display.
 	/*!
-		\param histogram The histogram data.
+		The counts are scaled so that the highest bar reaches 1.
+		\param histogram The histogram data, 256 bins covering the range of the transfer function.
 	*/
 	void setHistogram(int* histogram);
 
@@ -45,10 +45,11 @@ void TFView::drawTF()
 	std::map<int, TFNode>::iterator node;
 	TFNode thisNode, prevNode;
 	
-	//for (unsigned int i = 1; i < 256; i++) {
-	//	QPen pen(QColor(i, 0.25, 255 - i, 255), 2, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-	//	scene()->addLine(static_cast<double>(i) / 256 * sceneWidth, sceneHeight, static_cast<double>(i) / 256 * sceneWidth, sceneHeight * (1 - tf->histogram[i]), pen);
-	//}
+	for (unsigned int i = 0; i < 256; i++) {
+		QPen pen(QColor(i, 0, 255 - i, 96), 2, Qt::SolidLine, Qt::FlatCap, Qt::RoundJoin);
+		QGraphicsLineItem *bar = scene()->addLine(static_cast<double>(i) / 256 * sceneWidth, sceneHeight, static_cast<double>(i) / 256 * sceneWidth, sceneHeight * (1 - tf->histogram[i]), pen);
+		bar->setZValue(-2);
+	}
 
 	QPen pen2(Qt::black, 1, Qt::DashLine, Qt::RoundCap, Qt::RoundJoin);
 
@@ -0,0 +1,39 @@
+#ifndef ALIGNEDMEMORY_H
+#define ALIGNEDMEMORY_H
+
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+///alignment used for all bulk float arrays, one cache line (and a multiple of the AVX register width)
+#define DATA_ALIGNMENT 64
+
+/**
+* A templated routine that allocates an uninitialized array of count elements starting at an aligned address.
+* The memory has to be released with alignedFree. Returns NULL if the allocation fails.
+*/
+template < typename T > T* alignedAlloc( size_t count, size_t alignment = DATA_ALIGNMENT )
+{
+#ifdef _WIN32
+	return (T*)_aligned_malloc(count * sizeof(T), alignment);
+#else
+	void* p = NULL;
+	if (posix_memalign(&p, alignment, count * sizeof(T)) != 0)
+		return NULL;
+	return (T*)p;
+#endif
+}
+
+///releases memory obtained by alignedAlloc, NULL is ignored
+inline void alignedFree( void* p )
+{
+	if (!p)
+		return;
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+#endif
@@ -12,6 +12,7 @@
 #include "common.h"
 #include <qgl.h>
 #include "FlowData.h"
+#include "interpolation.h"
 #include "TFTexture.h"
 #include "Ball.h"
 #include "Player.h"
@@ -103,6 +104,20 @@ public slots:
 	*/
 	void setRK(bool enabled);
 
+	//! Slot that toggles integration of the streamlines in computational space.
+	/*!
+		In computational space the streamlines advance in vertex indexes (i,j) using the velocity transformed by the inverse grid Jacobian.
+		Physical positions are only reconstructed for drawing.
+		\param enabled True to integrate in computational space, false to integrate in screen space.
+	*/
+	void setComputationalSpace(bool enabled);
+
+	//! Slot to set the interpolation scheme used for the streamlines in computational space.
+	/*!
+		\param mode The InterpolationMode: nearest, bilinear, Catmull-Rom or monotone cubic.
+	*/
+	void setInterpolation(int mode);
+
 	//! Slot to set the number of streamlines.
 	/*!
 		\param num The new number of streamlines (rows and colums).
@@ -155,7 +170,7 @@ protected:
 
 	//! Resizes the GL viewport on widget resize.
 	/*!
-		Overwritten from QGLWidget.
+		Overwritten from QGLWidget. Uploads another display level if the new size calls for one.
 		\param width New viewport width.
 		\param height New viewport height.
 		\sa initializeGL(), paintGL()
@@ -229,6 +244,12 @@ private:
 	//! The flag that determines which algorithm is used for the streamlines. True for Runge-Kutta second order, false for Euler's method.
 	bool rk;
 
+	//! The flag that determines whether the streamlines are integrated in computational space.
+	bool computational;
+
+	//! The interpolation scheme used for the streamlines in computational space.
+	InterpolationMode interpolation;
+
 	//! The number of streamlines (rows and columns).
 	int numLines;
 
@@ -257,7 +278,11 @@ private:
 	FlowData *dataset;
 
 	//! The velocity data.
-	float *velocity;
+	/*!
+		The velocity (x, y and magnitude) resampled onto a regular grid of dimX x dimY pixels. Owned by the resampler of the dataset,
+		which may drop it to stay within the memory budget, so paintGL() asks for it again every frame.
+	*/
+	const float *velocity;
 
 	//! The channel id for the x-coordinate of the velocity data.
 	int chX;
@@ -268,6 +293,32 @@ private:
 	//! The channel id for the magnitude of the velocity data.
 	int vel;
 
+	//! The channel id for the validity of the vertices.
+	/*!
+		1 for valid and 0 for invalid vertices, -1 if the dataset has no invalid vertices. \sa FlowData::createChannelValidity()
+	*/
+	int valid;
+
+	//! The validity resampled onto the same grid as the velocity.
+	/*!
+		0 where the pixel lies in a blocked cell (e.g. inside of an obstacle) or outside of the grid, NULL without invalid vertices.
+		Owned by the resampler of the dataset and asked for again every frame, like the velocity.
+	*/
+	const float *validity;
+
+	//! Returns true if the pixel of the regular velocity grid is blocked.
+	/*!
+		\param x The x-coordinate of the pixel.
+		\param y The y-coordinate of the pixel.
+	*/
+	bool isBlocked(float x, float y);
+
+	//! The velocity in computational space.
+	/*!
+		Both components (i and j) of every vertex stored next to each other, so the integrator fetches whole vectors. Owned by the dataset.
+	*/
+	FlowChannelGroup* computationalVelocity;
+
 	//! The flow geometry.
 	FlowGeometry* geometry;
 	//FlowChannel* channel3;
@@ -275,7 +326,44 @@ private:
 	//! The OpenGL id for the data channel 3 texture.
 	GLuint channel3Texture;
 
+	//! The level of the geometry and channel pyramids shown by the color map.
+	/*!
+		Level 0 is the full resolution, every further level halves the number of vertices in both directions.
+		\sa updateDisplayLevel(), FlowGeometry::getLevel()
+	*/
+	int displayLevel;
+
+	//! Chooses the coarsest level that still has a vertex for every pixel of the widget and uploads it.
+	/*!
+		Keeps the texture sizes (and the work of extracting them) bounded by the screen instead of the data. Called after loading and on every resize that changes the level.
+		\sa uploadDisplayLevel(), resizeGL()
+	*/
+	void updateDisplayLevel();
+
+	//! Uploads the grid texture and the data channel 3 texture from the given level of the pyramids.
+	/*!
+		The channel is normalized to the robust range of the full resolution channel, so the colors do not change with the level.
+		\param level The level of the pyramids.
+	*/
+	void uploadDisplayLevel(int level);
+
+	//! Reports the memory of the textures to the memory governor of the dataset.
+	/*!
+		\sa FlowMemory, FlowData::getMemory()
+	*/
+	void reportTextureMemory();
+
+	//! Deletes the textures holding the current dataset.
+	/*!
+		Called before a dataset is loaded and by the destructor, the transfer function texture is kept.
+		\sa loadDataSet()
+	*/
+	void deleteDataTextures();
+
 	//! The OpenGL id for the velocity texture.
+	/*!
+		Holds the resampled velocity, used by the arrow plot.
+	*/
 	GLuint velocityTexture;
 
 	//! The OpenGL id for the vertex shader for the velocity magnitude image.
@@ -314,12 +402,6 @@ private:
 	//! The OpenGL id for the arrow plot shader program with scaling.
 	GLuint arrowScaleProgram;
 
-	//! the OpenGL id for the velocity texture generation shader.
-	GLuint velocityShader;
-
-	//! the OpenGL id for the velocity texture generation shader program.
-	GLuint velocityProgram;
-
 	//! The OpenGL id for the arrow sprite texture.
 	GLuint sprite;
 
@@ -338,28 +420,6 @@ private:
 	//! The inverse texture generated from the y-axis of the grid.
 	GLuint inverseGridYTexture;
 
-	//! Flag to check whether the x and y axis need to be flipped.
-	bool isFlipped;
-
-	//! Flag to check whether the velocity texture needs to be recomputed.
-	bool initVelocity;
-
-	//! The OpenGL id for the velocity texture render buffer.
-	GLuint velocityTextureFBO;
-
-	//! The OpenGL id for the velocity texture frame buffer object.
-	GLuint fbo_velocity;
-
-	//! The OpenGL id for the velocity texture depth buffer object.
-	GLuint depth_rb_velocity;
-
-	//! Generates the velocity texture.
-	/*!
-		Sets up a frame buffer object and generates a texture used to properly align the velocity data according to the grid.
-	*/
-
-	void initializeVelocity(void);
-
 	//! Draws the arrow plot.
 	/*!
 		Draws a grid of arrow point sprites, rotated and (optionally) scaled in the shader.
@@ -381,8 +441,9 @@ private:
 		Euler's method is used to approximate the curve, using the step size set in the UI.
 		\param x The x-coordinate of the starting point.
 		\param y The y-coordinate of the starting point.
+		\return False if the point left the grid or entered an obstacle, see FlowMask.
 	*/
-	void euler(float *x, float *y);
+	bool euler(float *x, float *y);
 
 	//! Approximates the next point in a curve using a Runge-Kutta second order algorithm.
 	/*!
@@ -390,8 +451,26 @@ private:
 		A Runge-Kutta second order algorithm is used to approximate the curve, using the step size set in the UI.
 		\param x The x-coordinate of the starting point.
 		\param y The y-coordinate of the starting point.
+		\return False if the point left the grid or entered an obstacle, see FlowMask.
+	*/
+	bool rungeKutta(float *x, float *y);
+
+	//! Draws the streamlines integrated in computational space.
+	/*!
+		The interpolation policy is a template parameter, so the whole integration is specialized for it. drawStreamlines picks the policy once per frame.
+	*/
+	template < class Policy > void drawComputationalStreamlines();
+
+	//! Approximates the next point in a curve in computational space.
+	/*!
+		Advances the given vertex index position using the velocity transformed into computational space,
+		with either Euler's method or the Runge-Kutta second order algorithm, depending on the UI setting.
+		The velocity is interpolated with the given policy.
+		\param i The fractional x index of the starting point.
+		\param j The fractional y index of the starting point.
+		\return False if the point left the grid or entered a blocked cell, see FlowMask.
 	*/
-	void rungeKutta(float *x, float *y);
+	template < class Policy > bool integrateComputational(float *i, float *j);
 
 	//! Updates the ball for the Pong game.
 	/*!
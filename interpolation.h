@@ -0,0 +1,175 @@
+#ifndef INTERPOLATION_H
+#define INTERPOLATION_H
+
+#include <math.h>
+#include "FlowGeometry.h"
+
+///interpolation schemes for the run-time selection, each one maps to one of the policies below
+enum InterpolationMode {
+	///value of the closest vertex of the cell
+	INTERPOLATE_NEAREST,
+	///bilinear interpolation of the 4 cell vertices
+	INTERPOLATE_BILINEAR,
+	///Catmull-Rom bicubic interpolation of the 4x4 surrounding vertices
+	INTERPOLATE_CATMULL_ROM,
+	///bicubic Hermite interpolation with slopes limited so that no new extrema appear
+	INTERPOLATE_MONOTONE_CUBIC
+};
+
+/**
+* Interpolation policies. Each one provides
+*   template < class Values > static float sample(const Values& values, FlowGeometry* g, int cx, int cy, float s, float t)
+* which interpolates the values (stored in the vertex order of g) inside of the cell with the lower left vertex (cx,cy) at the cell coordinates s, t <0..1>.
+* Values is anything indexed by vertex ids: a plain const float* of a channel or a FlowStridedArray, e.g. one component of an interleaved FlowChannelGroup.
+* Samplers and integrators take the policy as a template parameter, so the inner loops get specialized at compile time.
+* The run-time InterpolationMode is resolved by a switch once per batch, never per sample.
+*/
+
+///value of the closest vertex of the cell
+struct InterpolateNearest{
+	template < class Values > static inline float sample(const Values& values, FlowGeometry* g, int cx, int cy, float s, float t)
+	{
+		return values[g->getVtx(cx + ((s < 0.5f) ? 0 : 1), cy + ((t < 0.5f) ? 0 : 1))];
+	}
+};
+
+///bilinear interpolation of the 4 cell vertices
+struct InterpolateBilinear{
+	template < class Values > static inline float sample(const Values& values, FlowGeometry* g, int cx, int cy, float s, float t)
+	{
+		return (1-t)*((1-s)*values[g->getVtx(cx,cy)] + s*values[g->getVtx(cx+1,cy)])
+			+ t*((1-s)*values[g->getVtx(cx,cy+1)] + s*values[g->getVtx(cx+1,cy+1)]);
+	}
+};
+
+///collects the 4x4 vertices around the cell row by row. Vertices beyond the border are extrapolated linearly, which keeps the cubic schemes exact for linear data there.
+template < class Values > inline void gatherStencil(const Values& values, FlowGeometry* g, int cx, int cy, float stencil[4][4])
+{
+	int xs[4], ys[4];
+	for (int k = 0; k < 4; k++)
+	{
+		int x = cx - 1 + k;
+		int y = cy - 1 + k;
+		xs[k] = (x < 0) ? 0 : ((x > g->getDimX()-1) ? g->getDimX()-1 : x);
+		ys[k] = (y < 0) ? 0 : ((y > g->getDimY()-1) ? g->getDimY()-1 : y);
+	}
+	for (int r = 0; r < 4; r++)
+		for (int k = 0; k < 4; k++)
+			stencil[r][k] = values[g->getVtx(xs[k], ys[r])];
+
+	bool left = (cx - 1 < 0);
+	bool right = (cx + 2 > g->getDimX()-1);
+	for (int r = 0; r < 4; r++)
+	{
+		if (left)
+			stencil[r][0] = 2.0f*stencil[r][1] - stencil[r][2];
+		if (right)
+			stencil[r][3] = 2.0f*stencil[r][2] - stencil[r][1];
+	}
+	if (cy - 1 < 0)
+		for (int k = 0; k < 4; k++)
+			stencil[0][k] = 2.0f*stencil[1][k] - stencil[2][k];
+	if (cy + 2 > g->getDimY()-1)
+		for (int k = 0; k < 4; k++)
+			stencil[3][k] = 2.0f*stencil[2][k] - stencil[1][k];
+}
+
+///Catmull-Rom bicubic interpolation of the 4x4 surrounding vertices
+struct InterpolateCatmullRom{
+	///interpolates between p1 and p2 at u <0..1>
+	static inline float cubic(const float* p, float u)
+	{
+		return p[1] + 0.5f*u*(p[2] - p[0] + u*(2.0f*p[0] - 5.0f*p[1] + 4.0f*p[2] - p[3] + u*(3.0f*(p[1] - p[2]) + p[3] - p[0])));
+	}
+
+	template < class Values > static inline float sample(const Values& values, FlowGeometry* g, int cx, int cy, float s, float t)
+	{
+		float stencil[4][4];
+		gatherStencil(values, g, cx, cy, stencil);
+		float column[4];
+		for (int r = 0; r < 4; r++)
+			column[r] = cubic(stencil[r], s);
+		return cubic(column, t);
+	}
+};
+
+///bicubic Hermite interpolation, the slopes are limited (Fritsch-Carlson) so that every 1D pass stays monotone between two vertices
+struct InterpolateMonotoneCubic{
+	///interpolates between p1 and p2 at u <0..1>
+	static inline float cubic(const float* p, float u)
+	{
+		float delta = p[2] - p[1];
+		float d1 = 0.5f*(p[2] - p[0]);
+		float d2 = 0.5f*(p[3] - p[1]);
+		if (delta == 0.0f)
+			d1 = d2 = 0.0f;
+		else
+		{
+			//slopes against the direction of the segment would overshoot, steep ones as well
+			if (d1*delta < 0.0f)
+				d1 = 0.0f;
+			if (d2*delta < 0.0f)
+				d2 = 0.0f;
+			float limit = 3.0f*fabs(delta);
+			d1 = (d1 > limit) ? limit : ((d1 < -limit) ? -limit : d1);
+			d2 = (d2 > limit) ? limit : ((d2 < -limit) ? -limit : d2);
+		}
+		float u2 = u*u;
+		float u3 = u2*u;
+		return (2*u3 - 3*u2 + 1)*p[1] + (u3 - 2*u2 + u)*d1 + (-2*u3 + 3*u2)*p[2] + (u3 - u2)*d2;
+	}
+
+	template < class Values > static inline float sample(const Values& values, FlowGeometry* g, int cx, int cy, float s, float t)
+	{
+		float stencil[4][4];
+		gatherStencil(values, g, cx, cy, stencil);
+		float column[4];
+		for (int r = 0; r < 4; r++)
+			column[r] = cubic(stencil[r], s);
+		return cubic(column, t);
+	}
+};
+
+///interpolates the values bilinearly inside of the cell (cx,cy) at the cell coordinates s, t and differentiates the interpolant, all from the same 4 vertices
+/**
+* The gradient is taken with respect to the normalized coordinates: the derivatives along s and t are mapped through the inverse of the Jacobian of the bilinear cell mapping,
+* so curvilinear cells are handled exactly. Divide by the size of the domain to get the physical gradient. Degenerate cells give a zero gradient.
+* @param gradient receives d/dx and d/dy
+*/
+inline void sampleBilinearGradient(const float* values, FlowGeometry* g, int cx, int cy, float s, float t, float* value, float* gradient)
+{
+	int v00 = g->getVtx(cx,cy);
+	int v10 = g->getVtx(cx+1,cy);
+	int v01 = g->getVtx(cx,cy+1);
+	int v11 = g->getVtx(cx+1,cy+1);
+	float f00 = values[v00], f10 = values[v10], f01 = values[v01], f11 = values[v11];
+	*value = (1-t)*((1-s)*f00 + s*f10) + t*((1-s)*f01 + s*f11);
+
+	//derivatives of the value and of the position along the cell coordinates
+	float fs = (1-t)*(f10 - f00) + t*(f11 - f01);
+	float ft = (1-s)*(f01 - f00) + s*(f11 - f10);
+	float xs = (1-t)*(g->getPosX(v10) - g->getPosX(v00)) + t*(g->getPosX(v11) - g->getPosX(v01));
+	float xt = (1-s)*(g->getPosX(v01) - g->getPosX(v00)) + s*(g->getPosX(v11) - g->getPosX(v10));
+	float ys = (1-t)*(g->getPosY(v10) - g->getPosY(v00)) + t*(g->getPosY(v11) - g->getPosY(v01));
+	float yt = (1-s)*(g->getPosY(v01) - g->getPosY(v00)) + s*(g->getPosY(v11) - g->getPosY(v10));
+	//(fs, ft) = J^T grad with J = ((xs, xt), (ys, yt))
+	float det = xs*yt - xt*ys;
+	float inverse = (det != 0.0f) ? 1.0f / det : 0.0f;
+	gradient[0] = (yt*fs - ys*ft) * inverse;
+	gradient[1] = (xs*ft - xt*fs) * inverse;
+}
+
+///interpolates the values at fractional vertex indexes (i from 0 to dimX-1, j from 0 to dimY-1) with the given policy, no point location is needed
+template < class Policy, class Values > inline float sampleAtIndex( const Values& values, FlowGeometry* g, float i, float j )
+{
+	//lower left vertex of the cell, clamped so that the upper right one exists as well.
+	//The upper bound goes first, grids of a single vertex in a direction have a cell 0 as well (see FlowGeometry::getVtx).
+	int cx = (int)i;
+	int cy = (int)j;
+	cx = (cx > g->getDimX()-2) ? g->getDimX()-2 : cx;
+	cy = (cy > g->getDimY()-2) ? g->getDimY()-2 : cy;
+	cx = (cx < 0) ? 0 : cx;
+	cy = (cy < 0) ? 0 : cy;
+	return Policy::sample(values, g, cx, cy, i - cx, j - cy);
+}
+#endif
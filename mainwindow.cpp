@@ -50,6 +50,20 @@ MainWindow::MainWindow()
 	connect(rkButton, SIGNAL(toggled(bool)), glWidget, SLOT(setRK(bool)));
     rkButton->setChecked(true);
 
+	checkComputational = new QCheckBox("Computational Space", widget);
+	connect(checkComputational, SIGNAL(toggled(bool)), glWidget, SLOT(setComputationalSpace(bool)));
+	checkComputational->setChecked(false);
+
+	labelInterpolation = new QLabel("Interpolation");
+	comboInterpolation = new QComboBox();
+	//the order matches InterpolationMode
+	comboInterpolation->addItem("Nearest");
+	comboInterpolation->addItem("Bilinear");
+	comboInterpolation->addItem("Catmull-Rom");
+	comboInterpolation->addItem("Monotone Cubic");
+	connect(comboInterpolation, SIGNAL(currentIndexChanged(int)), glWidget, SLOT(setInterpolation(int)));
+	comboInterpolation->setCurrentIndex(INTERPOLATE_BILINEAR);
+
 	labelNumLines = new QLabel("Number of Streamlines");
 	sbNumLines = new QSpinBox();
 	sbNumLines->setMinimum(10);
@@ -90,6 +104,9 @@ MainWindow::MainWindow()
     linesGroupLayout->addWidget(labelStepSize, 5, 1);
     linesGroupLayout->addWidget(sbStepSize, 5, 2);
     linesGroupLayout->addWidget(checkLockedSteps, 6, 1);
+    linesGroupLayout->addWidget(checkComputational, 7, 1);
+    linesGroupLayout->addWidget(labelInterpolation, 8, 1);
+    linesGroupLayout->addWidget(comboInterpolation, 8, 2);
     linesGroup->setLayout(linesGroupLayout);
 
 	checkPong = new QCheckBox("Enabled", widget);
@@ -198,5 +215,9 @@ void MainWindow::loadDataset()
 {
 	QString fileName = QFileDialog::getOpenFileName(this, tr("Load Dataset"), "", tr("Flow Geometry (*.gri)"));
 	if(!fileName.isNull())
+	{
 		glWidget->loadDataSet(fileName.toStdString());
+		//the histogram of the new data set is shown behind the transfer function
+		transferView->drawTF();
+	}
 }
@@ -70,6 +70,15 @@ private:
 	//! The button that switches to Runge-Kutta algorithm.
 	QRadioButton *rkButton;
 
+	//! The checkbox that switches the streamline integration to computational space.
+	QCheckBox *checkComputational;
+
+	//! The label for the combobox for the interpolation scheme.
+	QLabel *labelInterpolation;
+
+	//! The combobox for the interpolation scheme used in computational space.
+	QComboBox *comboInterpolation;
+
 	//! The label for the spinbox for the number of streamlines.
 	QLabel *labelNumLines;
 
@@ -0,0 +1,37 @@
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include <string.h>
+
+///edge length of the square blocks used by transposeBlocked, 32x32 records keep both the source and the destination block in L1 for small records
+#define TRANSPOSE_BLOCK 32
+
+/**
+* A templated routine that transposes a row-major matrix of records in a cache-friendly way.
+* The matrix is walked in square blocks, so that both the reads and the writes stay inside a few cache lines,
+* and the block rows are distributed among the OpenMP threads (if OpenMP is enabled).
+* @param src source matrix with rows*cols records, each record consisting of recordSize elements
+* @param dst destination matrix with cols*rows records, must not overlap with src
+* @param rows number of rows of the source matrix
+* @param cols number of columns of the source matrix
+* @param recordSize number of elements of type T forming one record (e.g. 3 for a vec3 stored as floats)
+*/
+template < typename T > void transposeBlocked( const T* src, T* dst, int rows, int cols, int recordSize = 1 )
+{
+	int blockRows = (rows + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+	#pragma omp parallel for schedule(static)
+	for (int b = 0; b < blockRows; b++)
+	{
+		int r0 = b * TRANSPOSE_BLOCK;
+		int r1 = (r0 + TRANSPOSE_BLOCK < rows) ? r0 + TRANSPOSE_BLOCK : rows;
+		for (int c0 = 0; c0 < cols; c0 += TRANSPOSE_BLOCK)
+		{
+			int c1 = (c0 + TRANSPOSE_BLOCK < cols) ? c0 + TRANSPOSE_BLOCK : cols;
+			//the element (r,c) of the source becomes the element (c,r) of the destination
+			for (int r = r0; r < r1; r++)
+				for (int c = c0; c < c1; c++)
+					memcpy(dst + ((size_t)c * rows + r) * recordSize, src + ((size_t)r * cols + c) * recordSize, recordSize * sizeof(T));
+		}
+	}
+}
+#endif